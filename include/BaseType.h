@@ -56,4 +56,28 @@ enum class Format
 	D24_UNORM_S8_UINT,
 };
 
+// Bytes per texel, depth formats count the depth aspect only as copied to a buffer
+inline Uint32 FormatTexelSize(Format format)
+{
+	switch (format)
+	{
+	case Format::R8_UINT:
+		return 1;
+	case Format::RGB8_UNORM:
+		return 3;
+	case Format::R32_UINT:
+	case Format::R32_FLOAT:
+	case Format::RGBA8_UNORM:
+	case Format::RGBA8_SRGB:
+	case Format::BGRA8_SRGB:
+	case Format::D32_FLOAT:
+	case Format::D24_UNORM_S8_UINT:
+		return 4;
+	case Format::RGBA32_FLOAT:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
 enum class CompOp { Never, Less, Equal, LessEqual, Greater, NotEqual, GreaterEqual, Always };
@@ -0,0 +1,36 @@
+#pragma once
+#include <chrono>
+#include <span>
+#include <string>
+#include "BaseType.h"
+
+namespace TinyRHI
+{
+	// Clock of every profiler timestamp (CPU zones, calibrated GPU scopes), nanoseconds
+	inline Uint64 TraceClockNs()
+	{
+		return (Uint64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// One complete ("X") event of a trace. name and category are kept by pointer, string literals
+	struct TraceEvent
+	{
+		const char* name = nullptr;
+		const char* category = nullptr;
+		Uint32 threadId = 0;
+		Uint64 beginNs = 0;
+		Uint64 durationNs = 0;
+	};
+
+	// Timeline row of the trace viewer
+	struct TraceThread
+	{
+		Uint32 threadId = 0;
+		std::string name;
+	};
+
+	// Chrome trace event JSON, opens in chrome://tracing and ui.perfetto.dev. Times are written relative
+	// to the earliest event. False when the file cannot be written
+	Bool WriteChromeTrace(const char* filePath, std::span<const TraceEvent> events, std::span<const TraceThread> threads);
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ChromeTrace.h"
+
+namespace TinyRHI
+{
+	// Zones kept per thread, older ones are overwritten
+	#define CpuProfileRingSize 16384
+
+	/*
+	* Scoped CPU zones of the RHI hot paths, compiled in with RHI_CPU_PROFILE (CMake CPU_PROFILE) only.
+	* Each thread writes into its own ring without locks; the rings outlive their threads so a trace can
+	* still be exported after a worker exits. IRHIHandle::ExportTrace merges them with the GPU timeline.
+	*/
+	class CpuProfiler
+	{
+	public:
+		static CpuProfiler& Get();
+
+		// name is kept by pointer, a string literal
+		void Record(const char* name, Uint64 beginNs, Uint64 endNs);
+		// Row name of the calling thread in the trace
+		void SetThreadName(const char* name);
+		void AppendTrace(std::vector<TraceEvent>& events, std::vector<TraceThread>& threads);
+
+	private:
+		// Relaxed atomics: an export may read a slot the owner is overwriting, and drops it afterwards
+		struct ZoneRecord
+		{
+			std::atomic<const char*> name;
+			std::atomic<Uint64> beginNs;
+			std::atomic<Uint64> endNs;
+		};
+
+		struct ThreadRing
+		{
+			Uint32 threadId;
+			std::string name;
+			// Written by the owning thread only, zones [0, writeCount) were recorded
+			std::atomic<Uint64> writeCount = 0;
+			ZoneRecord zones[CpuProfileRingSize];
+		};
+
+		ThreadRing& GetThreadRing();
+
+		static thread_local ThreadRing* threadRing;
+
+		std::mutex mutex;
+		std::vector<std::shared_ptr<ThreadRing>> rings;
+	};
+
+	class CpuProfileZone
+	{
+	public:
+		explicit CpuProfileZone(const char* _name)
+			: name(_name), beginNs(TraceClockNs())
+		{
+		}
+
+		~CpuProfileZone()
+		{
+			CpuProfiler::Get().Record(name, beginNs, TraceClockNs());
+		}
+
+		CpuProfileZone(const CpuProfileZone&) = delete;
+		CpuProfileZone& operator=(const CpuProfileZone&) = delete;
+
+	private:
+		const char* name;
+		Uint64 beginNs;
+	};
+
+#define RHI_PROFILE_CONCAT_IMPL(a, b) a##b
+#define RHI_PROFILE_CONCAT(a, b) RHI_PROFILE_CONCAT_IMPL(a, b)
+#ifdef RHI_CPU_PROFILE
+	// Times the rest of the enclosing block
+	#define RHI_PROFILE_ZONE(name) ::TinyRHI::CpuProfileZone RHI_PROFILE_CONCAT(rhiProfileZone, __LINE__)(name)
+#else
+	#define RHI_PROFILE_ZONE(name)
+#endif
+}
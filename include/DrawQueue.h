@@ -0,0 +1,68 @@
+#pragma once
+#include "IRHIHandle.h"
+#include <vector>
+#include <unordered_map>
+
+namespace TinyRHI
+{
+	enum class DrawSortPolicy
+	{
+		// pass, pipeline, binding group, vertex buffer, then front to back
+		Opaque,
+		// pass, back to front, then pipeline, binding group, vertex buffer
+		Transparent,
+		// pass, then submission order
+		None,
+	};
+
+	// Collects DrawItems with a 64 bit sort key and radix sorts them before SubmitDraws, so draws
+	// sharing state end up next to each other. The compact ids packed into the keys are assigned per
+	// pipeline / binding group / buffer on first use and forgotten by Clear, so a pointer freed and
+	// reused by the next batch never keeps a stale id. One batch holds up to 16384 pipelines, 16384
+	// binding groups and 4096 vertex buffers. Keep one queue alive across frames, its storage is reused
+	class DrawQueue
+	{
+	public:
+		explicit DrawQueue(DrawSortPolicy _policy = DrawSortPolicy::Opaque)
+			: policy(_policy)
+		{
+		}
+
+		// pass < 16 orders whole groups of draws, depth is the view space distance (>= 0)
+		void Add(const DrawItem& item, Uint32 pass, Float depth);
+
+		void Sort();
+		// Sorts, records every item through SubmitDraws and clears the queue
+		void Submit(IRHIHandle* handle);
+		void Clear();
+
+		std::span<const DrawItem> SortedItems() const
+		{
+			return sortedItems;
+		}
+
+		Uint32 Size() const
+		{
+			return static_cast<Uint32>(items.size());
+		}
+
+	private:
+		Uint64 MakeKey(const DrawItem& item, Uint32 pass, Float depth);
+		Uint32 CompactId(std::unordered_map<const void*, Uint32>& ids, const void* ptr, Uint32 bits);
+
+	private:
+		DrawSortPolicy policy;
+
+		std::vector<DrawItem> items;
+		std::vector<Uint64> keys;
+
+		// Radix sort ping-pong buffers of (key, item index)
+		std::vector<Uint64> sortKeys[2];
+		std::vector<Uint32> sortIndices[2];
+		std::vector<DrawItem> sortedItems;
+
+		std::unordered_map<const void*, Uint32> pipelineIds;
+		std::unordered_map<const void*, Uint32> groupIds;
+		std::unordered_map<const void*, Uint32> bufferIds;
+	};
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "IRHIHandle.h"
+#include <vector>
+
+namespace TinyRHI
+{
+	// One cullable object, std430 layout of CullingObject in shader/GpuCulling.comp
+	struct CullingObject
+	{
+		Float boundsCenter[3] = { 0, 0, 0 };
+		Float boundsRadius = 0;
+		// Draw emitted when the object survives. firstInstance is passed through unchanged,
+		// so the vertex shader can fetch per-object data with gl_InstanceIndex
+		Uint32 indexCount = 0;
+		Uint32 firstIndex = 0;
+		Int32 vertexOffset = 0;
+		Uint32 firstInstance = 0;
+	};
+
+	// std140 layout of CullingView in shader/GpuCulling.comp
+	struct CullingView
+	{
+		// Column major, clip = viewProj * world
+		Float viewProj[16] = {};
+		// xyz inward normal, w distance, see GpuCulling::ExtractFrustumPlanes
+		Float frustumPlanes[6][4] = {};
+		// Hi-Z only: size of mip 0 and mip count of the pyramid
+		Float hiZSize[2] = { 0, 0 };
+		Uint32 hiZMipCount = 0;
+		Uint32 bReverseZ = 0;
+	};
+
+	struct GpuCullingDesc
+	{
+		// shader/GpuCulling.comp
+		IShader* frustumShader = nullptr;
+		// shader/GpuCulling.comp compiled with -DHIZ_OCCLUSION, only needed by Cull(hiZ)
+		IShader* occlusionShader = nullptr;
+		Uint32 maxObjectCount = 0;
+	};
+
+	// Culls a static object list on the GPU and draws the survivors with one indirect count draw:
+	//   BeginCommand()
+	//   culling.Cull(hiZ)                     // outside of a render pass, once per frame
+	//   BeginRenderPass() ... SetGraphicsPipeline(...)
+	//   culling.Draw(indexBuffer)
+	// The object and view buffers hold one copy per frame in flight, each Cull writes the next one
+	class GpuCulling
+	{
+	public:
+		GpuCulling(IRHIHandle* _handle, const GpuCullingDesc& _desc);
+
+		// Both are kept on the CPU and written into the frame's buffers by the next Cull
+		void UpdateObjects(const CullingObject* objects, Uint32 objectCount);
+		void UpdateView(const CullingView& view);
+		// Fills view.frustumPlanes from view.viewProj, clip space depth in [0, 1]
+		static void ExtractFrustumPlanes(CullingView& view);
+
+		// hiZ is a sampled pyramid holding the farthest depth of each texel (typically last frame's depth),
+		// nullptr for frustum culling only
+		void Cull(ITexture* hiZ = nullptr);
+		void Draw(IBuffer* indexBuffer);
+
+		// Objects read by the last Cull
+		IBuffer* ObjectBuffer() { return objectBuffers[frameSlot]; }
+		IBuffer* DrawArgsBuffer() { return drawArgsBuffer; }
+		IBuffer* DrawCountBuffer() { return drawCountBuffer; }
+
+	private:
+		IRHIHandle* handle;
+		GpuCullingDesc desc;
+
+		std::vector<CullingObject> objects;
+		CullingView view;
+		// Bumped by UpdateObjects, a frame's object buffer is rewritten when it is behind
+		Uint32 objectsVersion = 0;
+		Uint32 slotObjectsVersion[MaxFrameInFlight] = {};
+		Uint32 frameSlot = MaxFrameInFlight - 1;
+
+		IBuffer* viewBuffers[MaxFrameInFlight];
+		IBuffer* objectBuffers[MaxFrameInFlight];
+		IBuffer* drawArgsBuffer;
+		IBuffer* drawCountBuffer;
+	};
+}
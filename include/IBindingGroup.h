@@ -0,0 +1,33 @@
+#pragma once
+#include "BaseType.h"
+#include "IShader.h"
+#include "IBuffer.h"
+#include "IImageView.h"
+#include <vector>
+
+namespace TinyRHI
+{
+	struct BindingGroupEntry
+	{
+		enum class Type { UniformBuffer, StorageBuffer, SamplerTexture, StorageTexture, } type = Type::UniformBuffer;
+		Uint bindingId = 0;
+		IShader::Stage stage = IShader::Stage::Vertex;
+		IBuffer* buffer = nullptr;
+		ITexture* texture = nullptr;
+		// Buffers only, range 0 means up to the end of the buffer
+		Uint32 offset = 0;
+		Uint32 range = 0;
+	};
+
+	struct BindingGroupDesc
+	{
+		std::vector<BindingGroupEntry> entries;
+	};
+
+	// Resources of one descriptor set, written once when created
+	class IBindingGroup
+	{
+	public:
+		virtual ~IBindingGroup() {}
+	};
+}
@@ -11,14 +11,53 @@ namespace TinyRHI
 		Bool bUniform = false;
 		Bool bIndirect = false;
 		Bool bTransfer = false;
+		// Source of IRHIHandle::BeginConditional
+		Bool bPredicate = false;
 	};
 
+	// Uint8 needs VK_EXT_index_type_uint8, see DeviceData::enabledFeatures.indexTypeUint8
+	enum class IndexType { Uint16, Uint32, Uint8 };
+
 	struct BufferDesc
 	{
 		BufferType bufferType;
 		Uint32 elementNum = 0;
 		Uint32 stride = 0;
 		Bool bStaging = false;
+		// Index format used when the buffer is passed straight to a DrawIndexPrimitive* call
+		IndexType indexType = IndexType::Uint16;
+	};
+
+	// How a buffer is accessed on either side of IRHIHandle::SetBufferBarrier
+	enum class BufferAccess
+	{
+		TransferWrite,
+		ComputeRead,
+		ComputeWrite,
+		IndirectArgument,
+		VertexInput,
+		GraphicsRead,
+		// Read by IRHIHandle::BeginConditional
+		Predicate,
+	};
+
+	// One record of an argument buffer for DrawPrimitiveIndirect*, same layout as VkDrawIndirectCommand
+	struct DrawIndirectArgs
+	{
+		Uint32 vertexCount = 0;
+		Uint32 instanceCount = 1;
+		Uint32 firstVertex = 0;
+		Uint32 firstInstance = 0;
+	};
+
+	// One record of an argument buffer for DrawIndexPrimitiveIndirect*, same layout as VkDrawIndexedIndirectCommand
+	struct DrawIndexedIndirectArgs
+	{
+		Uint32 indexCount = 0;
+		Uint32 instanceCount = 1;
+		Uint32 firstIndex = 0;
+		Int32 vertexOffset = 0;
+		Uint32 firstInstance = 0;
 	};
 
 	class IBuffer
@@ -9,6 +9,13 @@
 #include "IPipeline.h"
 #include "IFramebuffer.h"
 #include "ITransition.h"
+#include "IBindingGroup.h"
+#include "ResourceHandle.h"
+#include "JobSystem.h"
+#include <span>
+#include <coroutine>
+#include <string>
+#include <vector>
 
 #ifdef RHI_SUPPORT_VULKAN
 #include "vulkan/vulkan.hpp"
@@ -16,6 +23,11 @@
 
 namespace TinyRHI
 {
+#ifdef RHI_SUPPORT_VULKAN
+	class UploadContextsVk;
+	class BindlessHeapVk;
+#endif
+
 	struct DeviceData
 	{
 		#ifdef RHI_SUPPORT_VULKAN
@@ -37,18 +49,176 @@ namespace TinyRHI
 
 			vk::CommandPool commandPool = VK_NULL_HANDLE;
 			vk::DescriptorPool descriptorPool = VK_NULL_HANDLE;
+			// Per thread upload pools and the queue lock
+			UploadContextsVk* uploadContexts = nullptr;
+			// Null without bindless, deleted textures and buffers hand their slot back through it
+			BindlessHeapVk* bindlessHeap = nullptr;
+
+			vk::PhysicalDeviceProperties properties;
+
+			// Optional features actually enabled on logicalDevice
+			struct EnabledFeatures
+			{
+				bool bindless = false;
+				bool descriptorBuffer = false;
+				bool pushDescriptor = false;
+				bool multiDrawIndirect = false;
+				bool drawIndirectCount = false;
+				bool indexTypeUint8 = false;
+				bool calibratedTimestamps = false;
+				bool hostQueryReset = false;
+				bool pipelineStatisticsQuery = false;
+				bool occlusionQueryPrecise = false;
+				bool conditionalRendering = false;
+			} enabledFeatures;
+
+			// Entry points of enabled device extensions
+			vk::DispatchLoaderDynamic dispatcher;
+			vk::PhysicalDeviceDescriptorBufferPropertiesEXT descriptorBufferProperties;
+			vk::PhysicalDevicePushDescriptorPropertiesKHR pushDescriptorProperties;
 		};
 		#elif RHI_SUPPORT_OPENGL
 
 		#endif
 	};
 
+	// Optional backend features, fixed when the handle is created
+	struct HandleDesc
+	{
+		// Global descriptor heap indexed from shaders, see IRHIHandle::GetBindlessIndex
+		Bool bBindless = false;
+		// Descriptors are written into a mapped ring buffer (VK_EXT_descriptor_buffer) instead of
+		// descriptor sets, ignored when bBindless is enabled
+		Bool bDescriptorBuffer = false;
+		// Allows IRHIHandle::SetPushDescriptorSet (VK_KHR_push_descriptor), ignored with bDescriptorBuffer
+		Bool bPushDescriptor = false;
+		// Workers of IRHIHandle::GetJobSystem, 0 for one per hardware thread minus the calling thread
+		Uint32 workerThreadCount = 0;
+		// Queue submits and presents of Commit/EndFrame run on a dedicated thread, so recording never
+		// blocks on the driver or on vsync. SetDefaultAttachments then renders into a back buffer of the
+		// swapchain's format that the thread blits into the acquired image, at the cost of one blit a frame
+		Bool bSubmitThread = false;
+		// Timestamp queries for IRHIHandle::BeginGpuScope and around every render pass and dispatch
+		Bool bGpuProfiler = false;
+	};
+
+	inline constexpr Uint32 InvalidBindlessIndex = ~0u;
+
+	// Texels of one mip level and array layer, an extent of 0 reaches to the end of the mip
+	struct TextureRegion
+	{
+		Uint32 mipLevel = 0;
+		Uint32 arrayLayer = 0;
+		Int32 offset[3] = { 0, 0, 0 };
+		Uint32 extent[3] = { 0, 0, 0 };
+	};
+
+	// GPU time of one scope name over the last resolved frames, scopes sharing a name are summed per frame
+	struct GpuScopeStats
+	{
+		std::string name;
+		Float64 lastMs = 0;
+		Float64 averageMs = 0;
+		Float64 minMs = 0;
+		Float64 maxMs = 0;
+		// In the last resolved frame
+		Uint32 callsPerFrame = 0;
+		// Frames behind averageMs, minMs and maxMs
+		Uint32 frameCount = 0;
+	};
+
+	// Occlusion: samples that passed the depth/stencil test, BinaryOcclusion: non zero if any did (cheaper).
+	// PipelineStatistics needs DeviceData::enabledFeatures.pipelineStatisticsQuery, it resolves to zeros without
+	enum class QueryType { Occlusion, BinaryOcclusion, PipelineStatistics };
+	inline constexpr Uint32 QueryTypeCount = 3;
+	// Query indices of each type in one frame
+	inline constexpr Uint32 MaxQueriesPerFrame = 1024;
+	// Frames recorded ahead of the GPU. BeginFrame waits for what was submitted MaxFrameInFlight frames
+	// earlier, so data the CPU writes every frame needs that many copies
+	inline constexpr Uint32 MaxFrameInFlight = 2;
+
+	// What IRHIHandle::ResolveQueries writes per PipelineStatistics query. Occlusion queries write one Uint32
+	struct PipelineStatistics
+	{
+		Uint64 inputAssemblyVertices;
+		Uint64 vertexShaderInvocations;
+		Uint64 clippingInvocations;
+		Uint64 clippingPrimitives;
+		Uint64 fragmentShaderInvocations;
+		Uint64 computeShaderInvocations;
+	};
+
+	class IRHIHandle;
+
+	// One submission to the GPU, from IRHIHandle::LastSubmit or Upload. co_await it inside an RHITask (RHITask.h)
+	struct GpuSyncPoint
+	{
+		IRHIHandle* handle = nullptr;
+		// Submissions are numbered from 1, 0 is always complete
+		Uint64 value = 0;
+	};
+
+	#define DrawItemPushConstantSize 16
+
+	// One draw of IRHIHandle::SubmitDraws. Consecutive items sharing a pipeline, binding group
+	// or stream only bind it once, so sorted items record the fewest commands
+	struct DrawItem
+	{
+		// From IRHIHandle::CreateDrawPipeline
+		IGraphicsPipeline* pipeline = nullptr;
+		// Bound as set 0, nullptr for pipelines without a set
+		IBindingGroup* bindingGroup = nullptr;
+		// Vertex stream 0
+		IBuffer* vertexBuffer = nullptr;
+		Uint32 vertexBufferOffset = 0;
+		// nullptr draws non indexed
+		IBuffer* indexBuffer = nullptr;
+		Uint32 indexBufferOffset = 0;
+		IndexType indexType = IndexType::Uint16;
+		// Vertex or index count and first vertex or index
+		Uint32 elementCount = 0;
+		Uint32 firstElement = 0;
+		Int32 vertexOffset = 0;
+		Uint32 instanceCount = 1;
+		Uint32 firstInstance = 0;
+		// push_constant block at offset 0 of the vertex and pixel shader
+		Uint32 pushConstants[DrawItemPushConstantSize / 4] = {};
+	};
+
+	// Counters accumulated since the handle was created
+	struct RHIStats
+	{
+		// Vulkan object creations issued by the layout caches, constant in steady state
+		Uint32 descriptorSetLayoutCreated = 0;
+		Uint32 pipelineLayoutCreated = 0;
+
+		// Descriptor sets are cached per frame by (layout, bound resources)
+		Uint64 descriptorSetAllocated = 0;
+		Uint64 descriptorSetCacheHit = 0;
+		Uint32 descriptorPoolCreated = 0;
+
+		// Commands recorded vs. filtered out because the command buffer already held that state
+		struct BindCounter
+		{
+			Uint64 emitted = 0;
+			Uint64 skipped = 0;
+		};
+		BindCounter pipelineBinds;
+		BindCounter descriptorSetBinds;
+		BindCounter pushConstantUpdates;
+		BindCounter vertexBufferBinds;
+		BindCounter indexBufferBinds;
+		// Viewport and scissor
+		BindCounter dynamicStates;
+	};
+
     class IRHIHandle
     {
     public:
 		virtual DeviceData* GetDeviceData() = 0;
 
-        // 
+        // Creation below may be called from any thread while another thread records, except
+        // CreateBindingGroup which belongs to the recording thread. Uploads block the calling thread only
         // ------------------------------------------------------------------------------------------------
 
 		virtual IShader* CreateVertexShader(const ShaderDesc& shaderDesc) = 0;
@@ -60,10 +230,31 @@ namespace TinyRHI
 		virtual ITexture* CreateTextureWithoutSampling(const ImageDesc& imageDesc) = 0;
 		virtual ITexture* CreateTexture(const ImageDesc& imageDesc, const SamplerState& samplerState) = 0;
 		virtual ITexture* CreateTextureWithData(const ImageDesc& imageDesc, const SamplerState& samplerState, void* data, Uint32 dataSize) = 0;
+		// nullptr with HandleDesc::bDescriptorBuffer: a group owns a real descriptor set
+		virtual IBindingGroup* CreateBindingGroup(const BindingGroupDesc& bindingGroupDesc) = 0;
+
+		// Pooled resources addressed by generational handles (ResourceHandle.h). data may be nullptr,
+		// samplerState nullptr creates a texture without sampling. Get* returns nullptr for a destroyed
+		// handle; Destroy* frees the handle at once and the GPU resource once the frames in flight retire
+		virtual BufferId CreateBufferId(const BufferDesc& bufferDesc, void* data, Uint32 dataSize) = 0;
+		virtual TextureId CreateTextureId(const ImageDesc& imageDesc, const SamplerState* samplerState, void* data, Uint32 dataSize) = 0;
+		virtual ShaderId CreateShaderId(IShader::Stage stage, const ShaderDesc& shaderDesc) = 0;
+		virtual IBuffer* GetBuffer(BufferId buffer) = 0;
+		virtual ITexture* GetTexture(TextureId texture) = 0;
+		virtual IShader* GetShader(ShaderId shader) = 0;
+		virtual void DestroyBuffer(BufferId buffer) = 0;
+		virtual void DestroyTexture(TextureId texture) = 0;
+		virtual void DestroyShader(ShaderId shader) = 0;
 
 		virtual Uint32 GetTotalVRAM() const = 0;
 		virtual Uint32 GetUsedVRAM() const = 0;
 
+		virtual RHIStats GetStats() const = 0;
+
+		// Scheduler shared by the RHI and the application, so both use the same cores. Loader jobs may
+		// create resources directly, see the creation rules above
+		virtual JobSystem* GetJobSystem() = 0;
+
         // Cmd
         // ------------------------------------------------------------------------------------------------
 
@@ -78,6 +269,61 @@ namespace TinyRHI
 
 		virtual IRHIHandle* Commit() = 0;
 
+		// Completion tracking, recording thread only. Waiters are resumed from BeginFrame and EndFrame
+		// once the GPU finished the submission, nothing ever blocks on it
+		virtual GpuSyncPoint LastSubmit() = 0;
+		virtual Bool IsComplete(GpuSyncPoint syncPoint) = 0;
+		virtual void WhenComplete(GpuSyncPoint syncPoint, std::coroutine_handle<> waiter) = 0;
+		// Copies data into buffer at offset on a separate submission, without waiting for it. data is
+		// consumed before returning. Host visible buffers are written directly and return a complete point.
+		// The copy waits for graphics work submitted before it; host visible buffers, and buffers read by
+		// compute commands on a separate compute queue, must be idle (IsComplete of their last use)
+		virtual GpuSyncPoint Upload(IBuffer* buffer, const void* data, Uint32 dataSize, Uint32 offset) = 0;
+
+		// Records a copy into a pooled, persistently mapped readback ring in the current command, outside of a
+		// render pass. Nothing waits: the data is ready once the Commit of that command completed. Texture rows
+		// are tightly packed. Each ticket must be released, its memory is recycled afterwards
+		virtual ReadbackTicket RequestReadback(IBuffer* buffer, Uint32 offset, Uint32 size) = 0;
+		virtual ReadbackTicket RequestReadback(ITexture* texture, const TextureRegion& region) = 0;
+		// Empty until Commit, then the submission to wait for
+		virtual GpuSyncPoint GetReadbackSyncPoint(ReadbackTicket ticket) = 0;
+		// Mapped result without a copy, an empty span while the GPU has not finished it
+		virtual std::span<const std::byte> GetReadbackData(ReadbackTicket ticket) = 0;
+		// Ends the ticket, also while its copy is in flight: the memory is then recycled once the copy completed
+		virtual void ReleaseReadback(ReadbackTicket ticket) = 0;
+
+		// Timestamp scope in the current command, needs HandleDesc::bGpuProfiler (no-ops otherwise). Scopes
+		// nest and may span render passes; name is kept by pointer, pass a string literal. Render passes and
+		// dispatches get "RenderPass" and "Dispatch" scopes of their own
+		virtual IRHIHandle* BeginGpuScope(const char* name) = 0;
+		virtual IRHIHandle* EndGpuScope() = 0;
+		// Results arrive a few frames after recording, frames the GPU has not finished by then are skipped
+		virtual std::vector<GpuScopeStats> GetGpuScopeStats() = 0;
+		// Chrome trace JSON of the last resolved frames: frames and scope recording on the CPU clock, next
+		// to scope execution on the GPU mapped onto the same clock, plus the CPU zones of every thread
+		// when built with RHI_CPU_PROFILE (CpuProfiler.h)
+		virtual Bool ExportTrace(const char* filePath) = 0;
+
+		// Queries of one frame, index < MaxQueriesPerFrame and each index begun at most once per type and
+		// frame. Occlusion queries begin and end inside one render pass. Only graphics commands record queries,
+		// BeginQuery and EndQuery come after the command's SetGraphicsPipeline or SubmitDraws
+		virtual IRHIHandle* BeginQuery(QueryType type, Uint32 index) = 0;
+		virtual IRHIHandle* EndQuery(QueryType type, Uint32 index) = 0;
+		// GPU side copy of the results into a transfer buffer, tightly packed from offset (a multiple of 4, of 8
+		// for PipelineStatistics), outside of a render pass. Consumers on the GPU need
+		// SetBufferBarrier(buffer, TransferWrite, ...), the CPU a RequestReadback.
+		// Every index in the range must have been ended this frame, others are asserted and written as zero
+		virtual IRHIHandle* ResolveQueries(QueryType type, Uint32 firstIndex, Uint32 count, IBuffer* buffer, Uint32 offset) = 0;
+
+		// Draws and dispatches up to EndConditional are skipped on the GPU when the Uint32 at offset (a multiple
+		// of 4) of a bPredicate buffer is zero, e.g. a resolved occlusion query or a flag written by a compute
+		// pass (barrier with BufferAccess::Predicate first). Does not nest. Begun inside a render pass, the block
+		// is closed by EndRenderPass at the latest; begun outside, EndConditional has to be outside of any pass
+		// too. EndCommand closes a block still open. Without DeviceData::enabledFeatures.conditionalRendering
+		// everything is drawn
+		virtual IRHIHandle* BeginConditional(IBuffer* buffer, Uint32 offset) = 0;
+		virtual IRHIHandle* EndConditional() = 0;
+
 		virtual IRHIHandle* SetGraphicsPipeline(const GfxSetting& gfxSetting) = 0;
 		virtual IRHIHandle* SetComputePipeline() = 0;
 
@@ -92,6 +338,13 @@ namespace TinyRHI
 		virtual IRHIHandle* SetComputeShader(IShader* shader) = 0;
 
 		virtual IRHIHandle* SetVertexStream(Uint32 vertId, IBuffer* buffer, Uint32 offset) = 0;
+		// Index buffer of the DrawIndexPrimitive* calls given a nullptr indexBuffer. offset is in bytes, so
+		// several meshes can share one buffer. Rebinding the same stream records nothing. An offset not aligned
+		// to the index size, or Uint8 without device support, unbinds the stream and indexed draws are skipped
+		virtual IRHIHandle* SetIndexStream(IBuffer* buffer, Uint32 offset, IndexType indexType) = 0;
+		// Handle overloads read the Vulkan buffer straight from the pool, a destroyed handle binds nothing
+		virtual IRHIHandle* SetVertexStream(Uint32 vertId, BufferId buffer, Uint32 offset) = 0;
+		virtual IRHIHandle* SetIndexStream(BufferId buffer, Uint32 offset, IndexType indexType) = 0;
 		virtual IRHIHandle* SetViewport(Extent2D minExt, Extent2D maxExt) = 0;
 		virtual IRHIHandle* SetViewport(Extent3D minExt, Extent3D maxExt) = 0;
 		virtual IRHIHandle* SetScissor(Extent2D minExt, Extent2D maxExt) = 0;
@@ -100,12 +353,64 @@ namespace TinyRHI
 		virtual IRHIHandle* SetStorageTexture(ITexture* texture, IShader::Stage stage, Uint setId, Uint bindingId) = 0;
 		virtual IRHIHandle* SetStorageBuffer(IBuffer* buffer, IShader::Stage stage, Uint setId, Uint bindingId) = 0;
 		virtual IRHIHandle* SetUniformBuffer(IBuffer* Buffer, IShader::Stage stage, Uint setId, Uint bindingId) = 0;
+		virtual IRHIHandle* SetSamplerTexture(TextureId texture, IShader::Stage stage, Uint setId, Uint bindingId) = 0;
+		virtual IRHIHandle* SetStorageBuffer(BufferId buffer, IShader::Stage stage, Uint setId, Uint bindingId) = 0;
+		virtual IRHIHandle* SetUniformBuffer(BufferId buffer, IShader::Stage stage, Uint setId, Uint bindingId) = 0;
+		// Binds [offset, offset + range) of the buffer through a dynamic descriptor: draws that only differ
+		// in offset share one descriptor set. offset must be a multiple of the device's minUniformBufferOffsetAlignment
+		// (uniform) or minStorageBufferOffsetAlignment (storage), 256 covers every device; others are dropped
+		virtual IRHIHandle* SetStorageBuffer(IBuffer* buffer, IShader::Stage stage, Uint setId, Uint bindingId, Uint32 offset, Uint32 range) = 0;
+		virtual IRHIHandle* SetUniformBuffer(IBuffer* Buffer, IShader::Stage stage, Uint setId, Uint bindingId, Uint32 offset, Uint32 range) = 0;
+		// Small per-draw data recorded straight into the command buffer, offset + size <= 128 bytes.
+		// Stages used before Set*Pipeline decide the push constant range of that pipeline's layout
+		virtual IRHIHandle* SetPushConstants(IShader::Stage stage, const void* data, Uint32 size, Uint32 offset) = 0;
 
 		virtual IRHIHandle* DrawPrimitive(Uint32 vertexCount, Uint32 firstVertex) = 0;
 		virtual IRHIHandle* DrawPrimitiveIndirect(IBuffer* argumentBuffer, Uint32 argumentOffset) = 0;
+		// A non null indexBuffer replaces the index stream with (indexBuffer, 0, its BufferDesc::indexType)
 		virtual IRHIHandle* DrawIndexPrimitive(IBuffer *indexBuffer, Uint32 indexCount, Uint32 firstIndex, Int32 vertOffset) = 0;
+		virtual IRHIHandle* DrawPrimitiveInstanced(Uint32 vertexCount, Uint32 instanceCount, Uint32 firstVertex, Uint32 firstInstance) = 0;
+		virtual IRHIHandle* DrawIndexPrimitiveInstanced(IBuffer *indexBuffer, Uint32 indexCount, Uint32 instanceCount, Uint32 firstIndex, Int32 vertOffset, Uint32 firstInstance) = 0;
+		// Argument buffers hold DrawIndirectArgs / DrawIndexedIndirectArgs records, stride apart.
+		// drawCount records starting at argumentOffset are drawn
+		virtual IRHIHandle* DrawPrimitiveIndirect(IBuffer* argumentBuffer, Uint32 argumentOffset, Uint32 drawCount, Uint32 stride) = 0;
+		virtual IRHIHandle* DrawIndexPrimitiveIndirect(IBuffer *indexBuffer, IBuffer* argumentBuffer, Uint32 argumentOffset, Uint32 drawCount, Uint32 stride) = 0;
+		// The draw count is read by the GPU from countBuffer at countOffset, clamped to maxDrawCount.
+		// Nothing is drawn unless the drawIndirectCount feature is enabled
+		virtual IRHIHandle* DrawPrimitiveIndirectCount(IBuffer* argumentBuffer, Uint32 argumentOffset, IBuffer* countBuffer, Uint32 countOffset, Uint32 maxDrawCount, Uint32 stride) = 0;
+		virtual IRHIHandle* DrawIndexPrimitiveIndirectCount(IBuffer *indexBuffer, IBuffer* argumentBuffer, Uint32 argumentOffset, IBuffer* countBuffer, Uint32 countOffset, Uint32 maxDrawCount, Uint32 stride) = 0;
 		virtual IRHIHandle* Dispatch(Uint32 threadGroupCountX, Uint32 threadGroupCountY, Uint32 threadGroupCountZ) = 0;
 
+		// Pipeline for DrawItems, built from the current vertex/pixel shader and attachments. Set 0 takes
+		// the layout of layoutGroup (nullptr for none), push constants are DrawItemPushConstantSize bytes
+		virtual IGraphicsPipeline* CreateDrawPipeline(const GfxSetting& gfxSetting, IBindingGroup* layoutGroup) = 0;
+		// Records every item inside the current render pass, after SetViewport/SetScissor.
+		// Pipelines and resources set through Set* have to be set again afterwards
+		virtual IRHIHandle* SubmitDraws(std::span<const DrawItem> drawItems) = 0;
+
+		// Recorded into the current command outside of a render pass, offset and size are multiples of 4
+		virtual IRHIHandle* FillBuffer(IBuffer* buffer, Uint32 offset, Uint32 size, Uint32 value) = 0;
+		// Makes srcAccess writes recorded so far visible to the dstAccess reads that follow, outside of a render pass
+		virtual IRHIHandle* SetBufferBarrier(IBuffer* buffer, BufferAccess srcAccess, BufferAccess dstAccess) = 0;
+
+		// Bindless
+		// ------------------------------------------------------------------------------------------------
+
+		// Stable index of the resource in the global descriptor heap, InvalidBindlessIndex without HandleDesc::bBindless.
+		// Heap layout (set = setId of SetBindlessHeap):
+		//   binding 0: texture2D   textures[]   (index of GetBindlessIndex(ITexture*))
+		//   binding 1: image2D     images[]     (same index, Storage textures only)
+		//   binding 2: sampler     samplers[]   (same index, textures with a sampler)
+		//   binding 3: buffer      buffers[]    (index of GetBindlessIndex(IBuffer*), storage buffers)
+		virtual Uint32 GetBindlessIndex(ITexture* texture) = 0;
+		virtual Uint32 GetBindlessIndex(IBuffer* buffer) = 0;
+		// Following pipelines get the heap as set setId instead of a per-draw set
+		virtual IRHIHandle* SetBindlessHeap(Uint setId) = 0;
+
+		// Set setId of following pipelines is pushed into the command buffer instead of being allocated,
+		// meant for the set whose resources change on every draw. Requires HandleDesc::bPushDescriptor
+		virtual IRHIHandle* SetPushDescriptorSet(Uint setId) = 0;
+
 		virtual IRHIHandle* UpdateBuffer(IBuffer* buffer, void* data, Uint32 dataSize, Uint32 offset) = 0;
 		virtual IRHIHandle* UpdateImageView(IImageView* imageView, void* data, Uint32 dataSize) = 0;
 		virtual IRHIHandle* CopyBuffer(IBuffer* srcBuffer, IBuffer* dstBuffer) = 0;
@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "BaseType.h"
+
+namespace TinyRHI
+{
+	// Unfinished jobs of one batch. Zero it, hand it to Run, then Wait on it
+	struct JobCounter
+	{
+		std::atomic<Uint32> pending = 0;
+	};
+
+	/*
+	* Work stealing scheduler. Each worker owns a deque: it pushes and pops at the back, idle workers
+	* steal from the front of the others. Threads outside the pool submit to a shared queue, and
+	* Wait runs queued jobs on the waiting thread instead of blocking it.
+	* Jobs may Run and Wait on further jobs themselves.
+	*/
+	class JobSystem
+	{
+	public:
+		// 0 workers: one per hardware thread minus the calling thread
+		explicit JobSystem(Uint32 workerCount = 0);
+		~JobSystem();
+
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+
+		void Run(std::function<void()> job, JobCounter* counter = nullptr);
+		// func(begin, end) over [0, count) in batches of batchSize. func is referenced by the jobs, it
+		// has to outlive the Wait on counter
+		void ParallelFor(Uint32 count, Uint32 batchSize, const std::function<void(Uint32, Uint32)>& func, JobCounter& counter);
+		void Wait(JobCounter& counter);
+
+		Uint32 WorkerCount() const
+		{
+			return (Uint32)workers.size();
+		}
+
+	private:
+		struct Job
+		{
+			std::function<void()> func;
+			JobCounter* counter = nullptr;
+		};
+
+		struct JobQueue
+		{
+			std::mutex mutex;
+			std::deque<Job> jobs;
+		};
+
+		void WorkerLoop(Uint32 workerIndex);
+		Bool TryRunOne(Uint32 ownQueue);
+		Bool PopOwn(Uint32 queueIndex, Job& job);
+		Bool Steal(Uint32 thiefQueue, Job& job);
+		void Execute(Job& job);
+		Uint32 CurrentQueue() const;
+
+		// One per worker, the last one is shared by every outside thread
+		std::vector<std::unique_ptr<JobQueue>> queues;
+		std::vector<std::thread> workers;
+
+		std::mutex sleepMutex;
+		std::condition_variable wakeCondition;
+		std::atomic<Uint32> queuedJobs = 0;
+		std::atomic<Bool> bStop = false;
+	};
+}
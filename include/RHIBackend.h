@@ -0,0 +1,75 @@
+#pragma once
+#include "RHIHandleFactory.h"
+#include <type_traits>
+
+// Handle and resource types of the compiled-in backend.
+// With RHI_STATIC_BACKEND (cmake -DSTATIC_BACKEND=ON) they name the concrete Vulkan classes: VkHandle is final
+// and its chained calls return VkHandle*, so calls through RHIHandle are direct and can be inlined, and the
+// backend casts inside VkHandle are static_casts. Otherwise they alias the virtual interfaces, which stay
+// available either way for code that only holds an IRHIHandle*
+#ifdef RHI_STATIC_BACKEND
+
+#ifndef RHI_SUPPORT_VULKAN
+#error "RHI_STATIC_BACKEND is only implemented for the Vulkan backend"
+#endif
+
+#include "Vulkan/HandleVk.h"
+#include "Vulkan/BufferVk.h"
+#include "Vulkan/ImageViewVk.h"
+#include "Vulkan/BindingGroupVk.h"
+
+namespace TinyRHI
+{
+	using RHIHandle = VkHandle;
+	using RHIBuffer = BufferVk;
+	using RHITexture = TextureVk;
+	using RHIImageView = ImageViewVk;
+	using RHIBindingGroup = BindingGroupVk;
+}
+
+#else
+
+namespace TinyRHI
+{
+	using RHIHandle = IRHIHandle;
+	using RHIBuffer = IBuffer;
+	using RHITexture = ITexture;
+	using RHIImageView = IImageView;
+	using RHIBindingGroup = IBindingGroup;
+}
+
+#endif
+
+namespace TinyRHI
+{
+	inline RHIHandle* CreateRHIHandle(GLFWwindow* window, const HandleDesc& handleDesc = HandleDesc())
+	{
+		return static_cast<RHIHandle*>(RHIHandleFactory::getHandle(window, handleDesc));
+	}
+
+	// Interface pointer returned by Create* -> backend type, no RTTI
+	template<typename Interface>
+	inline auto* AsBackend(Interface* object)
+	{
+		if constexpr (std::is_same_v<Interface, IBuffer>)
+		{
+			return static_cast<RHIBuffer*>(object);
+		}
+		else if constexpr (std::is_same_v<Interface, ITexture>)
+		{
+			return static_cast<RHITexture*>(object);
+		}
+		else if constexpr (std::is_same_v<Interface, IImageView>)
+		{
+			return static_cast<RHIImageView*>(object);
+		}
+		else if constexpr (std::is_same_v<Interface, IBindingGroup>)
+		{
+			return static_cast<RHIBindingGroup*>(object);
+		}
+		else
+		{
+			return object;
+		}
+	}
+}
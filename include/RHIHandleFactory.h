@@ -8,7 +8,7 @@ namespace TinyRHI
     class RHIHandleFactory
     {
     public:
-        static IRHIHandle* getHandle(GLFWwindow* window);
+        static IRHIHandle* getHandle(GLFWwindow* window, const HandleDesc& handleDesc = HandleDesc());
     };
     
 } // namespace TinyRHI
@@ -0,0 +1,110 @@
+#pragma once
+#include <cassert>
+#include <coroutine>
+#include <exception>
+#include <span>
+#include "IRHIHandle.h"
+
+namespace TinyRHI
+{
+	// Suspends until the GPU finished the submission. Resumed on the recording thread from
+	// IRHIHandle::BeginFrame / EndFrame, a point that is already complete does not suspend
+	struct GpuSyncAwaiter
+	{
+		GpuSyncPoint syncPoint;
+
+		bool await_ready() const
+		{
+			return syncPoint.value == 0 || syncPoint.handle->IsComplete(syncPoint);
+		}
+
+		void await_suspend(std::coroutine_handle<> waiter) const
+		{
+			syncPoint.handle->WhenComplete(syncPoint, waiter);
+		}
+
+		void await_resume() const
+		{
+		}
+	};
+
+	inline GpuSyncAwaiter operator co_await(GpuSyncPoint syncPoint)
+	{
+		return GpuSyncAwaiter{ syncPoint };
+	}
+
+	// Suspends until a requested readback landed, resumes with its mapped data.
+	// The command that recorded the request must be committed before awaiting
+	struct ReadbackAwaiter
+	{
+		IRHIHandle* handle;
+		ReadbackTicket ticket;
+
+		bool await_ready() const
+		{
+			return !handle->GetReadbackData(ticket).empty();
+		}
+
+		void await_suspend(std::coroutine_handle<> waiter) const
+		{
+			GpuSyncPoint syncPoint = handle->GetReadbackSyncPoint(ticket);
+			assert(syncPoint.value != 0 && "commit before awaiting a readback");
+			handle->WhenComplete(syncPoint, waiter);
+		}
+
+		std::span<const std::byte> await_resume() const
+		{
+			return handle->GetReadbackData(ticket);
+		}
+	};
+
+	inline ReadbackAwaiter Readback(IRHIHandle* handle, ReadbackTicket ticket)
+	{
+		return ReadbackAwaiter{ handle, ticket };
+	}
+
+	/*
+	* Fire and forget coroutine for streaming and readback logic on the recording thread:
+	*   RHITask StreamMesh(IRHIHandle* handle, IBuffer* vertexBuffer, ...)
+	*   {
+	*       co_await handle->Upload(vertexBuffer, data, size, 0);
+	*       // vertexBuffer holds the data here
+	*       ReadbackTicket ticket = handle->RequestReadback(vertexBuffer, 0, size);
+	*       handle->Commit();
+	*       auto data = co_await Readback(handle, ticket);
+	*       // read data, then
+	*       handle->ReleaseReadback(ticket);
+	*   }
+	* It starts running on the call and frees itself when it returns. Everything it references must
+	* outlive it, and the handle must not be destroyed while a task is suspended.
+	*/
+	struct RHITask
+	{
+		struct promise_type
+		{
+			RHITask get_return_object()
+			{
+				return RHITask();
+			}
+
+			std::suspend_never initial_suspend()
+			{
+				return {};
+			}
+
+			std::suspend_never final_suspend() noexcept
+			{
+				return {};
+			}
+
+			void return_void()
+			{
+			}
+
+			void unhandled_exception()
+			{
+				std::terminate();
+			}
+		};
+	};
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "BaseType.h"
+
+namespace TinyRHI
+{
+	#define ResourceHandleIndexBits 20
+	#define ResourceHandleIndexMask ((1u << ResourceHandleIndexBits) - 1)
+	#define ResourceHandleGenerationMask ((1u << (32 - ResourceHandleIndexBits)) - 1)
+
+	// 32 bit generational handle: slot index in the low 20 bits, slot generation in the high 12 bits.
+	// Destroying a resource bumps the generation of its slot, so stale handles resolve to nothing.
+	// Generation 0 is never handed out, a zero handle is always invalid
+	template<typename Tag>
+	struct ResourceHandle
+	{
+		Uint32 value = 0;
+
+		static ResourceHandle Make(Uint32 index, Uint32 generation)
+		{
+			return ResourceHandle{ (generation << ResourceHandleIndexBits) | (index & ResourceHandleIndexMask) };
+		}
+
+		Uint32 Index() const
+		{
+			return value & ResourceHandleIndexMask;
+		}
+
+		Uint32 Generation() const
+		{
+			return value >> ResourceHandleIndexBits;
+		}
+
+		Bool IsValid() const
+		{
+			return value != 0;
+		}
+
+		bool operator==(const ResourceHandle&) const = default;
+	};
+
+	struct BufferHandleTag;
+	struct TextureHandleTag;
+	struct ShaderHandleTag;
+	struct ReadbackHandleTag;
+
+	using BufferId = ResourceHandle<BufferHandleTag>;
+	using TextureId = ResourceHandle<TextureHandleTag>;
+	using ShaderId = ResourceHandle<ShaderHandleTag>;
+	// IRHIHandle::RequestReadback
+	using ReadbackTicket = ResourceHandle<ReadbackHandleTag>;
+}
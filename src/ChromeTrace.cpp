@@ -0,0 +1,68 @@
+#include "ChromeTrace.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace TinyRHI
+{
+    static void WriteJsonString(FILE* file, const char* text)
+    {
+        fputc('"', file);
+        for (const char* c = text ? text : ""; *c; c++)
+        {
+            if (*c == '"' || *c == '\\')
+            {
+                fputc('\\', file);
+                fputc(*c, file);
+            }
+            else if ((unsigned char)*c < 0x20)
+            {
+                fprintf(file, "\\u%04x", (unsigned)(unsigned char)*c);
+            }
+            else
+            {
+                fputc(*c, file);
+            }
+        }
+        fputc('"', file);
+    }
+
+    Bool WriteChromeTrace(const char* filePath, std::span<const TraceEvent> events, std::span<const TraceThread> threads)
+    {
+        FILE* file = fopen(filePath, "wb");
+        if (!file)
+        {
+            return false;
+        }
+
+        Uint64 baseNs = ~0ull;
+        for (const TraceEvent& event : events)
+        {
+            baseNs = (std::min)(baseNs, event.beginNs);
+        }
+
+        fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+        Bool bFirst = true;
+        for (const TraceThread& thread : threads)
+        {
+            fprintf(file, "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":", bFirst ? "" : ",\n", thread.threadId);
+            WriteJsonString(file, thread.name.c_str());
+            fputs("}}", file);
+            bFirst = false;
+        }
+        for (const TraceEvent& event : events)
+        {
+            // Microseconds with nanosecond precision
+            fprintf(file, "%s{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"cat\":", bFirst ? "" : ",\n",
+                event.threadId, (event.beginNs - baseNs) / 1000.0, event.durationNs / 1000.0);
+            WriteJsonString(file, event.category);
+            fputs(",\"name\":", file);
+            WriteJsonString(file, event.name);
+            fputc('}', file);
+            bFirst = false;
+        }
+        fputs("\n]}\n", file);
+
+        return fclose(file) == 0;
+    }
+
+} // namespace TinyRHI
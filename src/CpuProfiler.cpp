@@ -0,0 +1,75 @@
+#include "CpuProfiler.h"
+#include <algorithm>
+
+namespace TinyRHI
+{
+    // Trace rows below are taken by the GPU profiler
+    #define CpuTraceFirstThreadId 16
+
+    thread_local CpuProfiler::ThreadRing* CpuProfiler::threadRing = nullptr;
+
+    CpuProfiler& CpuProfiler::Get()
+    {
+        static CpuProfiler profiler;
+        return profiler;
+    }
+
+    CpuProfiler::ThreadRing& CpuProfiler::GetThreadRing()
+    {
+        if (!threadRing)
+        {
+            auto ring = std::make_shared<ThreadRing>();
+            std::lock_guard<std::mutex> lock(mutex);
+            ring->threadId = CpuTraceFirstThreadId + (Uint32)rings.size();
+            ring->name = "Thread " + std::to_string(rings.size());
+            rings.push_back(ring);
+            threadRing = ring.get();
+        }
+        return *threadRing;
+    }
+
+    void CpuProfiler::Record(const char* name, Uint64 beginNs, Uint64 endNs)
+    {
+        ThreadRing& ring = GetThreadRing();
+        Uint64 writeCount = ring.writeCount.load(std::memory_order_relaxed);
+        ZoneRecord& zone = ring.zones[writeCount % CpuProfileRingSize];
+        zone.name.store(name, std::memory_order_relaxed);
+        zone.beginNs.store(beginNs, std::memory_order_relaxed);
+        zone.endNs.store(endNs, std::memory_order_relaxed);
+        ring.writeCount.store(writeCount + 1, std::memory_order_release);
+    }
+
+    void CpuProfiler::SetThreadName(const char* name)
+    {
+        ThreadRing& ring = GetThreadRing();
+        std::lock_guard<std::mutex> lock(mutex);
+        ring.name = name;
+    }
+
+    void CpuProfiler::AppendTrace(std::vector<TraceEvent>& events, std::vector<TraceThread>& threads)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& ring : rings)
+        {
+            threads.push_back(TraceThread{ ring->threadId, ring->name });
+
+            Uint64 writeCount = ring->writeCount.load(std::memory_order_acquire);
+            Uint64 first = writeCount > CpuProfileRingSize ? writeCount - CpuProfileRingSize : 0;
+            size_t firstEvent = events.size();
+            for (Uint64 i = first; i < writeCount; i++)
+            {
+                const ZoneRecord& zone = ring->zones[i % CpuProfileRingSize];
+                Uint64 beginNs = zone.beginNs.load(std::memory_order_relaxed);
+                Uint64 endNs = zone.endNs.load(std::memory_order_relaxed);
+                events.push_back(TraceEvent{ zone.name.load(std::memory_order_relaxed), "rhi", ring->threadId, beginNs, endNs - beginNs });
+            }
+
+            // The owner kept recording while copying: drop what it may have overwritten meanwhile
+            std::atomic_thread_fence(std::memory_order_acquire);
+            Uint64 overwritten = ring->writeCount.load(std::memory_order_acquire) - writeCount;
+            Uint64 dropCount = (std::min)(overwritten, writeCount - first);
+            events.erase(events.begin() + firstEvent, events.begin() + firstEvent + dropCount);
+        }
+    }
+
+} // namespace TinyRHI
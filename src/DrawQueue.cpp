@@ -0,0 +1,156 @@
+#include "DrawQueue.h"
+#include <cassert>
+#include <cstring>
+
+// Key fields, most significant first, widths add up to 64
+#define SortPassBits 4
+#define SortPipelineBits 14
+#define SortGroupBits 14
+#define SortBufferBits 12
+#define SortDepthBits 20
+
+namespace TinyRHI
+{
+    static Uint64 Field(Uint64 value, Uint32 bits)
+    {
+        return value & ((Uint64(1) << bits) - 1);
+    }
+
+    // Positive floats compare like their bit patterns, the top bits keep the order
+    static Uint32 QuantizeDepth(Float depth, Uint32 bits)
+    {
+        if (!(depth > 0))
+        {
+            return 0;
+        }
+        Uint32 depthBits;
+        memcpy(&depthBits, &depth, sizeof(depthBits));
+        return depthBits >> (32 - bits);
+    }
+
+    Uint32 DrawQueue::CompactId(std::unordered_map<const void*, Uint32>& ids, const void* ptr, Uint32 bits)
+    {
+        auto it = ids.find(ptr);
+        if (it != ids.end())
+        {
+            return it->second;
+        }
+        // Past the field width ids alias, the batch still draws correctly but sorts worse
+        Uint32 id = static_cast<Uint32>(ids.size());
+        assert(id < (1u << bits) && "too many distinct states in one DrawQueue batch");
+        ids.emplace(ptr, id);
+        return id;
+    }
+
+    Uint64 DrawQueue::MakeKey(const DrawItem& item, Uint32 pass, Float depth)
+    {
+        assert(pass < (1u << SortPassBits));
+        Uint64 pipelineId = Field(CompactId(pipelineIds, item.pipeline, SortPipelineBits), SortPipelineBits);
+        Uint64 groupId = Field(CompactId(groupIds, item.bindingGroup, SortGroupBits), SortGroupBits);
+        Uint64 bufferId = Field(CompactId(bufferIds, item.vertexBuffer, SortBufferBits), SortBufferBits);
+        Uint64 depthKey = QuantizeDepth(depth, SortDepthBits);
+
+        Uint64 key = Uint64(pass) << (64 - SortPassBits);
+        switch (policy)
+        {
+        case DrawSortPolicy::Opaque:
+            key |= pipelineId << (SortGroupBits + SortBufferBits + SortDepthBits);
+            key |= groupId << (SortBufferBits + SortDepthBits);
+            key |= bufferId << SortDepthBits;
+            key |= depthKey;
+            break;
+        case DrawSortPolicy::Transparent:
+            // Farthest first, state only breaks ties
+            key |= Field(~depthKey, SortDepthBits) << (SortPipelineBits + SortGroupBits + SortBufferBits);
+            key |= pipelineId << (SortGroupBits + SortBufferBits);
+            key |= groupId << SortBufferBits;
+            key |= bufferId;
+            break;
+        case DrawSortPolicy::None:
+            // The sort is stable, submission order is kept inside a pass
+            break;
+        }
+        return key;
+    }
+
+    void DrawQueue::Add(const DrawItem& item, Uint32 pass, Float depth)
+    {
+        items.push_back(item);
+        keys.push_back(MakeKey(item, pass, depth));
+    }
+
+    void DrawQueue::Sort()
+    {
+        Uint32 count = static_cast<Uint32>(items.size());
+        for (Uint32 i = 0; i < 2; i++)
+        {
+            sortKeys[i].resize(count);
+            sortIndices[i].resize(count);
+        }
+        for (Uint32 i = 0; i < count; i++)
+        {
+            sortKeys[0][i] = keys[i];
+            sortIndices[0][i] = i;
+        }
+
+        // LSD radix sort over 8 bit digits, stable, digits every key shares are skipped
+        Uint32 src = 0;
+        for (Uint32 shift = 0; shift < 64; shift += 8)
+        {
+            Uint32 histogram[256] = {};
+            for (Uint32 i = 0; i < count; i++)
+            {
+                histogram[(sortKeys[src][i] >> shift) & 0xFF]++;
+            }
+            if (count == 0 || histogram[(sortKeys[src][0] >> shift) & 0xFF] == count)
+            {
+                continue;
+            }
+
+            Uint32 offset = 0;
+            for (Uint32 digit = 0; digit < 256; digit++)
+            {
+                Uint32 digitCount = histogram[digit];
+                histogram[digit] = offset;
+                offset += digitCount;
+            }
+
+            Uint32 dst = src ^ 1;
+            for (Uint32 i = 0; i < count; i++)
+            {
+                Uint32 slot = histogram[(sortKeys[src][i] >> shift) & 0xFF]++;
+                sortKeys[dst][slot] = sortKeys[src][i];
+                sortIndices[dst][slot] = sortIndices[src][i];
+            }
+            src = dst;
+        }
+
+        sortedItems.resize(count);
+        for (Uint32 i = 0; i < count; i++)
+        {
+            sortedItems[i] = items[sortIndices[src][i]];
+        }
+    }
+
+    void DrawQueue::Submit(IRHIHandle* handle)
+    {
+        Sort();
+        if (!sortedItems.empty())
+        {
+            handle->SubmitDraws(sortedItems);
+        }
+        Clear();
+    }
+
+    void DrawQueue::Clear()
+    {
+        items.clear();
+        keys.clear();
+        sortedItems.clear();
+        // Keys of the next batch are made from scratch, the maps keep their buckets
+        pipelineIds.clear();
+        groupIds.clear();
+        bufferIds.clear();
+    }
+
+} // namespace TinyRHI
@@ -0,0 +1,135 @@
+#include "GpuCulling.h"
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+
+#define CullingGroupSize 64
+
+namespace TinyRHI
+{
+    static_assert(sizeof(CullingObject) == 32, "CullingObject must match the std430 layout in GpuCulling.comp");
+    static_assert(sizeof(CullingView) == 176, "CullingView must match the std140 layout in GpuCulling.comp");
+
+    GpuCulling::GpuCulling(IRHIHandle* _handle, const GpuCullingDesc& _desc)
+        : handle(_handle), desc(_desc)
+    {
+        assert(handle && desc.frustumShader && desc.maxObjectCount > 0);
+
+        // Written by the CPU while earlier frames may still read them, so one copy per frame in flight
+        BufferDesc viewDesc;
+        viewDesc.bufferType.bUniform = true;
+        viewDesc.elementNum = 1;
+        viewDesc.stride = sizeof(CullingView);
+
+        BufferDesc objectDesc;
+        objectDesc.bufferType.bStorage = true;
+        objectDesc.elementNum = desc.maxObjectCount;
+        objectDesc.stride = sizeof(CullingObject);
+        for (Uint32 i = 0; i < MaxFrameInFlight; i++)
+        {
+            viewBuffers[i] = handle->CreateBuffer(viewDesc);
+            objectBuffers[i] = handle->CreateBuffer(objectDesc);
+        }
+
+        // Only written and read by the GPU
+        BufferDesc drawArgsDesc;
+        drawArgsDesc.bufferType.bStorage = true;
+        drawArgsDesc.bufferType.bIndirect = true;
+        drawArgsDesc.elementNum = desc.maxObjectCount;
+        drawArgsDesc.stride = sizeof(DrawIndexedIndirectArgs);
+        drawArgsDesc.bStaging = true;
+        drawArgsBuffer = handle->CreateBuffer(drawArgsDesc);
+
+        BufferDesc drawCountDesc;
+        drawCountDesc.bufferType.bStorage = true;
+        drawCountDesc.bufferType.bIndirect = true;
+        drawCountDesc.bufferType.bTransfer = true;
+        drawCountDesc.elementNum = 1;
+        drawCountDesc.stride = sizeof(Uint32);
+        drawCountDesc.bStaging = true;
+        drawCountBuffer = handle->CreateBuffer(drawCountDesc);
+    }
+
+    void GpuCulling::UpdateObjects(const CullingObject* _objects, Uint32 objectCount)
+    {
+        assert(objectCount <= desc.maxObjectCount);
+        objectCount = (std::min)(objectCount, desc.maxObjectCount);
+        objects.assign(_objects, _objects + objectCount);
+        objectsVersion++;
+    }
+
+    void GpuCulling::UpdateView(const CullingView& _view)
+    {
+        view = _view;
+    }
+
+    void GpuCulling::ExtractFrustumPlanes(CullingView& view)
+    {
+        // Row r of the column major matrix
+        auto row = [&view](Uint32 r, Uint32 c) { return view.viewProj[c * 4 + r]; };
+        for (Uint32 c = 0; c < 4; c++)
+        {
+            view.frustumPlanes[0][c] = row(3, c) + row(0, c);
+            view.frustumPlanes[1][c] = row(3, c) - row(0, c);
+            view.frustumPlanes[2][c] = row(3, c) + row(1, c);
+            view.frustumPlanes[3][c] = row(3, c) - row(1, c);
+            view.frustumPlanes[4][c] = row(2, c);
+            view.frustumPlanes[5][c] = row(3, c) - row(2, c);
+        }
+        for (auto& plane : view.frustumPlanes)
+        {
+            Float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+            if (length > 0)
+            {
+                for (auto& value : plane)
+                {
+                    value /= length;
+                }
+            }
+        }
+    }
+
+    void GpuCulling::Cull(ITexture* hiZ)
+    {
+        assert(!hiZ || desc.occlusionShader);
+        IShader::Stage stage = IShader::Stage::Compute;
+
+        // This frame's copies were last read MaxFrameInFlight frames ago, BeginFrame waited for that
+        frameSlot = (frameSlot + 1) % MaxFrameInFlight;
+        Uint32 objectCount = (Uint32)objects.size();
+        handle->UpdateBuffer(viewBuffers[frameSlot], &view, sizeof(CullingView), 0);
+        if (slotObjectsVersion[frameSlot] != objectsVersion && objectCount > 0)
+        {
+            handle->UpdateBuffer(objectBuffers[frameSlot], objects.data(), objectCount * sizeof(CullingObject), 0);
+        }
+        slotObjectsVersion[frameSlot] = objectsVersion;
+
+        // Previous draws may still read the arguments
+        handle->SetBufferBarrier(drawCountBuffer, BufferAccess::IndirectArgument, BufferAccess::TransferWrite)->
+            SetBufferBarrier(drawArgsBuffer, BufferAccess::IndirectArgument, BufferAccess::ComputeWrite)->
+            FillBuffer(drawCountBuffer, 0, sizeof(Uint32), 0)->
+            SetBufferBarrier(drawCountBuffer, BufferAccess::TransferWrite, BufferAccess::ComputeWrite);
+
+        handle->SetComputeShader(hiZ ? desc.occlusionShader : desc.frustumShader)->
+            SetUniformBuffer(viewBuffers[frameSlot], stage, 0, 0)->
+            SetStorageBuffer(objectBuffers[frameSlot], stage, 0, 1)->
+            SetStorageBuffer(drawArgsBuffer, stage, 0, 2)->
+            SetStorageBuffer(drawCountBuffer, stage, 0, 3);
+        if (hiZ)
+        {
+            handle->SetSamplerTexture(hiZ, stage, 0, 4);
+        }
+        handle->SetPushConstants(stage, &objectCount, sizeof(Uint32), 0)->
+            SetComputePipeline()->
+            Dispatch((objectCount + CullingGroupSize - 1) / CullingGroupSize, 1, 1)->
+            SetBufferBarrier(drawArgsBuffer, BufferAccess::ComputeWrite, BufferAccess::IndirectArgument)->
+            SetBufferBarrier(drawCountBuffer, BufferAccess::ComputeWrite, BufferAccess::IndirectArgument);
+    }
+
+    void GpuCulling::Draw(IBuffer* indexBuffer)
+    {
+        handle->DrawIndexPrimitiveIndirectCount(indexBuffer, drawArgsBuffer, 0, drawCountBuffer, 0,
+            desc.maxObjectCount, sizeof(DrawIndexedIndirectArgs));
+    }
+
+} // namespace TinyRHI
@@ -0,0 +1,166 @@
+#include "JobSystem.h"
+#include <algorithm>
+#include <cassert>
+
+namespace TinyRHI
+{
+    // Set on worker threads only, outside threads see nullptr
+    static thread_local const JobSystem* tlsJobSystem = nullptr;
+    static thread_local Uint32 tlsQueueIndex = 0;
+
+    JobSystem::JobSystem(Uint32 workerCount)
+    {
+        if (workerCount == 0)
+        {
+            workerCount = (std::max)(std::thread::hardware_concurrency(), 2u) - 1;
+        }
+
+        for (Uint32 i = 0; i <= workerCount; i++)
+        {
+            queues.push_back(std::make_unique<JobQueue>());
+        }
+        for (Uint32 i = 0; i < workerCount; i++)
+        {
+            workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+        }
+    }
+
+    JobSystem::~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            bStop = true;
+        }
+        wakeCondition.notify_all();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    Uint32 JobSystem::CurrentQueue() const
+    {
+        return tlsJobSystem == this ? tlsQueueIndex : (Uint32)workers.size();
+    }
+
+    void JobSystem::Run(std::function<void()> job, JobCounter* counter)
+    {
+        if (counter)
+        {
+            counter->pending.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        JobQueue& queue = *queues[CurrentQueue()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back({ std::move(job), counter });
+        }
+        {
+            // Taken so a worker between its empty check and its sleep cannot miss the notify
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queuedJobs.fetch_add(1, std::memory_order_release);
+        }
+        wakeCondition.notify_one();
+    }
+
+    void JobSystem::ParallelFor(Uint32 count, Uint32 batchSize, const std::function<void(Uint32, Uint32)>& func, JobCounter& counter)
+    {
+        assert(batchSize > 0);
+        for (Uint32 begin = 0; begin < count; begin += batchSize)
+        {
+            Uint32 end = (std::min)(begin + batchSize, count);
+            Run([&func, begin, end]() { func(begin, end); }, &counter);
+        }
+    }
+
+    void JobSystem::Wait(JobCounter& counter)
+    {
+        Uint32 ownQueue = CurrentQueue();
+        while (counter.pending.load(std::memory_order_acquire) != 0)
+        {
+            if (!TryRunOne(ownQueue))
+            {
+                // The remaining jobs run elsewhere
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void JobSystem::WorkerLoop(Uint32 workerIndex)
+    {
+        tlsJobSystem = this;
+        tlsQueueIndex = workerIndex;
+
+        while (true)
+        {
+            if (TryRunOne(workerIndex))
+            {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wakeCondition.wait(lock, [this]() { return bStop || queuedJobs.load(std::memory_order_acquire) > 0; });
+            // Queued jobs still run before the workers exit
+            if (bStop && queuedJobs.load(std::memory_order_acquire) == 0)
+            {
+                return;
+            }
+        }
+    }
+
+    Bool JobSystem::TryRunOne(Uint32 ownQueue)
+    {
+        Job job;
+        if (PopOwn(ownQueue, job) || Steal(ownQueue, job))
+        {
+            queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+            Execute(job);
+            return true;
+        }
+        return false;
+    }
+
+    Bool JobSystem::PopOwn(Uint32 queueIndex, Job& job)
+    {
+        JobQueue& queue = *queues[queueIndex];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty())
+        {
+            return false;
+        }
+        // Newest first, its data is still warm in this core's cache
+        job = std::move(queue.jobs.back());
+        queue.jobs.pop_back();
+        return true;
+    }
+
+    Bool JobSystem::Steal(Uint32 thiefQueue, Job& job)
+    {
+        Uint32 queueCount = (Uint32)queues.size();
+        for (Uint32 i = 1; i < queueCount; i++)
+        {
+            JobQueue& queue = *queues[(thiefQueue + i) % queueCount];
+            // Blocking: locks are held for a single push or pop, while skipping a busy queue could miss
+            // its only job and spin on queuedJobs
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.jobs.empty())
+            {
+                // Oldest first, typically the biggest remaining piece of work
+                job = std::move(queue.jobs.front());
+                queue.jobs.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void JobSystem::Execute(Job& job)
+    {
+        job.func();
+        if (job.counter)
+        {
+            job.counter->pending.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+} // namespace TinyRHI
@@ -37,9 +37,23 @@ namespace TinyRHI
 		virtual ITexture* CreateTextureWithoutSampling(const ImageDesc& imageDesc) = 0;
 		virtual ITexture* CreateTexture(const ImageDesc& imageDesc, const SamplerState& samplerState) = 0;
 		virtual ITexture* CreateTextureWithData(const ImageDesc& imageDesc, const SamplerState& samplerState, void* data, Uint32 dataSize) = 0;
+		virtual IBindingGroup* CreateBindingGroup(const BindingGroupDesc& bindingGroupDesc) = 0;
+
+		virtual BufferId CreateBufferId(const BufferDesc& bufferDesc, void* data, Uint32 dataSize) = 0;
+		virtual TextureId CreateTextureId(const ImageDesc& imageDesc, const SamplerState* samplerState, void* data, Uint32 dataSize) = 0;
+		virtual ShaderId CreateShaderId(IShader::Stage stage, const ShaderDesc& shaderDesc) = 0;
+		virtual IBuffer* GetBuffer(BufferId buffer) = 0;
+		virtual ITexture* GetTexture(TextureId texture) = 0;
+		virtual IShader* GetShader(ShaderId shader) = 0;
+		virtual void DestroyBuffer(BufferId buffer) = 0;
+		virtual void DestroyTexture(TextureId texture) = 0;
+		virtual void DestroyShader(ShaderId shader) = 0;
 
 		virtual Uint32 GetTotalVRAM() const;
 		virtual Uint32 GetUsedVRAM() const;
+
+		virtual RHIStats GetStats() const = 0;
+		virtual JobSystem* GetJobSystem() = 0;
     
         // 
         // ------------------------------------------------------------------------------------------------
@@ -54,6 +68,24 @@ namespace TinyRHI
 		virtual IRHIHandle* EndRenderPass() = 0;
 
 		virtual IRHIHandle* Commit() = 0;
+		virtual GpuSyncPoint LastSubmit() = 0;
+		virtual Bool IsComplete(GpuSyncPoint syncPoint) = 0;
+		virtual void WhenComplete(GpuSyncPoint syncPoint, std::coroutine_handle<> waiter) = 0;
+		virtual GpuSyncPoint Upload(IBuffer* buffer, const void* data, Uint32 dataSize, Uint32 offset) = 0;
+		virtual ReadbackTicket RequestReadback(IBuffer* buffer, Uint32 offset, Uint32 size) = 0;
+		virtual ReadbackTicket RequestReadback(ITexture* texture, const TextureRegion& region) = 0;
+		virtual GpuSyncPoint GetReadbackSyncPoint(ReadbackTicket ticket) = 0;
+		virtual std::span<const std::byte> GetReadbackData(ReadbackTicket ticket) = 0;
+		virtual void ReleaseReadback(ReadbackTicket ticket) = 0;
+		virtual IRHIHandle* BeginGpuScope(const char* name) = 0;
+		virtual IRHIHandle* EndGpuScope() = 0;
+		virtual std::vector<GpuScopeStats> GetGpuScopeStats() = 0;
+		virtual Bool ExportTrace(const char* filePath) = 0;
+		virtual IRHIHandle* BeginQuery(QueryType type, Uint32 index) = 0;
+		virtual IRHIHandle* EndQuery(QueryType type, Uint32 index) = 0;
+		virtual IRHIHandle* ResolveQueries(QueryType type, Uint32 firstIndex, Uint32 count, IBuffer* buffer, Uint32 offset) = 0;
+		virtual IRHIHandle* BeginConditional(IBuffer* buffer, Uint32 offset) = 0;
+		virtual IRHIHandle* EndConditional() = 0;
 
 		virtual IRHIHandle* SetGraphicsPipeline(const GfxSetting& gfxSetting) = 0;
 		virtual IRHIHandle* SetComputePipeline() = 0;
@@ -69,6 +101,9 @@ namespace TinyRHI
 		virtual IRHIHandle* SetComputeShader(IShader* shader) = 0;
 
 		virtual IRHIHandle* SetVertexStream(Uint32 vertId, IBuffer* buffer, Uint32 offset) = 0;
+		virtual IRHIHandle* SetIndexStream(IBuffer* buffer, Uint32 offset, IndexType indexType) = 0;
+		virtual IRHIHandle* SetVertexStream(Uint32 vertId, BufferId buffer, Uint32 offset) = 0;
+		virtual IRHIHandle* SetIndexStream(BufferId buffer, Uint32 offset, IndexType indexType) = 0;
 		virtual IRHIHandle* SetViewport(Extent2D minExt, Extent2D maxExt);
 		virtual IRHIHandle* SetViewport(Extent3D minExt, Extent3D maxExt);
 		virtual IRHIHandle* SetScissor(Extent2D minExt, Extent2D maxExt);
@@ -77,11 +112,32 @@ namespace TinyRHI
 		virtual IRHIHandle* SetStorageTexture(ITexture* texture, IShader::Stage stage, Uint setId, Uint bindingId) = 0;
 		virtual IRHIHandle* SetStorageBuffer(IBuffer* buffer, IShader::Stage stage, Uint setId, Uint bindingId) = 0;
 		virtual IRHIHandle* SetUniformBuffer(IBuffer* Buffer, IShader::Stage stage, Uint setId, Uint bindingId) = 0;
+		virtual IRHIHandle* SetSamplerTexture(TextureId texture, IShader::Stage stage, Uint setId, Uint bindingId) = 0;
+		virtual IRHIHandle* SetStorageBuffer(BufferId buffer, IShader::Stage stage, Uint setId, Uint bindingId) = 0;
+		virtual IRHIHandle* SetUniformBuffer(BufferId buffer, IShader::Stage stage, Uint setId, Uint bindingId) = 0;
+		virtual IRHIHandle* SetStorageBuffer(IBuffer* buffer, IShader::Stage stage, Uint setId, Uint bindingId, Uint32 offset, Uint32 range) = 0;
+		virtual IRHIHandle* SetUniformBuffer(IBuffer* Buffer, IShader::Stage stage, Uint setId, Uint bindingId, Uint32 offset, Uint32 range) = 0;
+		virtual IRHIHandle* SetPushConstants(IShader::Stage stage, const void* data, Uint32 size, Uint32 offset) = 0;
 
 		virtual IRHIHandle* DrawPrimitive(Uint32 vertexCount, Uint32 firstVertex) = 0;
 		virtual IRHIHandle* DrawPrimitiveIndirect(IBuffer* argumentBuffer, Uint32 argumentOffset) = 0;
 		virtual IRHIHandle* DrawIndexPrimitive(IBuffer *indexBuffer, Uint32 indexCount, Uint32 firstIndex, Int32 vertOffset) = 0;
+		virtual IRHIHandle* DrawPrimitiveInstanced(Uint32 vertexCount, Uint32 instanceCount, Uint32 firstVertex, Uint32 firstInstance) = 0;
+		virtual IRHIHandle* DrawIndexPrimitiveInstanced(IBuffer *indexBuffer, Uint32 indexCount, Uint32 instanceCount, Uint32 firstIndex, Int32 vertOffset, Uint32 firstInstance) = 0;
+		virtual IRHIHandle* DrawPrimitiveIndirect(IBuffer* argumentBuffer, Uint32 argumentOffset, Uint32 drawCount, Uint32 stride) = 0;
+		virtual IRHIHandle* DrawIndexPrimitiveIndirect(IBuffer *indexBuffer, IBuffer* argumentBuffer, Uint32 argumentOffset, Uint32 drawCount, Uint32 stride) = 0;
+		virtual IRHIHandle* DrawPrimitiveIndirectCount(IBuffer* argumentBuffer, Uint32 argumentOffset, IBuffer* countBuffer, Uint32 countOffset, Uint32 maxDrawCount, Uint32 stride) = 0;
+		virtual IRHIHandle* DrawIndexPrimitiveIndirectCount(IBuffer *indexBuffer, IBuffer* argumentBuffer, Uint32 argumentOffset, IBuffer* countBuffer, Uint32 countOffset, Uint32 maxDrawCount, Uint32 stride) = 0;
 		virtual IRHIHandle* Dispatch(Uint32 threadGroupCountX, Uint32 threadGroupCountY, Uint32 threadGroupCountZ) = 0;
+		virtual IGraphicsPipeline* CreateDrawPipeline(const GfxSetting& gfxSetting, IBindingGroup* layoutGroup) = 0;
+		virtual IRHIHandle* SubmitDraws(std::span<const DrawItem> drawItems) = 0;
+		virtual IRHIHandle* FillBuffer(IBuffer* buffer, Uint32 offset, Uint32 size, Uint32 value) = 0;
+		virtual IRHIHandle* SetBufferBarrier(IBuffer* buffer, BufferAccess srcAccess, BufferAccess dstAccess) = 0;
+
+		virtual Uint32 GetBindlessIndex(ITexture* texture) = 0;
+		virtual Uint32 GetBindlessIndex(IBuffer* buffer) = 0;
+		virtual IRHIHandle* SetBindlessHeap(Uint setId) = 0;
+		virtual IRHIHandle* SetPushDescriptorSet(Uint setId) = 0;
 
 		virtual IRHIHandle* UpdateBuffer(IBuffer* buffer, void* data, Uint32 dataSize, Uint32 offset) = 0;
 		virtual IRHIHandle* UpdateImageView(IImageView* imageView, void* data, Uint32 dataSize) = 0;
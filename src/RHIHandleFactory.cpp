@@ -12,10 +12,10 @@
 
 namespace TinyRHI
 {
-    IRHIHandle* RHIHandleFactory::getHandle(GLFWwindow *window)
+    IRHIHandle* RHIHandleFactory::getHandle(GLFWwindow *window, const HandleDesc& handleDesc)
     {
         #ifdef RHI_SUPPORT_VULKAN
-        return new VkHandle(window);
+        return new VkHandle(window, handleDesc);
         #elif RHI_SUPPORT_OPENGL
         return new HandleOgl(window);
         #else
@@ -0,0 +1,32 @@
+#ifdef RHI_SUPPORT_VULKAN
+
+#include "BindingGroupVk.h"
+
+using namespace TinyRHI;
+
+BindingGroupVk::BindingGroupVk(
+    const DeviceData& _deviceData,
+    const DescriptorSetWriterVk& writer,
+    DescriptorSetLayoutVk* _dsLayout)
+    : deviceData(_deviceData), dsLayout(_dsLayout)
+{
+    std::vector<vk::DescriptorPoolSize> poolSizes;
+    for (const auto& binding : dsLayout->LayoutBinding())
+    {
+        poolSizes.push_back(vk::DescriptorPoolSize(binding.type, binding.count));
+    }
+    auto descriptorPoolCreateInfo = vk::DescriptorPoolCreateInfo()
+        .setPoolSizes(poolSizes)
+        .setMaxSets(1);
+    descriptorPool = deviceData.logicalDevice.createDescriptorPoolUnique(descriptorPoolCreateInfo);
+
+    auto descriptorSetAllocInfo = vk::DescriptorSetAllocateInfo()
+        .setDescriptorPool(descriptorPool.get())
+        .setDescriptorSetCount(1)
+        .setPSetLayouts(&dsLayout->DSLayoutHandle());
+    descriptorSet = deviceData.logicalDevice.allocateDescriptorSets(descriptorSetAllocInfo).front();
+
+    writer.Update(deviceData.logicalDevice, descriptorSet, dsLayout);
+}
+
+#endif
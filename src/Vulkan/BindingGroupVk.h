@@ -0,0 +1,39 @@
+#pragma once
+#ifdef RHI_SUPPORT_VULKAN
+
+#include "IBindingGroup.h"
+#include "HeaderVk.h"
+#include "DescriptorSetPoolVk.h"
+
+namespace TinyRHI
+{
+	// Long lived set for DrawItem::bindingGroup: it is allocated from its own pool and
+	// written once, so SubmitDraws only has to bind it
+	class BindingGroupVk : public IBindingGroup
+	{
+	public:
+		BindingGroupVk(
+			const DeviceData& _deviceData,
+			const DescriptorSetWriterVk& writer,
+			DescriptorSetLayoutVk* _dsLayout);
+
+		auto& DescriptorSetHandle()
+		{
+			return descriptorSet;
+		}
+
+		DescriptorSetLayoutVk* GetDescriptorSetLayout()
+		{
+			return dsLayout;
+		}
+
+	private:
+		const DeviceData& deviceData;
+		DescriptorSetLayoutVk* dsLayout;
+
+		vk::UniqueDescriptorPool descriptorPool;
+		vk::DescriptorSet descriptorSet;
+	};
+}
+
+#endif
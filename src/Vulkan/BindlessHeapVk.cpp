@@ -0,0 +1,207 @@
+#ifdef RHI_SUPPORT_VULKAN
+
+#include "BindlessHeapVk.h"
+
+using namespace TinyRHI;
+
+BindlessHeapVk::BindlessHeapVk(const DeviceData& _deviceData)
+    : deviceData(_deviceData)
+{
+    // Clamp the arrays to what an update-after-bind set may hold on this device
+    auto propertiesChain = deviceData.physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorIndexingProperties>();
+    const auto& indexingProperties = propertiesChain.get<vk::PhysicalDeviceDescriptorIndexingProperties>();
+
+    textureCapacity = (std::min)({ (Uint32)MaxBindlessTextureCount,
+        indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+        indexingProperties.maxDescriptorSetUpdateAfterBindStorageImages,
+        indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+        indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+        indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageImages,
+        indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers });
+    bufferCapacity = (std::min)({ (Uint32)MaxBindlessBufferCount,
+        indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+        indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers });
+
+    DescriptorSetLayoutBindingDescArray layoutBindings =
+    {
+        { SampledImageBinding, vk::DescriptorType::eSampledImage, vk::ShaderStageFlagBits::eAll, textureCapacity },
+        { StorageImageBinding, vk::DescriptorType::eStorageImage, vk::ShaderStageFlagBits::eAll, textureCapacity },
+        { SamplerBinding, vk::DescriptorType::eSampler, vk::ShaderStageFlagBits::eAll, textureCapacity },
+        { StorageBufferBinding, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eAll, bufferCapacity },
+    };
+    dsLayout = std::make_unique<DescriptorSetLayoutVk>(deviceData, layoutBindings, DescriptorSetLayoutVk::Usage::Bindless);
+
+    std::vector<vk::DescriptorPoolSize> poolSizes =
+    {
+        { vk::DescriptorType::eSampledImage, textureCapacity },
+        { vk::DescriptorType::eStorageImage, textureCapacity },
+        { vk::DescriptorType::eSampler, textureCapacity },
+        { vk::DescriptorType::eStorageBuffer, bufferCapacity },
+    };
+    auto descriptorPoolCreateInfo = vk::DescriptorPoolCreateInfo()
+        .setFlags(vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind)
+        .setPoolSizes(poolSizes)
+        .setMaxSets(1);
+    descriptorPool = deviceData.logicalDevice.createDescriptorPoolUnique(descriptorPoolCreateInfo);
+
+    auto variableCountAllocInfo = vk::DescriptorSetVariableDescriptorCountAllocateInfo()
+        .setDescriptorSetCount(1)
+        .setPDescriptorCounts(&bufferCapacity);
+    auto descriptorSetAllocInfo = vk::DescriptorSetAllocateInfo()
+        .setDescriptorPool(descriptorPool.get())
+        .setDescriptorSetCount(1)
+        .setPSetLayouts(&dsLayout->DSLayoutHandle())
+        .setPNext(&variableCountAllocInfo);
+    descriptorSet = deviceData.logicalDevice.allocateDescriptorSets(descriptorSetAllocInfo).front();
+}
+
+Uint32 BindlessHeapVk::GetIndex(TextureVk* vkTexture)
+{
+    if(vkTexture->BindlessIndex() != InvalidBindlessIndex)
+    {
+        return vkTexture->BindlessIndex();
+    }
+
+    Uint32 index;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!freeTextureIndices.empty())
+        {
+            index = freeTextureIndices.back();
+            freeTextureIndices.pop_back();
+        }
+        else
+        {
+            assert(textureCount < textureCapacity);
+            index = textureCount++;
+        }
+    }
+    vkTexture->BindlessIndex() = index;
+
+    // Slots nobody indexes yet may be written while earlier frames are still executing
+    const ImageUsage& usage = vkTexture->ImageViewPtr()->DescHandle().usage;
+    vk::DescriptorImageInfo sampledInfo(nullptr, vkTexture->ImageViewHandle(), vk::ImageLayout::eShaderReadOnlyOptimal);
+    vk::DescriptorImageInfo storageInfo(nullptr, vkTexture->ImageViewHandle(), vk::ImageLayout::eGeneral);
+    vk::DescriptorImageInfo samplerInfo;
+
+    std::vector<vk::WriteDescriptorSet> writeDescriptorSets;
+    auto addWrite = [&](Binding binding, vk::DescriptorType type, const vk::DescriptorImageInfo* imageInfo)
+    {
+        writeDescriptorSets.push_back(vk::WriteDescriptorSet()
+            .setDstSet(descriptorSet)
+            .setDstBinding(binding)
+            .setDstArrayElement(index)
+            .setDescriptorCount(1)
+            .setDescriptorType(type)
+            .setPImageInfo(imageInfo));
+    };
+
+    if(usage.Sample)
+    {
+        addWrite(SampledImageBinding, vk::DescriptorType::eSampledImage, &sampledInfo);
+    }
+    if(usage.Storage)
+    {
+        addWrite(StorageImageBinding, vk::DescriptorType::eStorageImage, &storageInfo);
+    }
+    if(vkTexture->HasSampler())
+    {
+        samplerInfo.setSampler(vkTexture->SamplerHandle());
+        addWrite(SamplerBinding, vk::DescriptorType::eSampler, &samplerInfo);
+    }
+
+    if(!writeDescriptorSets.empty())
+    {
+        deviceData.logicalDevice.updateDescriptorSets(writeDescriptorSets, {});
+    }
+    return index;
+}
+
+Uint32 BindlessHeapVk::GetIndex(BufferVk* vkBuffer)
+{
+    if(vkBuffer->BindlessIndex() != InvalidBindlessIndex)
+    {
+        return vkBuffer->BindlessIndex();
+    }
+
+    assert(vkBuffer->DescHandle().bufferType.bStorage);
+    Uint32 index;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!freeBufferIndices.empty())
+        {
+            index = freeBufferIndices.back();
+            freeBufferIndices.pop_back();
+        }
+        else
+        {
+            assert(bufferCount < bufferCapacity);
+            index = bufferCount++;
+        }
+    }
+    vkBuffer->BindlessIndex() = index;
+
+    vk::DescriptorBufferInfo bufferInfo(vkBuffer->BufferHandle(), 0, VK_WHOLE_SIZE);
+    auto writeDescriptorSet = vk::WriteDescriptorSet()
+        .setDstSet(descriptorSet)
+        .setDstBinding(StorageBufferBinding)
+        .setDstArrayElement(index)
+        .setDescriptorCount(1)
+        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+        .setPBufferInfo(&bufferInfo);
+    deviceData.logicalDevice.updateDescriptorSets(writeDescriptorSet, {});
+    return index;
+}
+
+void BindlessHeapVk::Release(TextureVk* vkTexture)
+{
+    if(vkTexture->BindlessIndex() != InvalidBindlessIndex)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeTextureIndices.push_back(vkTexture->BindlessIndex());
+        vkTexture->BindlessIndex() = InvalidBindlessIndex;
+    }
+}
+
+void BindlessHeapVk::Release(BufferVk* vkBuffer)
+{
+    if(vkBuffer->BindlessIndex() != InvalidBindlessIndex)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeBufferIndices.push_back(vkBuffer->BindlessIndex());
+        vkBuffer->BindlessIndex() = InvalidBindlessIndex;
+    }
+}
+
+void BindlessHeapVk::Retire(TextureVk* vkTexture)
+{
+    if(vkTexture->BindlessIndex() != InvalidBindlessIndex)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        retiredTextureIndices[currentFrame].push_back(vkTexture->BindlessIndex());
+        vkTexture->BindlessIndex() = InvalidBindlessIndex;
+    }
+}
+
+void BindlessHeapVk::Retire(BufferVk* vkBuffer)
+{
+    if(vkBuffer->BindlessIndex() != InvalidBindlessIndex)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        retiredBufferIndices[currentFrame].push_back(vkBuffer->BindlessIndex());
+        vkBuffer->BindlessIndex() = InvalidBindlessIndex;
+    }
+}
+
+void BindlessHeapVk::BeginFrame(Uint32 frameIndex)
+{
+    assert(frameIndex < MaxFrameInFlight);
+    std::lock_guard<std::mutex> lock(mutex);
+    currentFrame = frameIndex;
+    freeTextureIndices.insert(freeTextureIndices.end(), retiredTextureIndices[frameIndex].begin(), retiredTextureIndices[frameIndex].end());
+    freeBufferIndices.insert(freeBufferIndices.end(), retiredBufferIndices[frameIndex].begin(), retiredBufferIndices[frameIndex].end());
+    retiredTextureIndices[frameIndex].clear();
+    retiredBufferIndices[frameIndex].clear();
+}
+
+#endif
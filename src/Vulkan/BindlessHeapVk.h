@@ -0,0 +1,79 @@
+#pragma once
+#ifdef RHI_SUPPORT_VULKAN
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include "HeaderVk.h"
+#include "DescriptorSetPoolVk.h"
+#include "ImageViewVk.h"
+#include "BufferVk.h"
+
+namespace TinyRHI
+{
+	#define MaxBindlessTextureCount 16384
+	#define MaxBindlessBufferCount 16384
+
+	/*
+	* One update-after-bind descriptor set shared by every pipeline that opts in.
+	* A resource is written once, on its first GetIndex, and keeps that slot until Release, or until it is
+	* deleted: the slot is then retired with the frame recording and handed out again once that frame slot retired.
+	* binding 0/1/2: sampled images, storage images, samplers, indexed by texture slot
+	* binding 3: storage buffers, indexed by buffer slot, variable count
+	*/
+	class BindlessHeapVk
+	{
+	public:
+		enum Binding : Uint32
+		{
+			SampledImageBinding = 0,
+			StorageImageBinding = 1,
+			SamplerBinding = 2,
+			StorageBufferBinding = 3,
+		};
+
+		BindlessHeapVk(const DeviceData& _deviceData);
+
+		Uint32 GetIndex(TextureVk* vkTexture);
+		Uint32 GetIndex(BufferVk* vkBuffer);
+		// Only once the GPU no longer reads the resource, the slot is handed out again
+		void Release(TextureVk* vkTexture);
+		void Release(BufferVk* vkBuffer);
+		// From the destructors, any thread
+		void Retire(TextureVk* vkTexture);
+		void Retire(BufferVk* vkBuffer);
+		// The frame slot has retired on the GPU: the slots retired while it was recorded are free again
+		void BeginFrame(Uint32 frameIndex);
+
+		DescriptorSetLayoutVk* GetDescriptorSetLayout()
+		{
+			return dsLayout.get();
+		}
+
+		vk::DescriptorSet DescriptorSetHandle()
+		{
+			return descriptorSet;
+		}
+
+	private:
+		const DeviceData& deviceData;
+
+		Uint32 textureCapacity;
+		Uint32 bufferCapacity;
+		Uint32 textureCount = 0;
+		Uint32 bufferCount = 0;
+		std::vector<Uint32> freeTextureIndices;
+		std::vector<Uint32> freeBufferIndices;
+
+		std::mutex mutex;
+		Uint32 currentFrame = 0;
+		std::array<std::vector<Uint32>, MaxFrameInFlight> retiredTextureIndices;
+		std::array<std::vector<Uint32>, MaxFrameInFlight> retiredBufferIndices;
+
+		std::unique_ptr<DescriptorSetLayoutVk> dsLayout;
+		vk::UniqueDescriptorPool descriptorPool;
+		vk::DescriptorSet descriptorSet;
+	};
+}
+
+#endif
@@ -1,6 +1,7 @@
 #ifdef RHI_SUPPORT_VULKAN
 
 #include "BufferVk.h"
+#include "BindlessHeapVk.h"
 
 using namespace TinyRHI;
 
@@ -13,6 +14,18 @@ BufferVk::BufferVk(
     this->mappedDataPtr = nullptr;
 
     auto usageFlags = ConvertBufferUsage(bufferDesc.bufferType);
+    // Descriptor buffers reference uniform and storage buffers by device address
+    Bool bDeviceAddress = deviceData.enabledFeatures.descriptorBuffer 
+        && (bufferDesc.bufferType.bUniform || bufferDesc.bufferType.bStorage);
+    if (bDeviceAddress)
+    {
+        usageFlags |= vk::BufferUsageFlagBits::eShaderDeviceAddress;
+    }
+    // Without the extension BeginConditional is a no-op, the buffer is never read as a predicate
+    if (bufferDesc.bufferType.bPredicate && deviceData.enabledFeatures.conditionalRendering)
+    {
+        usageFlags |= vk::BufferUsageFlagBits::eConditionalRenderingEXT;
+    }
     vk::MemoryPropertyFlags memProp;
     if (bufferDesc.bStaging)
     {
@@ -35,12 +48,27 @@ BufferVk::BufferVk(
     auto allocInfo = vk::MemoryAllocateInfo()
         .setAllocationSize(bufferMemRequirements.size)
         .setMemoryTypeIndex(findMemoryType(availableMemProperties, memProp, bufferMemRequirements.memoryTypeBits));
+    auto allocFlagsInfo = vk::MemoryAllocateFlagsInfo()
+        .setFlags(vk::MemoryAllocateFlagBits::eDeviceAddress);
+    if (bDeviceAddress)
+    {
+        allocInfo.setPNext(&allocFlagsInfo);
+    }
 
     bufferMemory = deviceData.logicalDevice.allocateMemoryUnique(allocInfo);
 
     deviceData.logicalDevice.bindBufferMemory(buffer.get(), bufferMemory.get(), 0);
 }
 
+BufferVk::~BufferVk()
+{
+    // Deleted through the pointer API while frames in flight may still index the slot
+    if(deviceData.bindlessHeap)
+    {
+        deviceData.bindlessHeap->Retire(this);
+    }
+}
+
 void BufferVk::SetBufferData(void *data, Uint32 dataSize, Uint32 offset)
 {
     if (!bufferDesc.bStaging)
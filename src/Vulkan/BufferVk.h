@@ -13,6 +13,7 @@ namespace TinyRHI
 		BufferVk(
 			const DeviceData& _deviceData,
 			const BufferDesc& _bufferDesc);
+		~BufferVk();
 
 		void SetBufferData(void* data, Uint32 dataSize, Uint32 offset);
 
@@ -45,6 +46,17 @@ namespace TinyRHI
 			return buffer.get();
 		}
 
+		auto& DescHandle()
+		{
+			return bufferDesc;
+		}
+
+		// Slot in BindlessHeapVk, assigned on first request
+		auto& BindlessIndex()
+		{
+			return bindlessIndex;
+		}
+
 	private:
 		const DeviceData& deviceData;
 		BufferDesc bufferDesc;
@@ -54,6 +66,8 @@ namespace TinyRHI
 
 		vk::DeviceSize size;
 		void* mappedDataPtr;
+
+		Uint32 bindlessIndex = InvalidBindlessIndex;
 	};
 }
 
@@ -3,6 +3,7 @@
 
 #include "HeaderVk.h"
 #include "UniqueHash.h"
+#include "UploadContextVk.h"
 
 namespace TinyRHI
 {
@@ -35,6 +36,18 @@ namespace TinyRHI
         }
 
         void Submit(vk::Queue queue)
+        {
+            MarkSubmitted();
+            QueueSubmit(queue);
+        }
+
+        // Recording thread half of Submit, QueueSubmit may follow later on the submission thread
+        void MarkSubmitted()
+        {
+            submitSerial++;
+        }
+
+        void QueueSubmit(vk::Queue queue)
         {
             vk::SubmitInfo submitInfo = vk::SubmitInfo()
                 .setCommandBufferCount(1)
@@ -50,6 +63,7 @@ namespace TinyRHI
                 submitInfo.setPWaitDstStageMask(waitStages.data());
             }
 
+            auto lock = deviceData.uploadContexts->LockQueues();
             queue.submit(submitInfo, cmdFence.get());
         }
 
@@ -58,8 +72,31 @@ namespace TinyRHI
             return vk::Result::eSuccess == deviceData.logicalDevice.getFenceStatus(cmdFence.get());
         }
 
+        // A cmdBuffer is only recycled after its fence signaled, so a changed serial means complete
+        void WaitComplete(Uint64 serial)
+        {
+            if(serial == submitSerial)
+            {
+                auto result = deviceData.logicalDevice.waitForFences(cmdFence.get(), true, UINT64_MAX);
+                assert(result == vk::Result::eSuccess);
+            }
+        }
+
+        // Non blocking form of WaitComplete
+        Bool IsComplete(Uint64 serial)
+        {
+            return serial <= completedSerial || serial != submitSerial || QueryComplete();
+        }
+
+        Uint64 SubmitSerial() const
+        {
+            return submitSerial;
+        }
+
         void Reset()
         {
+            // Only recycled once the fence signaled
+            completedSerial = submitSerial;
             deviceData.logicalDevice.resetFences(cmdFence.get());
             // todo: pool to manage
             cmdWaitSemaphores.clear();
@@ -96,6 +133,8 @@ namespace TinyRHI
         std::vector<vk::Semaphore> cmdWaitSemaphores;
         std::vector<vk::Semaphore> cmdSignalSemaphores;
         std::vector<vk::PipelineStageFlags> waitStages;
+        Uint64 submitSerial = 0;
+        Uint64 completedSerial = 0;
     };
 
 } // namespace TinyRHI
@@ -3,6 +3,7 @@
 
 #include "HeaderVk.h"
 #include "CommandBufferVk.h"
+#include "SubmitThreadVk.h"
 #include <queue>
 #include <unordered_map>
 
@@ -93,7 +94,34 @@ namespace TinyRHI
             activeCmdBuffersSet.erase(cmdBuffer->Hash());
             submitCmdBuffersSet[cmdBuffer->Hash()] = cmdBuffer;
 
-            cmdBuffer->Submit(queue);
+            if(submitThread)
+            {
+                cmdBuffer->MarkSubmitted();
+                submitThread->Submit(cmdBuffer, queue);
+            }
+            else
+            {
+                cmdBuffer->Submit(queue);
+            }
+            frameSubmits[currentFrame].push_back({ cmdBuffer, cmdBuffer->SubmitSerial() });
+        }
+
+        // Wait until every cmdBuffer submitted the last time this frame slot was used has completed
+        void BeginFrame(Uint32 frameIndex)
+        {
+            assert(frameIndex < MaxFrameInFlight);
+            currentFrame = frameIndex;
+            for(auto& [cmdBuffer, serial] : frameSubmits[currentFrame])
+            {
+                cmdBuffer->WaitComplete(serial);
+            }
+            frameSubmits[currentFrame].clear();
+        }
+
+        // nullptr submits on the calling thread
+        void SetSubmitThread(SubmitThreadVk* _submitThread)
+        {
+            submitThread = _submitThread;
         }
 
         auto& CmdPoolHandle()
@@ -108,6 +136,10 @@ namespace TinyRHI
         std::queue<CommandBufferVk*> idleCmdBuffersQueue;
         std::unordered_map<Uint32, CommandBufferVk*> activeCmdBuffersSet;
         std::unordered_map<Uint32, CommandBufferVk*> submitCmdBuffersSet;
+
+        std::vector<std::pair<CommandBufferVk*, Uint64>> frameSubmits[MaxFrameInFlight];
+        Uint32 currentFrame = 0;
+        SubmitThreadVk* submitThread = nullptr;
     };
 
 } // namespace TinyRHI
@@ -0,0 +1,129 @@
+#ifdef RHI_SUPPORT_VULKAN
+
+#include "DescriptorBufferVk.h"
+
+using namespace TinyRHI;
+
+DescriptorBufferVk::DescriptorBufferVk(const DeviceData& _deviceData)
+    : deviceData(_deviceData)
+{
+    // One buffer holds both resource and sampler descriptors, so it is bound once per command buffer
+    usage = vk::BufferUsageFlagBits::eResourceDescriptorBufferEXT 
+        | vk::BufferUsageFlagBits::eSamplerDescriptorBufferEXT 
+        | vk::BufferUsageFlagBits::eShaderDeviceAddress;
+
+    currentBlock = AcquireBlock();
+    frameBlocks[currentFrame].push_back(currentBlock);
+}
+
+DescriptorBufferVk::~DescriptorBufferVk()
+{
+    for(auto& block : blocks)
+    {
+        deviceData.logicalDevice.unmapMemory(block.memory.get());
+    }
+}
+
+Uint32 DescriptorBufferVk::AcquireBlock()
+{
+    if(!freeBlocks.empty())
+    {
+        Uint32 blockIndex = freeBlocks.back();
+        freeBlocks.pop_back();
+        return blockIndex;
+    }
+
+    Block block;
+    auto bufferInfo = vk::BufferCreateInfo()
+        .setSize(DescriptorBufferBlockSize)
+        .setUsage(usage)
+        .setSharingMode(vk::SharingMode::eExclusive);
+    block.buffer = deviceData.logicalDevice.createBufferUnique(bufferInfo);
+
+    vk::MemoryRequirements bufferMemRequirements = deviceData.logicalDevice.getBufferMemoryRequirements(block.buffer.get());
+    vk::PhysicalDeviceMemoryProperties availableMemProperties = deviceData.physicalDevice.getMemoryProperties();
+    auto allocFlagsInfo = vk::MemoryAllocateFlagsInfo()
+        .setFlags(vk::MemoryAllocateFlagBits::eDeviceAddress);
+    auto allocInfo = vk::MemoryAllocateInfo()
+        .setAllocationSize(bufferMemRequirements.size)
+        .setMemoryTypeIndex(findMemoryType(
+            availableMemProperties,
+            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+            bufferMemRequirements.memoryTypeBits))
+        .setPNext(&allocFlagsInfo);
+    block.memory = deviceData.logicalDevice.allocateMemoryUnique(allocInfo);
+    deviceData.logicalDevice.bindBufferMemory(block.buffer.get(), block.memory.get(), 0);
+
+    block.address = deviceData.logicalDevice.getBufferAddress(vk::BufferDeviceAddressInfo(block.buffer.get()));
+    // Stays mapped, writing a descriptor is a memcpy into this range
+    block.mappedPtr = static_cast<std::byte*>(deviceData.logicalDevice.mapMemory(block.memory.get(), 0, VK_WHOLE_SIZE));
+
+    blocks.push_back(std::move(block));
+    return (Uint32)blocks.size() - 1;
+}
+
+vk::DeviceSize DescriptorBufferVk::GetDescriptorOffset(DescriptorSetLayoutVk* dsLayout, Uint64 contentKey, const DescriptorSetWriterVk& writer, Bool& bAllocated)
+{
+    assert(dsLayout != nullptr);
+    auto cached = offsetCache.find(contentKey);
+    bAllocated = cached == offsetCache.end() || !writer.ContentEquals(cached->second.content, dsLayout);
+    if(!bAllocated)
+    {
+        setCacheHitCount++;
+        return cached->second.offset;
+    }
+
+    vk::DeviceSize alignment = deviceData.descriptorBufferProperties.descriptorBufferOffsetAlignment;
+    vk::DeviceSize size = dsLayout->DescriptorBufferSize();
+    if(size > DescriptorBufferBlockSize)
+    {
+        throw std::runtime_error("descriptor set layout larger than a descriptor buffer block!");
+    }
+    vk::DeviceSize offset = (head + alignment - 1) / alignment * alignment;
+    if(offset + size > DescriptorBufferBlockSize)
+    {
+        // Only one block can be bound, whatever the caller still needs is written again into the new one
+        currentBlock = AcquireBlock();
+        frameBlocks[currentFrame].push_back(currentBlock);
+        offsetCache.clear();
+        offset = 0;
+    }
+    head = offset + size;
+
+    // A colliding hash takes the entry over, the descriptors written before stay in place for the frame
+    auto& cachedOffset = offsetCache[contentKey];
+    cachedOffset.offset = offset;
+    writer.CopyContent(cachedOffset.content, dsLayout);
+    setAllocateCount++;
+    return offset;
+}
+
+void DescriptorBufferVk::Bind(vk::CommandBuffer cmdBuffer)
+{
+    if(boundCmdBuffer == cmdBuffer && boundBlock == currentBlock)
+    {
+        return;
+    }
+    auto bindingInfo = vk::DescriptorBufferBindingInfoEXT()
+        .setAddress(blocks[currentBlock].address)
+        .setUsage(usage);
+    cmdBuffer.bindDescriptorBuffersEXT(bindingInfo, deviceData.dispatcher);
+    boundCmdBuffer = cmdBuffer;
+    boundBlock = currentBlock;
+    bindSerial++;
+}
+
+void DescriptorBufferVk::BeginFrame(Uint32 frameIndex)
+{
+    assert(frameIndex < MaxFrameInFlight);
+    currentFrame = frameIndex;
+    freeBlocks.insert(freeBlocks.end(), frameBlocks[frameIndex].begin(), frameBlocks[frameIndex].end());
+    frameBlocks[frameIndex].clear();
+
+    currentBlock = AcquireBlock();
+    frameBlocks[frameIndex].push_back(currentBlock);
+    head = 0;
+    offsetCache.clear();
+}
+
+#endif
@@ -0,0 +1,105 @@
+#pragma once
+#ifdef RHI_SUPPORT_VULKAN
+
+#include <unordered_map>
+#include <vector>
+#include "HeaderVk.h"
+#include "DescriptorSetPoolVk.h"
+
+namespace TinyRHI
+{
+	// Bytes of one descriptor buffer block, a frame chains further blocks when it writes more
+	#define DescriptorBufferBlockSize (1 << 20)
+
+	/*
+	* Host visible descriptors (VK_EXT_descriptor_buffer), shared by the graphics and compute pending
+	* states since a command binds a single descriptor buffer for both bind points. Like
+	* DescriptorSetPoolVk, a (layout, bound resources) key is written once per frame and later bindings
+	* of the same key reuse its offset. A frame writes into its current block; a full block is replaced by
+	* a free (or new) one, and the frame's blocks are recycled once the frame slot retired.
+	*/
+	class DescriptorBufferVk
+	{
+	public:
+		DescriptorBufferVk(const DeviceData& _deviceData);
+		~DescriptorBufferVk();
+
+		// Offset of the current frame's copy of writer's content (hashed as contentKey) in CurrentBlock(),
+		// bAllocated tells the caller to write it. Moving on to a new block drops every offset handed out before
+		vk::DeviceSize GetDescriptorOffset(DescriptorSetLayoutVk* dsLayout, Uint64 contentKey, const DescriptorSetWriterVk& writer, Bool& bAllocated);
+
+		Uint32 CurrentBlock() const
+		{
+			return currentBlock;
+		}
+
+		std::byte* MappedPtr(vk::DeviceSize offset)
+		{
+			return blocks[currentBlock].mappedPtr + offset;
+		}
+
+		// Binds the current block unless cmdBuffer already holds it
+		void Bind(vk::CommandBuffer cmdBuffer);
+		// The command buffer lost its bindings (begun again, or secondaries executed)
+		void InvalidateBinding()
+		{
+			boundCmdBuffer = nullptr;
+		}
+
+		// Bumped by every recorded bind, set offsets recorded under an older serial are gone
+		Uint64 BindSerial() const
+		{
+			return bindSerial;
+		}
+
+		// The frame slot has retired on the GPU: its blocks are free again
+		void BeginFrame(Uint32 frameIndex);
+
+		Uint64 SetAllocateCount() const
+		{
+			return setAllocateCount;
+		}
+
+		Uint64 SetCacheHitCount() const
+		{
+			return setCacheHitCount;
+		}
+
+	private:
+		struct Block
+		{
+			vk::UniqueBuffer buffer;
+			vk::UniqueDeviceMemory memory;
+			vk::DeviceAddress address;
+			std::byte* mappedPtr;
+		};
+
+		Uint32 AcquireBlock();
+
+		const DeviceData& deviceData;
+		vk::BufferUsageFlags usage;
+
+		std::vector<Block> blocks;
+		std::vector<Uint32> freeBlocks;
+		std::vector<Uint32> frameBlocks[MaxFrameInFlight];
+		Uint32 currentBlock;
+		Uint32 currentFrame = 0;
+
+		vk::DeviceSize head = 0;
+		struct CachedOffsetVk
+		{
+			vk::DeviceSize offset;
+			DescriptorSetContentVk content;
+		};
+		std::unordered_map<Uint64, CachedOffsetVk> offsetCache;
+
+		vk::CommandBuffer boundCmdBuffer;
+		Uint32 boundBlock = 0;
+		Uint64 bindSerial = 0;
+
+		Uint64 setAllocateCount = 0;
+		Uint64 setCacheHitCount = 0;
+	};
+}
+
+#endif
@@ -4,13 +4,108 @@
 
 using namespace TinyRHI;
 
+// Reserved by a pool before any usage has been observed
+static const Uint32 MinPoolSets = 256;
+static const Uint32 MinPoolDescriptors[PoolDescriptorTypeCount] = { 256, 64, 256, 64, 256, 0, 0, 64 };
+
+vk::DescriptorSet DescriptorPoolChainVk::Allocate(DescriptorSetLayoutVk* dsLayout)
+{
+    auto descriptorSetAllocInfo = vk::DescriptorSetAllocateInfo()
+        .setDescriptorSetCount(1)
+        .setPSetLayouts(&dsLayout->DSLayoutHandle());
+
+    vk::DescriptorSet descriptorSet;
+    while(true)
+    {
+        if(activePool == pools.size())
+        {
+            // Large enough for everything this frame allocated so far plus the pending set
+            DescriptorPoolUsage usage = frameUsage;
+            usage.sets += 1;
+            for(Uint32 i = 0; i < PoolDescriptorTypeCount; i++)
+            {
+                usage.descriptors[i] += dsLayout->DescriptorCounts()[i];
+            }
+            AddPool(usage);
+        }
+
+        descriptorSetAllocInfo.setDescriptorPool(pools[activePool].get());
+        vk::Result result = deviceData.logicalDevice.allocateDescriptorSets(&descriptorSetAllocInfo, &descriptorSet);
+        if(result == vk::Result::eSuccess)
+        {
+            break;
+        }
+
+        assert(result == vk::Result::eErrorOutOfPoolMemory || result == vk::Result::eErrorFragmentedPool);
+        activePool++;
+    }
+
+    frameUsage.sets++;
+    for(Uint32 i = 0; i < PoolDescriptorTypeCount; i++)
+    {
+        frameUsage.descriptors[i] += dsLayout->DescriptorCounts()[i];
+    }
+    return descriptorSet;
+}
+
+void DescriptorPoolChainVk::Reset()
+{
+    peakUsage.sets = (std::max)(peakUsage.sets, frameUsage.sets);
+    for(Uint32 i = 0; i < PoolDescriptorTypeCount; i++)
+    {
+        peakUsage.descriptors[i] = (std::max)(peakUsage.descriptors[i], frameUsage.descriptors[i]);
+    }
+
+    if(pools.size() > 1)
+    {
+        // The chain grew last time, replace it with one pool covering the peak and some headroom
+        pools.clear();
+        DescriptorPoolUsage usage = peakUsage;
+        usage.sets += usage.sets / 4;
+        for(Uint32 i = 0; i < PoolDescriptorTypeCount; i++)
+        {
+            usage.descriptors[i] += usage.descriptors[i] / 4;
+        }
+        AddPool(usage);
+    }
+    else if(pools.size() == 1 && frameUsage.sets > 0)
+    {
+        deviceData.logicalDevice.resetDescriptorPool(pools[0].get());
+    }
+
+    activePool = 0;
+    frameUsage = DescriptorPoolUsage();
+}
+
+void DescriptorPoolChainVk::AddPool(const DescriptorPoolUsage& usage)
+{
+    std::vector<vk::DescriptorPoolSize> poolSizes;
+    for(Uint32 i = 0; i < PoolDescriptorTypeCount; i++)
+    {
+        Uint32 descriptorCount = (std::max)(MinPoolDescriptors[i], usage.descriptors[i]);
+        if(descriptorCount > 0)
+        {
+            poolSizes.push_back(vk::DescriptorPoolSize()
+                .setType(PoolDescriptorTypes[i])
+                .setDescriptorCount(descriptorCount));
+        }
+    }
+
+    auto poolCreateInfo = vk::DescriptorPoolCreateInfo()
+        .setMaxSets((std::max)(MinPoolSets, usage.sets))
+        .setPoolSizeCount(poolSizes.size())
+        .setPPoolSizes(poolSizes.data());
+    pools.push_back(deviceData.logicalDevice.createDescriptorPoolUnique(poolCreateInfo));
+    poolCreateCount++;
+}
+
 DescriptorSetPoolVk::DescriptorSetPoolVk(
     const DeviceData& _deviceData)
     : deviceData(_deviceData)
 {
     auto uniformPoolSize = vk::DescriptorPoolSize()
         .setDescriptorCount(1000)
-        .setType(vk::DescriptorType::eUniformBufferDynamic);	// uniform
+        .setType(vk::DescriptorType::eUniformBuffer);	// uniform
     auto imageSamplerPoolSize = vk::DescriptorPoolSize()
         .setDescriptorCount(1000)
         .setType(vk::DescriptorType::eCombinedImageSampler);	// sampler2D��samplerCube
@@ -29,6 +124,41 @@ DescriptorSetPoolVk::DescriptorSetPoolVk(
         .setPPoolSizes(poolSizes.data())
         .setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet | vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind);	// �ͷ�poolʱ�Զ��ͷ���Ӧset
     descriptorPool = deviceData.logicalDevice.createDescriptorPoolUnique(poolCreateInfo);
+
+    for(Uint32 i = 0; i < MaxFrameInFlight; i++)
+    {
+        frameCaches[i].poolChain = std::make_unique<DescriptorPoolChainVk>(deviceData);
+    }
+}
+
+vk::DescriptorSet DescriptorSetPoolVk::GetDescriptorSet(DescriptorSetLayoutVk* dsLayout, Uint64 contentKey, const DescriptorSetWriterVk& writer, Bool& bAllocated)
+{
+    assert(dsLayout != nullptr);
+    auto& frameCache = frameCaches[currentFrame];
+
+    // A colliding hash takes the entry over, the set it held stays valid until the frame retires
+    auto& cachedSet = frameCache.descriptorSetCache[contentKey];
+    bAllocated = !cachedSet.descriptorSet || !writer.ContentEquals(cachedSet.content, dsLayout);
+    if(!bAllocated)
+    {
+        setCacheHitCount++;
+        return cachedSet.descriptorSet;
+    }
+
+    cachedSet.descriptorSet = frameCache.poolChain->Allocate(dsLayout);
+    writer.CopyContent(cachedSet.content, dsLayout);
+    setAllocateCount++;
+    return cachedSet.descriptorSet;
+}
+
+void DescriptorSetPoolVk::BeginFrame(Uint32 frameIndex)
+{
+    assert(frameIndex < MaxFrameInFlight);
+    currentFrame = frameIndex;
+
+    auto& frameCache = frameCaches[currentFrame];
+    frameCache.poolChain->Reset();
+    frameCache.descriptorSetCache.clear();
 }
 
 #endif
@@ -4,7 +4,9 @@
 #include "HeaderVk.h"
 #include "IRHIHandle.h"
 #include <unordered_map>
+#include <cstddef>
 #include <tuple>
+#include <algorithm>
 #include <cassert>
 
 namespace TinyRHI
@@ -14,9 +16,10 @@ namespace TinyRHI
 		Uint32 binding;
 		vk::DescriptorType type;
 		vk::ShaderStageFlags flag;
+		Uint32 count = 1;
 		Bool operator==(const DescriptorSetLayoutBindingDesc& other) const
 		{
-			return std::tie(binding, type, flag) == std::tie(other.binding, other.type, other.flag);
+			return std::tie(binding, type, flag, count) == std::tie(other.binding, other.type, other.flag, other.count);
 		}
 	};
 
@@ -29,48 +32,169 @@ namespace TinyRHI
 		for(const auto& binding : layoutBindings)
 		{
 			hashVal = hashVal * prime + std::hash<Uint32>()(binding.binding) 
-				+ std::hash<Uint32>()((Uint32)binding.flag) + std::hash<Uint32>()((Uint32)binding.flag);
+				+ std::hash<Uint32>()((Uint32)binding.type) * prime + std::hash<Uint32>()((Uint32)binding.flag)
+				+ std::hash<Uint32>()(binding.count) * prime * prime;
 			hashVal ^= (hashVal >> 16);
 		}
 		return hashVal;
 	}
 
+	// Bindings one DescriptorSetWriterVk holds by default
+	#define MaxDescriptorBindingCount 8
+
+	// Descriptor types the pools reserve space for
+	#define PoolDescriptorTypeCount 8
+	inline constexpr vk::DescriptorType PoolDescriptorTypes[PoolDescriptorTypeCount] =
+	{
+		vk::DescriptorType::eUniformBuffer,
+		vk::DescriptorType::eUniformBufferDynamic,
+		vk::DescriptorType::eStorageBuffer,
+		vk::DescriptorType::eStorageBufferDynamic,
+		vk::DescriptorType::eCombinedImageSampler,
+		vk::DescriptorType::eSampledImage,
+		vk::DescriptorType::eSampler,
+		vk::DescriptorType::eStorageImage,
+	};
+
+	inline Uint32 PoolDescriptorTypeIndex(vk::DescriptorType type)
+	{
+		for (Uint32 i = 0; i < PoolDescriptorTypeCount; i++)
+		{
+			if (PoolDescriptorTypes[i] == type)
+			{
+				return i;
+			}
+		}
+		assert(false);
+		return 0;
+	}
+
+	struct DescriptorPoolUsage
+	{
+		Uint32 sets = 0;
+		Uint32 descriptors[PoolDescriptorTypeCount] = {};
+	};
+
+	// Packed payload of one binding, update templates read it in place
+	struct DescriptorInfoVk
+	{
+		vk::DescriptorImageInfo imageInfo;
+		vk::DescriptorBufferInfo bufferInfo;
+		Bool operator==(const DescriptorInfoVk& other) const
+		{
+			return std::tie(imageInfo, bufferInfo) == std::tie(other.imageInfo, other.bufferInfo);
+		}
+	};
+
+	inline Bool IsBufferDescriptor(vk::DescriptorType type)
+	{
+		return type == vk::DescriptorType::eUniformBuffer || type == vk::DescriptorType::eUniformBufferDynamic
+			|| type == vk::DescriptorType::eStorageBuffer || type == vk::DescriptorType::eStorageBufferDynamic;
+	}
+
 	class DescriptorSetLayoutVk
 	{
 	public:
+		enum class Usage
+		{
+			// Allocated from the frame pools, written through an update template
+			Pooled,
+			// Partially bound, update-after-bind arrays, the last binding has a variable count
+			Bindless,
+			// Never allocated, pushed into the command buffer (VK_KHR_push_descriptor)
+			PushDescriptor,
+		};
+
 		DescriptorSetLayoutVk() = delete;
 		DescriptorSetLayoutVk(
 			const DeviceData& deviceData,
-			DescriptorSetLayoutBindingDescArray _layoutBindings)
-			: layoutBindings(_layoutBindings)
+			DescriptorSetLayoutBindingDescArray _layoutBindings,
+			Usage _usage = Usage::Pooled)
+			: layoutBindings(_layoutBindings), usage(_usage)
 		{
 			std::vector<vk::DescriptorSetLayoutBinding> dsLayoutBindings(layoutBindings.size());
-			std::vector<vk::DescriptorBindingFlags> bindingFlags(layoutBindings.size());
+			std::vector<vk::DescriptorBindingFlags> dsBindingFlags(layoutBindings.size());
 			for (Uint32 i = 0; i < layoutBindings.size(); i++)
 			{
 				auto& binding = dsLayoutBindings[i];
 				binding.setBinding(layoutBindings[i].binding)
-					.setDescriptorCount(1)
+					.setDescriptorCount(layoutBindings[i].count)
 					.setDescriptorType(layoutBindings[i].type)
 					.setStageFlags(layoutBindings[i].flag);
 
-				bindingFlags[i] = (vk::DescriptorBindingFlagBits::eUpdateAfterBind);
-			}
+				descriptorCounts[PoolDescriptorTypeIndex(layoutBindings[i].type)] += binding.descriptorCount;
 
-			vk::DescriptorSetLayoutBindingFlagsCreateInfo flag = vk::DescriptorSetLayoutBindingFlagsCreateInfo()
-				.setBindingCount(bindingFlags.size()).setBindingFlags(bindingFlags);
+				dsBindingFlags[i] = vk::DescriptorBindingFlagBits::ePartiallyBound 
+					| vk::DescriptorBindingFlagBits::eUpdateAfterBind 
+					| vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending;
 
+				// Binding i reads the i-th DescriptorInfoVk of DescriptorSetWriterVk's payload
+				Bool bBuffer = IsBufferDescriptor(layoutBindings[i].type);
+				templateEntries.push_back(vk::DescriptorUpdateTemplateEntry()
+					.setDstBinding(layoutBindings[i].binding)
+					.setDstArrayElement(0)
+					.setDescriptorCount(1)
+					.setDescriptorType(layoutBindings[i].type)
+					.setOffset(i * sizeof(DescriptorInfoVk) + (bBuffer ? offsetof(DescriptorInfoVk, bufferInfo) : offsetof(DescriptorInfoVk, imageInfo)))
+					.setStride(sizeof(DescriptorInfoVk)));
+			}
+
+			// Sets are content addressed and never rewritten once bound, no update-after-bind needed
 			auto dsLayoutCreateInfo = vk::DescriptorSetLayoutCreateInfo()
 				.setBindingCount(dsLayoutBindings.size())
-				.setPBindings(dsLayoutBindings.data())
-				.setFlags(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool)
-				.setPNext(&flag);
+				.setPBindings(dsLayoutBindings.data());
+
+			// The bindless set is written while in use, slots nobody indexes may stay empty
+			vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsCreateInfo;
+			if (usage == Usage::Bindless && !dsBindingFlags.empty())
+			{
+				dsBindingFlags.back() |= vk::DescriptorBindingFlagBits::eVariableDescriptorCount;
+				bindingFlagsCreateInfo.setBindingFlags(dsBindingFlags);
+				dsLayoutCreateInfo.setFlags(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool)
+					.setPNext(&bindingFlagsCreateInfo);
+			}
+			else if (usage == Usage::PushDescriptor)
+			{
+				assert(layoutBindings.size() <= deviceData.pushDescriptorProperties.maxPushDescriptors);
+				dsLayoutCreateInfo.setFlags(vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptorKHR);
+			}
+
+			Bool bDescriptorBuffer = deviceData.enabledFeatures.descriptorBuffer && usage == Usage::Pooled;
+			if (bDescriptorBuffer)
+			{
+				dsLayoutCreateInfo.setFlags(vk::DescriptorSetLayoutCreateFlagBits::eDescriptorBufferEXT);
+			}
 			descriptorSetLayout = deviceData.logicalDevice.createDescriptorSetLayoutUnique(dsLayoutCreateInfo);
 
-			hashKey = ComputeHash(layoutBindings);
+			if (bDescriptorBuffer)
+			{
+				descriptorBufferSize = deviceData.logicalDevice.getDescriptorSetLayoutSizeEXT(descriptorSetLayout.get(), deviceData.dispatcher);
+				bindingOffsets.resize(layoutBindings.size());
+				for (Uint32 i = 0; i < layoutBindings.size(); i++)
+				{
+					bindingOffsets[i] = deviceData.logicalDevice.getDescriptorSetLayoutBindingOffsetEXT(
+						descriptorSetLayout.get(), layoutBindings[i].binding, deviceData.dispatcher);
+				}
+			}
+			else if (usage == Usage::Pooled && !layoutBindings.empty())
+			{
+				auto templateCreateInfo = vk::DescriptorUpdateTemplateCreateInfo()
+					.setDescriptorUpdateEntries(templateEntries)
+					.setTemplateType(vk::DescriptorUpdateTemplateType::eDescriptorSet)
+					.setDescriptorSetLayout(descriptorSetLayout.get());
+				updateTemplate = deviceData.logicalDevice.createDescriptorUpdateTemplateUnique(templateCreateInfo);
+			}
+
+			hashKey = LayoutKey(layoutBindings, usage);
+		}
+
+		// Same bindings used as a pooled and as a push set are two different layouts
+		static Uint32 LayoutKey(const DescriptorSetLayoutBindingDescArray& layoutBindings, Usage usage)
+		{
+			return ComputeHash(layoutBindings) * 31 + static_cast<Uint32>(usage);
 		}
 
-		auto& LayoutBinding()
+		const auto& LayoutBinding() const
 		{
 			return layoutBindings;
 		}
@@ -85,57 +209,122 @@ namespace TinyRHI
 			return hashKey;
 		}
 
+		Usage GetUsage() const
+		{
+			return usage;
+		}
+
+		// Descriptors per PoolDescriptorTypes entry needed by one set
+		const Uint32* DescriptorCounts() const
+		{
+			return descriptorCounts;
+		}
+
+		vk::DescriptorUpdateTemplate UpdateTemplate() const
+		{
+			return updateTemplate.get();
+		}
+
+		// Push templates also depend on the pipeline layout, PipelineLayoutVk builds them from these
+		const std::vector<vk::DescriptorUpdateTemplateEntry>& TemplateEntries() const
+		{
+			return templateEntries;
+		}
+
+		// Bytes one set occupies in a descriptor buffer
+		vk::DeviceSize DescriptorBufferSize() const
+		{
+			return descriptorBufferSize;
+		}
+
+		vk::DeviceSize BindingOffset(Uint32 binding) const
+		{
+			for (Uint32 i = 0; i < layoutBindings.size(); i++)
+			{
+				if (layoutBindings[i].binding == binding)
+				{
+					return bindingOffsets[i];
+				}
+			}
+			assert(false);
+			return 0;
+		}
+
 	private:
 		vk::UniqueDescriptorSetLayout descriptorSetLayout;
 		DescriptorSetLayoutBindingDescArray layoutBindings;
+		Usage usage;
 		Uint32 hashKey;
+		Uint32 descriptorCounts[PoolDescriptorTypeCount] = {};
+
+		std::vector<vk::DescriptorUpdateTemplateEntry> templateEntries;
+		vk::UniqueDescriptorUpdateTemplate updateTemplate;
+
+		vk::DeviceSize descriptorBufferSize = 0;
+		std::vector<vk::DeviceSize> bindingOffsets;
 	};
 
-	class DescriptorSetVk
+	/*
+	* Pools of one frame slot, a new pool is chained on VK_ERROR_OUT_OF_POOL_MEMORY and
+	* sized from what the frame has used so far. All pools are reset together.
+	*/
+	class DescriptorPoolChainVk
 	{
 	public:
-		DescriptorSetVk() = delete;
-		DescriptorSetVk(
-			const DeviceData& _deviceData,
-			vk::DescriptorPool _descriptorPool,
-			DescriptorSetLayoutVk* _descriptorSetLayout)
-			: descriptorSetLayout(_descriptorSetLayout)
+		DescriptorPoolChainVk(const DeviceData& _deviceData)
+			: deviceData(_deviceData)
 		{
-			assert(descriptorSetLayout != nullptr);
-			auto descriptorSetAllocInfo = vk::DescriptorSetAllocateInfo()
-				.setDescriptorPool(_descriptorPool)
-				.setDescriptorSetCount(1)
-				.setPSetLayouts(&descriptorSetLayout->DSLayoutHandle());
-			descriptorSet = _deviceData.logicalDevice.allocateDescriptorSets(descriptorSetAllocInfo)[0];
 		}
 
-		auto& DescriptorSetHandle()
-		{
-			return descriptorSet;
-		}
+		vk::DescriptorSet Allocate(DescriptorSetLayoutVk* dsLayout);
 
-		auto& DesriptorSetLayoutHandle()
+		// Frame retired: recycle every pool, collapsing the chain into one pool sized from peak usage
+		void Reset();
+
+		Uint32 PoolCreateCount() const
 		{
-			return descriptorSetLayout->DSLayoutHandle();
+			return poolCreateCount;
 		}
 
 	private:
-		vk::DescriptorSet descriptorSet;
-		DescriptorSetLayoutVk* descriptorSetLayout;
+		void AddPool(const DescriptorPoolUsage& usage);
+
+	private:
+		const DeviceData& deviceData;
+		std::vector<vk::UniqueDescriptorPool> pools;
+		Uint32 activePool = 0;
+
+		DescriptorPoolUsage frameUsage;
+		DescriptorPoolUsage peakUsage;
+		Uint32 poolCreateCount = 0;
 	};
 
+	class DescriptorSetLayoutVk;
+
+	// Everything a content hash stands for. Caches keep it next to their entry and compare it on a hit,
+	// so writers whose hashes collide never share descriptors
+	struct DescriptorSetContentVk
+	{
+		const DescriptorSetLayoutVk* dsLayout = nullptr;
+		DescriptorSetLayoutBindingDescArray layoutBindings;
+		std::vector<DescriptorInfoVk> descriptorInfos;
+	};
+
+	/*
+	* Bindings of one set kept sorted by binding, next to a packed DescriptorInfoVk payload in
+	* the same order. The payload is what DescriptorSetLayoutVk's update template expects.
+	*/
 	class DescriptorSetWriterVk
 	{
 	public:
-		DescriptorSetWriterVk(Uint descriptorSetNum = 8)
+		DescriptorSetWriterVk(Uint descriptorSetNum = MaxDescriptorBindingCount)
 		{
 			assert(descriptorSetNum != 0);
 			maxDS = descriptorSetNum;
-			currentDescriptorSet = nullptr;
 			bDirty = false;
-			writeDescriptorSets.reserve(20);
-			descriptorBufferInfos.reserve(20);
-			descriptorImageInfos.reserve(20);
+			layoutBindings.reserve(maxDS);
+			descriptorInfos.reserve(maxDS);
+			dynamicOffsets.reserve(maxDS);
 		}
 
 		// offset: 0 default
@@ -143,26 +332,23 @@ namespace TinyRHI
 		template <Bool bUniform>
 		Bool WriteBuffer(vk::Buffer buffer, IShader::Stage stage, Uint32 offset, Uint32 range, Uint32 dstBinding)
 		{
-			writeDescriptorSets.emplace_back();
-			descriptorBufferInfos.emplace_back();
-			shaderStages.push_back(ConvertShaderStage(stage));
-			assert(writeDescriptorSets.size() < maxDS);
+			Uint32 index = FindOrAddBinding(dstBinding, stage);
+			layoutBindings[index].type = bUniform ? vk::DescriptorType::eUniformBuffer : vk::DescriptorType::eStorageBuffer;
+			descriptorInfos[index].bufferInfo.setBuffer(buffer).setOffset(offset).setRange(range);
 
-			auto& writeDescriptorSet = writeDescriptorSets.back();
-			auto& bufferInfo = descriptorBufferInfos.back();
+			bDirty = true;
+			return true;
+		}
 
-			bufferInfo.setBuffer(buffer).setOffset(offset).setRange(range);
-			writeDescriptorSet.setDstBinding(dstBinding)
-				.setDescriptorCount(1)
-				.setPBufferInfo(&bufferInfo);
-			if (bUniform)
-			{
-				writeDescriptorSet.setDescriptorType(vk::DescriptorType::eUniformBuffer);
-			}
-			else
-			{
-				writeDescriptorSet.setDescriptorType(vk::DescriptorType::eStorageBuffer);
-			}
+		// Dynamic descriptor: only [offset, offset + range) relative to dynamicOffset is part of the
+		// set, dynamicOffset is passed at bind time and does not change the content hash
+		template <Bool bUniform>
+		Bool WriteDynamicBuffer(vk::Buffer buffer, IShader::Stage stage, Uint32 dynamicOffset, Uint32 offset, Uint32 range, Uint32 dstBinding)
+		{
+			Uint32 index = FindOrAddBinding(dstBinding, stage);
+			layoutBindings[index].type = bUniform ? vk::DescriptorType::eUniformBufferDynamic : vk::DescriptorType::eStorageBufferDynamic;
+			descriptorInfos[index].bufferInfo.setBuffer(buffer).setOffset(offset).setRange(range);
+			dynamicOffsets[index] = dynamicOffset;
 
 			bDirty = true;
 			return true;
@@ -171,68 +357,142 @@ namespace TinyRHI
 		template<Bool bWriteEnable>
 		Bool WriteImage(vk::ImageView imageView, IShader::Stage stage, vk::Sampler sampler, Uint32 dstBinding)
 		{
-			writeDescriptorSets.emplace_back();
-			descriptorImageInfos.emplace_back();
-			shaderStages.push_back(ConvertShaderStage(stage));
-			assert(writeDescriptorSets.size() < maxDS);
-
-			auto& writeDescriptorSet = writeDescriptorSets.back();
-			auto& imageInfo = descriptorImageInfos.back();
+			Uint32 index = FindOrAddBinding(dstBinding, stage);
+			auto& imageInfo = descriptorInfos[index].imageInfo;
 
 			imageInfo.setImageView(imageView).setSampler(sampler);
-			writeDescriptorSet.setDstBinding(dstBinding).setDescriptorCount(1).setPImageInfo(&imageInfo);
 			if (bWriteEnable)
 			{
 				imageInfo.setImageLayout(vk::ImageLayout::eGeneral);
-				writeDescriptorSet.setDescriptorType(vk::DescriptorType::eStorageImage);
+				layoutBindings[index].type = vk::DescriptorType::eStorageImage;
 			}
 			else
 			{
 				imageInfo.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
-				writeDescriptorSet.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+				layoutBindings[index].type = vk::DescriptorType::eCombinedImageSampler;
 			}
 			
 			bDirty = true;
 			return true;
 		}
 
-		void BindDescriptor(vk::DescriptorSet vkDescriptorSet)
+		// Already sorted, the binding signature does not depend on the order of the Set* calls
+		const DescriptorSetLayoutBindingDescArray& GetDSLayoutBindingArray() const
+		{
+			return layoutBindings;
+		}
+
+		void Update(vk::Device logicalDevice, vk::DescriptorSet descriptorSet, const DescriptorSetLayoutVk* dsLayout) const
+		{
+			assert(layoutBindings == dsLayout->LayoutBinding());
+			logicalDevice.updateDescriptorSetWithTemplate(descriptorSet, dsLayout->UpdateTemplate(), descriptorInfos.data());
+		}
+
+		void Push(const DeviceData& deviceData, vk::CommandBuffer cmdBuffer, vk::DescriptorUpdateTemplate pushTemplate, vk::PipelineLayout pipelineLayout, Uint32 set) const
+		{
+			cmdBuffer.pushDescriptorSetWithTemplateKHR(pushTemplate, pipelineLayout, set, descriptorInfos.data(), deviceData.dispatcher);
+		}
+
+		// Descriptor buffer path: encodes every binding straight into dst, laid out as dsLayout
+		void WriteDescriptors(const DeviceData& deviceData, const DescriptorSetLayoutVk* dsLayout, std::byte* dst) const
 		{
-			if(vkDescriptorSet != currentDescriptorSet)
+			const auto& properties = deviceData.descriptorBufferProperties;
+			for (Uint32 i = 0; i < layoutBindings.size(); i++)
 			{
-				currentDescriptorSet = vkDescriptorSet;
-				for (auto& wdSet : writeDescriptorSets)
+				vk::DescriptorType type = layoutBindings[i].type;
+				auto getInfo = vk::DescriptorGetInfoEXT().setType(type);
+				vk::DescriptorAddressInfoEXT addressInfo;
+				size_t descriptorSize = 0;
+
+				switch (type)
+				{
+				case vk::DescriptorType::eUniformBuffer:
+				case vk::DescriptorType::eStorageBuffer:
 				{
-					wdSet.setDstSet(currentDescriptorSet);
+					const auto& bufferInfo = descriptorInfos[i].bufferInfo;
+					vk::DeviceAddress address = deviceData.logicalDevice.getBufferAddress(vk::BufferDeviceAddressInfo(bufferInfo.buffer));
+					addressInfo.setAddress(address + bufferInfo.offset).setRange(bufferInfo.range);
+					if (type == vk::DescriptorType::eUniformBuffer)
+					{
+						getInfo.data.setPUniformBuffer(&addressInfo);
+						descriptorSize = properties.uniformBufferDescriptorSize;
+					}
+					else
+					{
+						getInfo.data.setPStorageBuffer(&addressInfo);
+						descriptorSize = properties.storageBufferDescriptorSize;
+					}
+					break;
+				}
+				case vk::DescriptorType::eCombinedImageSampler:
+					getInfo.data.setPCombinedImageSampler(&descriptorInfos[i].imageInfo);
+					descriptorSize = properties.combinedImageSamplerDescriptorSize;
+					break;
+				case vk::DescriptorType::eStorageImage:
+					getInfo.data.setPStorageImage(&descriptorInfos[i].imageInfo);
+					descriptorSize = properties.storageImageDescriptorSize;
+					break;
+				default:
+					assert(false);
+					continue;
 				}
+
+				deviceData.logicalDevice.getDescriptorEXT(&getInfo, descriptorSize, 
+					dst + dsLayout->BindingOffset(layoutBindings[i].binding), deviceData.dispatcher);
 			}
 		}
 
-		DescriptorSetLayoutBindingDescArray GetDSLayoutBindingArray()
+		// Appends the offsets of dynamic bindings in binding order, as vkCmdBindDescriptorSets expects them
+		Uint32 GetDynamicOffsets(Uint32* dst) const
 		{
-			DescriptorSetLayoutBindingDescArray dsLayoutBindingArray;
-			for(Uint32 i = 0; i < writeDescriptorSets.size(); i++)
+			Uint32 count = 0;
+			for (Uint32 i = 0; i < layoutBindings.size(); i++)
 			{
-				auto& writeDescriptorSet = writeDescriptorSets[i];
-				DescriptorSetLayoutBindingDesc dsLayoutBindingDesc;
-				
-				dsLayoutBindingDesc.binding = writeDescriptorSet.dstBinding;
-				dsLayoutBindingDesc.type = writeDescriptorSet.descriptorType;
-				dsLayoutBindingDesc.flag = shaderStages[i];
-				dsLayoutBindingArray.push_back(dsLayoutBindingDesc);
+				if (layoutBindings[i].type == vk::DescriptorType::eUniformBufferDynamic
+					|| layoutBindings[i].type == vk::DescriptorType::eStorageBufferDynamic)
+				{
+					dst[count++] = dynamicOffsets[i];
+				}
 			}
-			return dsLayoutBindingArray;
+			return count;
 		}
 
-		Bool Update(vk::Device logicalDevice)
+		// Identifies the bound resources, two writers with the same hash produce the same descriptor set
+		Uint64 ContentHash() const
 		{
-			if (bDirty)
+			Uint64 hashVal = 17;
+			for (Uint32 i = 0; i < layoutBindings.size(); i++)
 			{
-				logicalDevice.updateDescriptorSets(writeDescriptorSets, {});
-				bDirty = false;
-				return true;
+				HashCombine(hashVal, layoutBindings[i].binding);
+				HashCombine(hashVal, static_cast<Uint64>(layoutBindings[i].type));
+				if (IsBufferDescriptor(layoutBindings[i].type))
+				{
+					const auto& bufferInfo = descriptorInfos[i].bufferInfo;
+					HashCombine(hashVal, std::hash<vk::Buffer>{}(bufferInfo.buffer));
+					HashCombine(hashVal, bufferInfo.offset);
+					HashCombine(hashVal, bufferInfo.range);
+				}
+				else
+				{
+					const auto& imageInfo = descriptorInfos[i].imageInfo;
+					HashCombine(hashVal, std::hash<vk::ImageView>{}(imageInfo.imageView));
+					HashCombine(hashVal, std::hash<vk::Sampler>{}(imageInfo.sampler));
+					HashCombine(hashVal, static_cast<Uint64>(imageInfo.imageLayout));
+				}
 			}
-			return false;
+			return hashVal;
+		}
+
+		Bool ContentEquals(const DescriptorSetContentVk& content, const DescriptorSetLayoutVk* dsLayout) const
+		{
+			return content.dsLayout == dsLayout && content.layoutBindings == layoutBindings && content.descriptorInfos == descriptorInfos;
+		}
+
+		void CopyContent(DescriptorSetContentVk& content, const DescriptorSetLayoutVk* dsLayout) const
+		{
+			content.dsLayout = dsLayout;
+			content.layoutBindings = layoutBindings;
+			content.descriptorInfos = descriptorInfos;
 		}
 
 		Bool Dirty() const
@@ -240,28 +500,57 @@ namespace TinyRHI
 			return bDirty;
 		}
 
+		void ClearDirty()
+		{
+			bDirty = false;
+		}
+
 		void Reset()
 		{
-			currentDescriptorSet = vk::DescriptorSet();
-			writeDescriptorSets.clear();
-			shaderStages.clear();
-			descriptorBufferInfos.clear();
-			descriptorImageInfos.clear();
+			layoutBindings.clear();
+			descriptorInfos.clear();
+			dynamicOffsets.clear();
 			bDirty = false;
 		}
 
 	private:
-		std::vector<vk::WriteDescriptorSet> writeDescriptorSets;
-		std::vector<vk::ShaderStageFlags> shaderStages;
-		std::vector<vk::DescriptorBufferInfo> descriptorBufferInfos;
-		std::vector<vk::DescriptorImageInfo> descriptorImageInfos;
-		vk::DescriptorSet currentDescriptorSet;
+		// Writing the same binding twice replaces the previous write, so that the
+		// layout signature never contains duplicated bindings
+		Uint32 FindOrAddBinding(Uint32 dstBinding, IShader::Stage stage)
+		{
+			auto it = std::lower_bound(layoutBindings.begin(), layoutBindings.end(), dstBinding,
+				[](const DescriptorSetLayoutBindingDesc& a, Uint32 binding)
+				{
+					return a.binding < binding;
+				});
+			Uint32 index = static_cast<Uint32>(it - layoutBindings.begin());
+			if (it != layoutBindings.end() && it->binding == dstBinding)
+			{
+				it->flag = ConvertShaderStage(stage);
+				return index;
+			}
+
+			assert(layoutBindings.size() < maxDS);
+			DescriptorSetLayoutBindingDesc bindingDesc;
+			bindingDesc.binding = dstBinding;
+			bindingDesc.flag = ConvertShaderStage(stage);
+			layoutBindings.insert(it, bindingDesc);
+			descriptorInfos.insert(descriptorInfos.begin() + index, DescriptorInfoVk());
+			dynamicOffsets.insert(dynamicOffsets.begin() + index, 0);
+			return index;
+		}
+
+	private:
+		DescriptorSetLayoutBindingDescArray layoutBindings;
+		std::vector<DescriptorInfoVk> descriptorInfos;
+		std::vector<Uint32> dynamicOffsets;
 		Bool bDirty;
 		Uint maxDS;
 	};
 
 	/*
-	* layoutBindings <--> descriptorSetLayout <--> descriptorSet
+	* layoutBindings <--> descriptorSetLayout
+	* (descriptorSetLayout, bound resources) <--> descriptorSet, cached per frame
 	*/
 	class DescriptorSetPoolVk
 	{
@@ -270,59 +559,83 @@ namespace TinyRHI
 			const DeviceData& _deviceData);
 		~DescriptorSetPoolVk() {}
 
-		DescriptorSetLayoutVk* GetDescriptorSetLayout(const DescriptorSetLayoutBindingDescArray& layoutBindings)
+		// Keyed by binding signature, a layout is only ever created once
+		DescriptorSetLayoutVk* GetDescriptorSetLayout(
+			const DescriptorSetLayoutBindingDescArray& layoutBindings,
+			DescriptorSetLayoutVk::Usage usage = DescriptorSetLayoutVk::Usage::Pooled)
 		{
-			Uint32 hashId = ComputeHash(layoutBindings);
+			Uint32 hashId = DescriptorSetLayoutVk::LayoutKey(layoutBindings, usage);
 			auto& vkDescriptorSetLayoutVk = descriptorSetLayoutCache[hashId];
 			if(!vkDescriptorSetLayoutVk)
 			{
-				vkDescriptorSetLayoutVk = std::make_unique<DescriptorSetLayoutVk>(deviceData, layoutBindings);
+				vkDescriptorSetLayoutVk = std::make_unique<DescriptorSetLayoutVk>(deviceData, layoutBindings, usage);
+				layoutCreateCount++;
 			}
+			assert(vkDescriptorSetLayoutVk->LayoutBinding() == layoutBindings);
 			return vkDescriptorSetLayoutVk.get();
 		}
 
-		DescriptorSetVk* GetDescriptorSet(const DescriptorSetLayoutBindingDescArray& layoutBindings)
+		// Returns the set of the current frame holding writer's content (hashed as contentKey), bAllocated
+		// tells the caller to write it
+		vk::DescriptorSet GetDescriptorSet(DescriptorSetLayoutVk* dsLayout, Uint64 contentKey, const DescriptorSetWriterVk& writer, Bool& bAllocated);
+
+		// The frame slot has retired on the GPU: its sets are released in bulk
+		void BeginFrame(Uint32 frameIndex);
+
+		vk::DescriptorPool GetPool()
 		{
-			Uint32 hashId = ComputeHash(layoutBindings);
-			auto& vkDescriptorSet = descriptorSetCache[hashId];
-			if(!vkDescriptorSet)
-			{
-				DescriptorSetLayoutVk* vkDescriptorSetLayout = GetDescriptorSetLayout(layoutBindings);
-				vkDescriptorSet = std::make_unique<DescriptorSetVk>(deviceData, descriptorPool.get(), vkDescriptorSetLayout);
-			}
-			return vkDescriptorSet.get();
+			return descriptorPool.get();
 		}
 
-		DescriptorSetVk* GetDescriptorSet(DescriptorSetLayoutVk* dsLayout)
+		Uint32 LayoutCreateCount() const
 		{
-			if(!dsLayout)
-			{
-				return nullptr;
-			}
+			return layoutCreateCount;
+		}
+
+		Uint64 SetAllocateCount() const
+		{
+			return setAllocateCount;
+		}
+
+		Uint64 SetCacheHitCount() const
+		{
+			return setCacheHitCount;
+		}
 
-			Uint32 hashId = dsLayout->Hash();
-			auto& vkDescriptorSet = descriptorSetCache[hashId];
-			if(!vkDescriptorSet)
+		Uint32 PoolCreateCount() const
+		{
+			Uint32 count = 0;
+			for(const auto& frameCache : frameCaches)
 			{
-				if(!descriptorSetLayoutCache[hashId])
-				{
-					descriptorSetLayoutCache[hashId] = std::unique_ptr<DescriptorSetLayoutVk>(dsLayout);
-				}
-				vkDescriptorSet = std::make_unique<DescriptorSetVk>(deviceData, descriptorPool.get(), dsLayout);
+				count += frameCache.poolChain->PoolCreateCount();
 			}
-			return vkDescriptorSet.get();
+			return count;
 		}
 
-		vk::DescriptorPool GetPool()
+	private:
+		struct FrameDescriptorCacheVk
 		{
-			return descriptorPool.get();
-		}
+			std::unique_ptr<DescriptorPoolChainVk> poolChain;
+			struct CachedSetVk
+			{
+				vk::DescriptorSet descriptorSet;
+				DescriptorSetContentVk content;
+			};
+			std::unordered_map<Uint64, CachedSetVk> descriptorSetCache;
+		};
 
 	private:
 		const DeviceData& deviceData;
+		Uint32 layoutCreateCount = 0;
+		Uint64 setAllocateCount = 0;
+		Uint64 setCacheHitCount = 0;
+
+		// Long lived pool handed out through DeviceData
 		vk::UniqueDescriptorPool descriptorPool;
 		std::unordered_map<Uint32, std::unique_ptr<DescriptorSetLayoutVk>> descriptorSetLayoutCache;
-		std::unordered_map<Uint32, std::unique_ptr<DescriptorSetVk>> descriptorSetCache;
+
+		FrameDescriptorCacheVk frameCaches[MaxFrameInFlight];
+		Uint32 currentFrame = 0;
 	};
 
 }
@@ -0,0 +1,283 @@
+#ifdef RHI_SUPPORT_VULKAN
+
+#include "GpuProfilerVk.h"
+#include <algorithm>
+
+namespace TinyRHI
+{
+    #define GpuTraceThreadFrame 0
+    #define GpuTraceThreadRecord 1
+    #define GpuTraceThreadGpu 2
+
+    GpuProfilerVk::GpuProfilerVk(const DeviceData& _deviceData)
+        : deviceData(_deviceData)
+    {
+        std::vector<vk::QueueFamilyProperties> queueFamilies = deviceData.physicalDevice.getQueueFamilyProperties();
+        // Scopes are written on both queues, the narrower counter bounds both
+        Uint32 validBits = (std::min)(queueFamilies[deviceData.queueFamilyIndices.graphicsFamilyIndex].timestampValidBits,
+            queueFamilies[deviceData.queueFamilyIndices.computeFamilyIndex].timestampValidBits);
+        Bool bOrderedReset = deviceData.enabledFeatures.hostQueryReset || deviceData.graphicsQueue == deviceData.computeQueue;
+        bSupported = validBits > 0 && deviceData.properties.limits.timestampPeriod > 0 && bOrderedReset;
+        if (!bSupported)
+        {
+            return;
+        }
+        timestampPeriod = deviceData.properties.limits.timestampPeriod;
+        timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+        auto queryPoolInfo = vk::QueryPoolCreateInfo()
+            .setQueryType(vk::QueryType::eTimestamp)
+            .setQueryCount(GpuProfilerMaxScopes * 2);
+        for (FrameVk& frame : frames)
+        {
+            frame.queryPool = deviceData.logicalDevice.createQueryPoolUnique(queryPoolInfo);
+        }
+
+        // steady_clock is CLOCK_MONOTONIC there, other host domains would need their own conversion
+#ifdef LINUX_MACRO
+        if (deviceData.enabledFeatures.calibratedTimestamps)
+        {
+            std::vector<vk::TimeDomainEXT> timeDomains = deviceData.physicalDevice.getCalibrateableTimeDomainsEXT(deviceData.dispatcher);
+            Bool bDevice = std::find(timeDomains.begin(), timeDomains.end(), vk::TimeDomainEXT::eDevice) != timeDomains.end();
+            if (bDevice && std::find(timeDomains.begin(), timeDomains.end(), vk::TimeDomainEXT::eClockMonotonic) != timeDomains.end())
+            {
+                hostTimeDomain = vk::TimeDomainEXT::eClockMonotonic;
+            }
+        }
+#endif
+        Calibrate();
+
+        if (deviceData.enabledFeatures.hostQueryReset)
+        {
+            for (FrameVk& frame : frames)
+            {
+                deviceData.logicalDevice.resetQueryPool(frame.queryPool.get(), 0, GpuProfilerMaxScopes * 2);
+                frame.bReset = true;
+            }
+        }
+    }
+
+    void GpuProfilerVk::Calibrate()
+    {
+        if (hostTimeDomain != vk::TimeDomainEXT::eDevice)
+        {
+            vk::CalibratedTimestampInfoEXT timestampInfos[2] =
+            {
+                vk::CalibratedTimestampInfoEXT(vk::TimeDomainEXT::eDevice),
+                vk::CalibratedTimestampInfoEXT(hostTimeDomain),
+            };
+            Uint64 timestamps[2];
+            Uint64 maxDeviation;
+            auto result = deviceData.logicalDevice.getCalibratedTimestampsEXT(2, timestampInfos, timestamps, &maxDeviation, deviceData.dispatcher);
+            if (result == vk::Result::eSuccess)
+            {
+                calibrationTicks = timestamps[0] & timestampMask;
+                calibrationNs = timestamps[1];
+                return;
+            }
+        }
+
+        // Fallback: a lone timestamp lands between submit and fence wake up, take the middle. Stalls, so only once
+        if (calibrationNs != 0)
+        {
+            return;
+        }
+        vk::QueryPool queryPool = frames[0].queryPool.get();
+        vk::CommandBuffer cmdBuffer = BeginSingleTimeCommands(deviceData);
+        cmdBuffer.resetQueryPool(queryPool, 0, 1);
+        cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, queryPool, 0);
+        Uint64 submitNs = TraceClockNs();
+        EndSingleTimeCommands(deviceData, cmdBuffer);
+        Uint64 completeNs = TraceClockNs();
+
+        Uint64 ticks = 0;
+        auto result = deviceData.logicalDevice.getQueryPoolResults(queryPool, 0, 1, sizeof(ticks), &ticks, sizeof(ticks),
+            vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+        assert(result == vk::Result::eSuccess);
+        calibrationTicks = ticks & timestampMask;
+        calibrationNs = submitNs + (completeNs - submitNs) / 2;
+    }
+
+    Uint64 GpuProfilerVk::GpuTicksToNs(Uint64 ticks) const
+    {
+        Int64 deltaTicks = (Int64)((ticks & timestampMask) - calibrationTicks);
+        return calibrationNs + (Int64)(deltaTicks * timestampPeriod);
+    }
+
+    void GpuProfilerVk::BeginFrame(Uint64 completedSubmit)
+    {
+        if (!bSupported)
+        {
+            return;
+        }
+        assert(openScopes.empty() && "GPU scope left open across frames");
+        openScopes.clear();
+
+        Uint64 nowNs = TraceClockNs();
+        frames[frameIndex % GpuProfilerFrameLatency].cpuEndNs = nowNs;
+        frameIndex++;
+        if (hostTimeDomain != vk::TimeDomainEXT::eDevice && frameIndex % GpuProfilerCalibrationInterval == 0)
+        {
+            Calibrate();
+        }
+
+        FrameVk& frame = frames[frameIndex % GpuProfilerFrameLatency];
+        Bool bComplete = frame.submitValue <= completedSubmit;
+        if (frame.bReset && frame.cpuBeginNs != 0)
+        {
+            Resolve(frame, frame.submitValue != 0 && bComplete);
+        }
+        frame.scopes.clear();
+        frame.queryCount = 0;
+        frame.cpuBeginNs = nowNs;
+        frame.submitValue = 0;
+        frame.bReset = false;
+        // BeginFrame waited for the submissions of the frame MaxFrameInFlight back, older ones are done
+        assert(bComplete);
+        if (deviceData.enabledFeatures.hostQueryReset && bComplete)
+        {
+            deviceData.logicalDevice.resetQueryPool(frame.queryPool.get(), 0, GpuProfilerMaxScopes * 2);
+            frame.bReset = true;
+        }
+    }
+
+    void GpuProfilerVk::BeginCommand(vk::CommandBuffer cmdBuffer)
+    {
+        FrameVk& frame = frames[frameIndex % GpuProfilerFrameLatency];
+        if (bSupported && !frame.bReset && !deviceData.enabledFeatures.hostQueryReset)
+        {
+            cmdBuffer.resetQueryPool(frame.queryPool.get(), 0, GpuProfilerMaxScopes * 2);
+            frame.bReset = true;
+        }
+    }
+
+    void GpuProfilerVk::BeginScope(vk::CommandBuffer cmdBuffer, const char* name)
+    {
+        if (!bSupported)
+        {
+            return;
+        }
+        FrameVk& frame = frames[frameIndex % GpuProfilerFrameLatency];
+        ScopeVk scope{ name, ~0u, TraceClockNs(), 0 };
+        if (frame.bReset && frame.queryCount + 2 <= GpuProfilerMaxScopes * 2)
+        {
+            scope.beginQuery = frame.queryCount;
+            frame.queryCount += 2;
+            cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, frame.queryPool.get(), scope.beginQuery);
+        }
+        openScopes.push_back((Uint32)frame.scopes.size());
+        frame.scopes.push_back(scope);
+    }
+
+    void GpuProfilerVk::EndScope(vk::CommandBuffer cmdBuffer)
+    {
+        if (!bSupported)
+        {
+            return;
+        }
+        assert(!openScopes.empty() && "EndGpuScope without BeginGpuScope");
+        FrameVk& frame = frames[frameIndex % GpuProfilerFrameLatency];
+        ScopeVk& scope = frame.scopes[openScopes.back()];
+        openScopes.pop_back();
+        scope.cpuEndNs = TraceClockNs();
+        if (scope.beginQuery != ~0u)
+        {
+            cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, frame.queryPool.get(), scope.beginQuery + 1);
+        }
+    }
+
+    void GpuProfilerVk::Submitted(Uint64 submitValue)
+    {
+        frames[frameIndex % GpuProfilerFrameLatency].submitValue = submitValue;
+    }
+
+    void GpuProfilerVk::Resolve(FrameVk& frame, Bool bComplete)
+    {
+        // (value, availability) per query, nothing waits. Until the frame completed its reset may not
+        // have run either, and the pool would still hold the values of its previous use
+        std::vector<Uint64> results(frame.queryCount * 2);
+        if (bComplete && frame.queryCount > 0)
+        {
+            auto result = deviceData.logicalDevice.getQueryPoolResults(frame.queryPool.get(), 0, frame.queryCount,
+                results.size() * sizeof(Uint64), results.data(), 2 * sizeof(Uint64),
+                vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+            assert(result == vk::Result::eSuccess || result == vk::Result::eNotReady);
+        }
+
+        std::vector<TraceEvent> traceEvents;
+        traceEvents.push_back(TraceEvent{ "Frame", "cpu", GpuTraceThreadFrame, frame.cpuBeginNs, frame.cpuEndNs - frame.cpuBeginNs });
+
+        // Scopes of one name are summed per frame, e.g. every Dispatch
+        std::map<std::string, std::pair<Float64, Uint32>> nameTotals;
+        for (const ScopeVk& scope : frame.scopes)
+        {
+            traceEvents.push_back(TraceEvent{ scope.name, "cpu", GpuTraceThreadRecord, scope.cpuBeginNs, scope.cpuEndNs - scope.cpuBeginNs });
+
+            if (scope.beginQuery == ~0u || results[scope.beginQuery * 2 + 1] == 0 || results[scope.beginQuery * 2 + 3] == 0)
+            {
+                continue;
+            }
+            Uint64 beginNs = GpuTicksToNs(results[scope.beginQuery * 2]);
+            Uint64 endNs = (std::max)(GpuTicksToNs(results[scope.beginQuery * 2 + 2]), beginNs);
+            traceEvents.push_back(TraceEvent{ scope.name, "gpu", GpuTraceThreadGpu, beginNs, endNs - beginNs });
+
+            auto& [totalMs, calls] = nameTotals[scope.name];
+            totalMs += (endNs - beginNs) / 1000000.0;
+            calls++;
+        }
+
+        for (auto& [name, total] : nameTotals)
+        {
+            HistoryVk& scopeHistory = history[name];
+            scopeHistory.frameMs[scopeHistory.next] = total.first;
+            scopeHistory.next = (scopeHistory.next + 1) % GpuProfilerHistory;
+            scopeHistory.count = (std::min)(scopeHistory.count + 1, (Uint32)GpuProfilerHistory);
+            scopeHistory.lastCalls = total.second;
+        }
+
+        traceFrames.push_back(std::move(traceEvents));
+        if (traceFrames.size() > GpuProfilerTraceFrames)
+        {
+            traceFrames.pop_front();
+        }
+    }
+
+    std::vector<GpuScopeStats> GpuProfilerVk::GetScopeStats() const
+    {
+        std::vector<GpuScopeStats> scopeStats;
+        for (const auto& [name, scopeHistory] : history)
+        {
+            GpuScopeStats stats;
+            stats.name = name;
+            stats.frameCount = scopeHistory.count;
+            stats.callsPerFrame = scopeHistory.lastCalls;
+            stats.lastMs = scopeHistory.frameMs[(scopeHistory.next + GpuProfilerHistory - 1) % GpuProfilerHistory];
+            stats.minMs = stats.lastMs;
+            stats.maxMs = stats.lastMs;
+            Float64 totalMs = 0;
+            for (Uint32 i = 0; i < scopeHistory.count; i++)
+            {
+                totalMs += scopeHistory.frameMs[i];
+                stats.minMs = (std::min)(stats.minMs, scopeHistory.frameMs[i]);
+                stats.maxMs = (std::max)(stats.maxMs, scopeHistory.frameMs[i]);
+            }
+            stats.averageMs = totalMs / scopeHistory.count;
+            scopeStats.push_back(stats);
+        }
+        return scopeStats;
+    }
+
+    void GpuProfilerVk::AppendTrace(std::vector<TraceEvent>& events, std::vector<TraceThread>& threads) const
+    {
+        threads.push_back(TraceThread{ GpuTraceThreadFrame, "Frames" });
+        threads.push_back(TraceThread{ GpuTraceThreadRecord, "GPU scopes (recorded)" });
+        threads.push_back(TraceThread{ GpuTraceThreadGpu, "GPU scopes (executed)" });
+        for (const auto& traceEvents : traceFrames)
+        {
+            events.insert(events.end(), traceEvents.begin(), traceEvents.end());
+        }
+    }
+
+} // namespace TinyRHI
+
+#endif
@@ -0,0 +1,103 @@
+#pragma once
+#ifdef RHI_SUPPORT_VULKAN
+
+#include <array>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "HeaderVk.h"
+#include "ChromeTrace.h"
+
+namespace TinyRHI
+{
+	// Frames between recording a frame's scopes and reading them back, one query pool each
+	#define GpuProfilerFrameLatency 4
+	#define GpuProfilerMaxScopes 512
+	// Frames in the rolling statistics and in ExportTrace
+	#define GpuProfilerHistory 120
+	#define GpuProfilerTraceFrames 300
+	#define GpuProfilerCalibrationInterval 240
+	static_assert(GpuProfilerFrameLatency > MaxFrameInFlight, "a frame's queries are reused once its submissions completed");
+
+	/*
+	* Timestamp scopes of HandleDesc::bGpuProfiler. Each frame writes into its own query pool; the pool is
+	* read GpuProfilerFrameLatency frames later without waiting, a frame the GPU has not finished by then
+	* is dropped. GPU ticks are mapped to TraceClockNs with VK_EXT_calibrated_timestamps, or once at startup
+	* by timing a single submit when the extension or a matching host clock is missing.
+	* Commands go to the graphics or the compute queue, so pools are reset from the host (hostQueryReset).
+	* Without it the reset is recorded in the frame's first command, which only orders it with writes on
+	* one queue: the profiler is then disabled when the two queues differ. Recording thread only.
+	*/
+	class GpuProfilerVk
+	{
+	public:
+		GpuProfilerVk(const DeviceData& _deviceData);
+
+		// Resolves the oldest frame and reuses its queries. Every submission up to completedSubmit finished
+		void BeginFrame(Uint64 completedSubmit);
+		// Without hostQueryReset, queries are reset in the first command of a frame, outside of any render pass
+		void BeginCommand(vk::CommandBuffer cmdBuffer);
+		// name is kept by pointer, a string literal
+		void BeginScope(vk::CommandBuffer cmdBuffer, const char* name);
+		void EndScope(vk::CommandBuffer cmdBuffer);
+		// The frame's queries are written once this submission completed
+		void Submitted(Uint64 submitValue);
+
+		std::vector<GpuScopeStats> GetScopeStats() const;
+		void AppendTrace(std::vector<TraceEvent>& events, std::vector<TraceThread>& threads) const;
+
+	private:
+		struct ScopeVk
+		{
+			const char* name;
+			// ~0u when the frame ran out of queries
+			Uint32 beginQuery;
+			Uint64 cpuBeginNs;
+			Uint64 cpuEndNs;
+		};
+
+		struct FrameVk
+		{
+			vk::UniqueQueryPool queryPool;
+			std::vector<ScopeVk> scopes;
+			Uint32 queryCount = 0;
+			Uint64 cpuBeginNs = 0;
+			Uint64 cpuEndNs = 0;
+			Uint64 submitValue = 0;
+			// Queries may be written
+			Bool bReset = false;
+		};
+
+		struct HistoryVk
+		{
+			std::array<Float64, GpuProfilerHistory> frameMs;
+			Uint32 count = 0;
+			Uint32 next = 0;
+			Uint32 lastCalls = 0;
+		};
+
+		void Calibrate();
+		void Resolve(FrameVk& frame, Bool bComplete);
+		Uint64 GpuTicksToNs(Uint64 ticks) const;
+
+		const DeviceData& deviceData;
+		Bool bSupported = false;
+		Float64 timestampPeriod = 1.0;
+		Uint64 timestampMask = ~0ull;
+		vk::TimeDomainEXT hostTimeDomain = vk::TimeDomainEXT::eDevice;
+
+		// One GPU tick and TraceClockNs value taken at the same moment
+		Uint64 calibrationTicks = 0;
+		Uint64 calibrationNs = 0;
+
+		std::array<FrameVk, GpuProfilerFrameLatency> frames;
+		Uint64 frameIndex = 0;
+		std::vector<Uint32> openScopes;
+
+		std::map<std::string, HistoryVk> history;
+		std::deque<std::vector<TraceEvent>> traceFrames;
+	};
+}
+
+#endif
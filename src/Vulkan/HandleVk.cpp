@@ -3,6 +3,8 @@
 #include <iostream>
 #include <set>
 #include <cassert>
+#include <cstring>
+#include <algorithm>
 
 #define GLFW_INCLUDE_VULKAN
 #include "GLFW/glfw3.h"
@@ -15,9 +17,13 @@
 
 using namespace TinyRHI;
 
-VkHandle::VkHandle(GLFWwindow *_window)
-	: window(_window)
+VkHandle::VkHandle(GLFWwindow *_window, const HandleDesc& _handleDesc)
+	: window(_window), handleDesc(_handleDesc)
 {
+#ifdef RHI_CPU_PROFILE
+	CpuProfiler::Get().SetThreadName("Recording thread");
+#endif
+	jobSystem = std::make_unique<JobSystem>(handleDesc.workerThreadCount);
 	InitVulkan();
 	InitPendingState();
 }
@@ -27,10 +33,30 @@ void VkHandle::InitVulkan()
 	InitInstanceAndPhysicalDevice();
 	InitSurface();
 	InitDevice();
+	uploadContexts = std::make_unique<UploadContextsVk>(deviceData);
+	deviceData.uploadContexts = uploadContexts.get();
 	InitSwapChain();
+	swapImageIndex = -1;
 	InitSync();
 	cmdPoolManager = std::make_unique<CommandPoolManager>(deviceData);
 	deviceData.commandPool = cmdPoolManager->CmdPoolHandle();
+	readbackRing = std::make_unique<ReadbackRingVk>(deviceData);
+	if(handleDesc.bGpuProfiler)
+	{
+		gpuProfiler = std::make_unique<GpuProfilerVk>(deviceData);
+	}
+	queryPools = std::make_unique<QueryPoolsVk>(deviceData);
+	if(handleDesc.bSubmitThread)
+	{
+		submitThread = std::make_unique<SubmitThreadVk>(deviceData, SwapChainTargetVk
+		{
+			.swapChain = &swapChain,
+			.extent = &swapChainExtent,
+			.recreate = [this]() { return RecreateSwapChain(); },
+		});
+		cmdPoolManager->SetSubmitThread(submitThread.get());
+		InitBackBuffers();
+	}
 }
 
 void VkHandle::InitInstanceAndPhysicalDevice()
@@ -161,16 +187,146 @@ void VkHandle::InitDevice()
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 	};
 
+	std::vector<vk::ExtensionProperties> availableExtensions = deviceData.physicalDevice.enumerateDeviceExtensionProperties();
+	auto isExtensionAvailable = [&](const char* extensionName)
+	{
+		for (const auto& extension : availableExtensions)
+		{
+			if (strcmp(extension.extensionName, extensionName) == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+
 #ifdef DEBUG_VULKAN_MACRO
 	std::vector<const char*> validationLayers;
 	validationLayers.push_back("VK_LAYER_KHRONOS_validation");
 #endif
 
-	vk::PhysicalDeviceDescriptorIndexingFeatures descriptorIndexingFeatures;
-	descriptorIndexingFeatures
+	auto supportedFeatureChain = deviceData.physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+	const auto& supported12Features = supportedFeatureChain.get<vk::PhysicalDeviceVulkan12Features>();
+	const auto& supportedFeatures = supportedFeatureChain.get<vk::PhysicalDeviceFeatures2>().features;
+
+	// Indirect draws: several records per call and a non zero firstInstance in the records
+	deviceData.enabledFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	deviceData.enabledFeatures.drawIndirectCount = supported12Features.drawIndirectCount;
+	deviceFeatures.setMultiDrawIndirect(supportedFeatures.multiDrawIndirect)
+		.setDrawIndirectFirstInstance(supportedFeatures.drawIndirectFirstInstance);
+
+	// Queries, see IRHIHandle::BeginQuery
+	deviceData.enabledFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+	deviceData.enabledFeatures.occlusionQueryPrecise = supportedFeatures.occlusionQueryPrecise;
+	deviceFeatures.setPipelineStatisticsQuery(supportedFeatures.pipelineStatisticsQuery)
+		.setOcclusionQueryPrecise(supportedFeatures.occlusionQueryPrecise);
+
+	// Query pools reset from the host are free of any queue, timestamps are written on both
+	deviceData.enabledFeatures.hostQueryReset = supported12Features.hostQueryReset;
+
+	vk::PhysicalDeviceVulkan12Features vulkan12Features;
+	vulkan12Features
 		.setDescriptorBindingUniformBufferUpdateAfterBind(true)
 		.setDescriptorBindingSampledImageUpdateAfterBind(true)
-		.setDescriptorBindingStorageBufferUpdateAfterBind(true);
+		.setDescriptorBindingStorageBufferUpdateAfterBind(true)
+		.setDrawIndirectCount(supported12Features.drawIndirectCount)
+		.setHostQueryReset(supported12Features.hostQueryReset);
+
+	// Bindless falls back to per-draw sets when the device lacks any piece of descriptor indexing
+	deviceData.enabledFeatures.bindless = handleDesc.bBindless
+		&& supported12Features.runtimeDescriptorArray
+		&& supported12Features.descriptorBindingPartiallyBound
+		&& supported12Features.descriptorBindingVariableDescriptorCount
+		&& supported12Features.descriptorBindingUpdateUnusedWhilePending
+		&& supported12Features.descriptorBindingStorageImageUpdateAfterBind
+		&& supported12Features.shaderSampledImageArrayNonUniformIndexing
+		&& supported12Features.shaderStorageImageArrayNonUniformIndexing
+		&& supported12Features.shaderStorageBufferArrayNonUniformIndexing;
+	if(deviceData.enabledFeatures.bindless)
+	{
+		vulkan12Features
+			.setDescriptorIndexing(supported12Features.descriptorIndexing)
+			.setRuntimeDescriptorArray(true)
+			.setDescriptorBindingPartiallyBound(true)
+			.setDescriptorBindingVariableDescriptorCount(true)
+			.setDescriptorBindingUpdateUnusedWhilePending(true)
+			.setDescriptorBindingStorageImageUpdateAfterBind(true)
+			.setShaderSampledImageArrayNonUniformIndexing(true)
+			.setShaderStorageImageArrayNonUniformIndexing(true)
+			.setShaderStorageBufferArrayNonUniformIndexing(true);
+	}
+
+	// 8-bit indices, chained in front of the rest of the feature structs
+	vk::PhysicalDeviceIndexTypeUint8FeaturesEXT indexTypeUint8Features;
+	if(isExtensionAvailable(VK_EXT_INDEX_TYPE_UINT8_EXTENSION_NAME))
+	{
+		auto supportedUint8Chain = deviceData.physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceIndexTypeUint8FeaturesEXT>();
+		deviceData.enabledFeatures.indexTypeUint8 = supportedUint8Chain.get<vk::PhysicalDeviceIndexTypeUint8FeaturesEXT>().indexTypeUint8;
+	}
+
+	// Descriptor buffers cannot hold update-after-bind layouts, so they are exclusive with bindless
+	vk::PhysicalDeviceDescriptorBufferFeaturesEXT descriptorBufferFeatures;
+	if(handleDesc.bDescriptorBuffer && !deviceData.enabledFeatures.bindless
+		&& isExtensionAvailable(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME))
+	{
+		auto supportedBufferChain = deviceData.physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorBufferFeaturesEXT>();
+		deviceData.enabledFeatures.descriptorBuffer = supportedBufferChain.get<vk::PhysicalDeviceDescriptorBufferFeaturesEXT>().descriptorBuffer
+			&& supported12Features.bufferDeviceAddress;
+	}
+	if(deviceData.enabledFeatures.descriptorBuffer)
+	{
+		deviceExtensions.push_back(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+		descriptorBufferFeatures.setDescriptorBuffer(true);
+		vulkan12Features.setBufferDeviceAddress(true)
+			.setPNext(&descriptorBufferFeatures);
+
+		auto propertiesChain = deviceData.physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorBufferPropertiesEXT>();
+		deviceData.descriptorBufferProperties = propertiesChain.get<vk::PhysicalDeviceDescriptorBufferPropertiesEXT>();
+		deviceData.descriptorBufferProperties.setPNext(nullptr);
+	}
+
+	// Push descriptors of this extension cannot be mixed with descriptor buffers
+	deviceData.enabledFeatures.pushDescriptor = handleDesc.bPushDescriptor && !deviceData.enabledFeatures.descriptorBuffer
+		&& isExtensionAvailable(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+	if(deviceData.enabledFeatures.pushDescriptor)
+	{
+		deviceExtensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+
+		auto propertiesChain = deviceData.physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDevicePushDescriptorPropertiesKHR>();
+		deviceData.pushDescriptorProperties = propertiesChain.get<vk::PhysicalDevicePushDescriptorPropertiesKHR>();
+		deviceData.pushDescriptorProperties.setPNext(nullptr);
+	}
+
+	// Predicated draws and dispatches, chained in front of the rest of the feature structs
+	vk::PhysicalDeviceConditionalRenderingFeaturesEXT conditionalRenderingFeatures;
+	if(isExtensionAvailable(VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME))
+	{
+		auto supportedConditionalChain = deviceData.physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceConditionalRenderingFeaturesEXT>();
+		deviceData.enabledFeatures.conditionalRendering = supportedConditionalChain.get<vk::PhysicalDeviceConditionalRenderingFeaturesEXT>().conditionalRendering;
+	}
+	if(deviceData.enabledFeatures.conditionalRendering)
+	{
+		deviceExtensions.push_back(VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME);
+		conditionalRenderingFeatures.setConditionalRendering(true)
+			.setPNext(vulkan12Features.pNext);
+		vulkan12Features.setPNext(&conditionalRenderingFeatures);
+	}
+
+	// GPU and CPU timestamps taken together, lets the profiler put both on one timeline
+	deviceData.enabledFeatures.calibratedTimestamps = handleDesc.bGpuProfiler
+		&& isExtensionAvailable(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+	if(deviceData.enabledFeatures.calibratedTimestamps)
+	{
+		deviceExtensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+	}
+
+	if(deviceData.enabledFeatures.indexTypeUint8)
+	{
+		deviceExtensions.push_back(VK_EXT_INDEX_TYPE_UINT8_EXTENSION_NAME);
+		indexTypeUint8Features.setIndexTypeUint8(true)
+			.setPNext(vulkan12Features.pNext);
+		vulkan12Features.setPNext(&indexTypeUint8Features);
+	}
 
 	auto deviceCreateInfo = vk::DeviceCreateInfo()
 		.setQueueCreateInfoCount((uint32_t)queueCreateInfos.size())
@@ -184,9 +340,11 @@ void VkHandle::InitDevice()
 #endif
 		.setEnabledExtensionCount(deviceExtensions.size())
 		.setPpEnabledExtensionNames(deviceExtensions.data())
-		.setPNext(&descriptorIndexingFeatures);
+		.setPNext(&vulkan12Features);
 
 	deviceData.logicalDevice = deviceData.physicalDevice.createDevice(deviceCreateInfo);
+	deviceData.properties = deviceData.physicalDevice.getProperties();
+	deviceData.dispatcher = vk::DispatchLoaderDynamic(instance.get(), vkGetInstanceProcAddr, deviceData.logicalDevice);
 	deviceData.graphicsQueue = deviceData.logicalDevice.getQueue(deviceData.queueFamilyIndices.graphicsFamilyIndex, 0);
 	deviceData.presentQueue = deviceData.logicalDevice.getQueue(deviceData.queueFamilyIndices.presentFamilyIndex, 0);
 	deviceData.computeQueue = deviceData.logicalDevice.getQueue(deviceData.queueFamilyIndices.computeFamilyIndex, 0);
@@ -244,6 +402,7 @@ void VkHandle::InitSwapChain()
 		.setImageUsage(vk::ImageUsageFlagBits::eColorAttachment)
 		.setCompositeAlpha(vk::CompositeAlphaFlagBitsKHR::eOpaque)
 		.setClipped(true)
+		.setOldSwapchain(swapChain.get())
 		;
 	
 	uint32_t familyIndices[] = { deviceData.queueFamilyIndices.graphicsFamilyIndex, deviceData.queueFamilyIndices.presentFamilyIndex };
@@ -277,17 +436,60 @@ void VkHandle::InitSwapChain()
 	{
 		swapImageViews.push_back(std::make_unique<ImageViewVk>(deviceData, imageDesc, swapImages[i]));
 	}
-	swapImageIndex = -1;
+}
+
+Bool VkHandle::RecreateSwapChain()
+{
+	// A minimized window has no extent and no swapchain can be created for it
+	auto capabilities = deviceData.physicalDevice.getSurfaceCapabilitiesKHR(surface);
+	if(capabilities.currentExtent.width == 0 || capabilities.currentExtent.height == 0)
+	{
+		return false;
+	}
+	{
+		auto lock = uploadContexts->LockQueues();
+		deviceData.logicalDevice.waitIdle();
+	}
+	InitSwapChain();
+	return true;
+}
+
+void VkHandle::RecreateSwapChainWhenVisible()
+{
+	while(!RecreateSwapChain())
+	{
+		glfwWaitEvents();
+	}
+	bSwapChainOutOfDate = false;
+}
+
+void VkHandle::InitBackBuffers()
+{
+	ImageDesc imageDesc
+	{
+		.size3 = {swapChainExtent.width, swapChainExtent.height, 1},
+		.format = Format::BGRA8_SRGB,
+		// Device local
+		.bStaging = true,
+		.usage
+		{
+			.colorAttach = true,
+		}
+	};
+	for(auto& backBuffer : backBuffers)
+	{
+		backBuffer = std::make_unique<ImageViewVk>(deviceData, imageDesc);
+	}
 }
 
 void VkHandle::InitSync()
 {
 	currentFrame = 0;
-	swapImageAvailableSemaphores.resize(2);
-	renderFinishedSemaphores.resize(2);
-	inFlightFences.resize(2);
+	swapImageAvailableSemaphores.resize(MaxFrameInFlight);
+	renderFinishedSemaphores.resize(MaxFrameInFlight);
+	inFlightFences.resize(MaxFrameInFlight);
 	auto fenceCreateInfo = vk::FenceCreateInfo().setFlags(vk::FenceCreateFlagBits::eSignaled);
-	for(Uint i = 0; i < 2; i++)
+	for(Uint i = 0; i < MaxFrameInFlight; i++)
 	{
 		swapImageAvailableSemaphores[i] = deviceData.logicalDevice.createSemaphoreUnique(vk::SemaphoreCreateInfo());
 		renderFinishedSemaphores[i] = deviceData.logicalDevice.createSemaphoreUnique(vk::SemaphoreCreateInfo());
@@ -356,6 +558,133 @@ ITexture* VkHandle::CreateTextureWithData(const ImageDesc& imageDesc, const Samp
     return pVkTexture;
 }
 
+IBindingGroup* VkHandle::CreateBindingGroup(const BindingGroupDesc& bindingGroupDesc)
+{
+	// A binding group owns a real descriptor set, descriptor buffer layouts cannot back it
+	assert(!deviceData.enabledFeatures.descriptorBuffer);
+	assert(!bindingGroupDesc.entries.empty());
+	if(deviceData.enabledFeatures.descriptorBuffer || bindingGroupDesc.entries.empty())
+	{
+		return nullptr;
+	}
+
+	DescriptorSetWriterVk writer((std::max)((Uint)bindingGroupDesc.entries.size(), (Uint)MaxDescriptorBindingCount));
+	for(const auto& entry : bindingGroupDesc.entries)
+	{
+		if(entry.type == BindingGroupEntry::Type::UniformBuffer || entry.type == BindingGroupEntry::Type::StorageBuffer)
+		{
+			BufferVk* vkBuffer = CastVk<BufferVk>(entry.buffer);
+			assert(vkBuffer && entry.offset + entry.range <= vkBuffer->GetSize());
+			Uint32 range = entry.range > 0 ? entry.range : vkBuffer->GetSize() - entry.offset;
+			if(entry.type == BindingGroupEntry::Type::UniformBuffer)
+			{
+				writer.WriteBuffer<true>(vkBuffer->BufferHandle(), entry.stage, entry.offset, range, entry.bindingId);
+			}
+			else
+			{
+				writer.WriteBuffer<false>(vkBuffer->BufferHandle(), entry.stage, entry.offset, range, entry.bindingId);
+			}
+		}
+		else
+		{
+			TextureVk* vkTexture = CastVk<TextureVk>(entry.texture);
+			assert(vkTexture);
+			if(entry.type == BindingGroupEntry::Type::StorageTexture)
+			{
+				writer.WriteImage<true>(vkTexture->ImageViewHandle(), entry.stage, vk::Sampler(), entry.bindingId);
+			}
+			else
+			{
+				writer.WriteImage<false>(vkTexture->ImageViewHandle(), entry.stage, vkTexture->SamplerHandle(), entry.bindingId);
+			}
+		}
+	}
+
+	DescriptorSetLayoutVk* dsLayout = pGfxPending->GetDescriptorSetLayout(writer.GetDSLayoutBindingArray());
+	return new BindingGroupVk(deviceData, writer, dsLayout);
+}
+
+BufferId VkHandle::CreateBufferId(const BufferDesc& bufferDesc, void* data, Uint32 dataSize)
+{
+	auto vkBuffer = std::make_unique<BufferVk>(deviceData, bufferDesc);
+	if(data)
+	{
+		vkBuffer->SetBufferData(data, dataSize, 0);
+	}
+	BufferSlotVk slot;
+	slot.buffer = vkBuffer->BufferHandle();
+	slot.size = vkBuffer->GetSize();
+	slot.indexType = bufferDesc.indexType;
+	slot.bufferType = bufferDesc.bufferType;
+	return bufferPool.Add(std::move(vkBuffer), slot);
+}
+
+TextureId VkHandle::CreateTextureId(const ImageDesc& imageDesc, const SamplerState* samplerState, void* data, Uint32 dataSize)
+{
+	auto vkTexture = samplerState ? std::make_unique<TextureVk>(deviceData, imageDesc, *samplerState)
+		: std::make_unique<TextureVk>(deviceData, imageDesc);
+	if(data)
+	{
+		vkTexture->SetImageData(data, dataSize);
+	}
+	TextureSlotVk slot;
+	slot.imageView = vkTexture->ImageViewHandle();
+	slot.sampler = vkTexture->HasSampler() ? vkTexture->SamplerHandle() : vk::Sampler();
+	return texturePool.Add(std::move(vkTexture), slot);
+}
+
+ShaderId VkHandle::CreateShaderId(IShader::Stage stage, const ShaderDesc& shaderDesc)
+{
+	std::unique_ptr<IShader> vkShader;
+	switch(stage)
+	{
+	case IShader::Stage::Vertex:
+		vkShader = std::make_unique<ShaderVk<IShader::Stage::Vertex>>(deviceData, shaderDesc);
+		break;
+	case IShader::Stage::Pixel:
+		vkShader = std::make_unique<ShaderVk<IShader::Stage::Pixel>>(deviceData, shaderDesc);
+		break;
+	case IShader::Stage::Compute:
+		vkShader = std::make_unique<ShaderVk<IShader::Stage::Compute>>(deviceData, shaderDesc);
+		break;
+	default:
+		assert(false);
+		return ShaderId();
+	}
+	return shaderPool.Add(std::move(vkShader), ShaderSlotVk{ stage });
+}
+
+IBuffer* VkHandle::GetBuffer(BufferId buffer)
+{
+	return bufferPool.Get(buffer);
+}
+
+ITexture* VkHandle::GetTexture(TextureId texture)
+{
+	return texturePool.Get(texture);
+}
+
+IShader* VkHandle::GetShader(ShaderId shader)
+{
+	return shaderPool.Get(shader);
+}
+
+void VkHandle::DestroyBuffer(BufferId buffer)
+{
+	bufferPool.Remove(buffer, currentFrame);
+}
+
+void VkHandle::DestroyTexture(TextureId texture)
+{
+	texturePool.Remove(texture, currentFrame);
+}
+
+void VkHandle::DestroyShader(ShaderId shader)
+{
+	// Pipelines built from the module keep working, the module is only read at pipeline creation
+	shaderPool.Remove(shader, currentFrame);
+}
+
 Uint32 VkHandle::GetTotalVRAM() const
 {
 	vk::PhysicalDeviceMemoryProperties deviceMemoryProperties = deviceData.physicalDevice.getMemoryProperties();
@@ -375,6 +704,18 @@ Uint32 VkHandle::GetUsedVRAM() const
     return 0;
 }
 
+RHIStats VkHandle::GetStats() const
+{
+	RHIStats stats;
+	pGfxPending->AccumulateStats(stats);
+	pComputePending->AccumulateStats(stats);
+	if(descriptorBuffer)
+	{
+		stats.descriptorSetAllocated += descriptorBuffer->SetAllocateCount();
+		stats.descriptorSetCacheHit += descriptorBuffer->SetCacheHitCount();
+	}
+	return stats;
+}
 
 
 
@@ -382,14 +723,72 @@ Uint32 VkHandle::GetUsedVRAM() const
 
 
 
-IRHIHandle* VkHandle::BeginFrame()
+
+VkHandle* VkHandle::BeginFrame()
 {
+	// The submission thread recreated the swapchain, the back buffers follow its extent. Rare, so draining
+	// the presents and the device here is fine
+	if(submitThread && submitThread->TakeSwapChainOutOfDate())
+	{
+		submitThread->WaitPresents();
+		{
+			auto lock = uploadContexts->LockQueues();
+			deviceData.logicalDevice.waitIdle();
+		}
+		InitBackBuffers();
+	}
+
+	// Once this frame slot has retired on the GPU its descriptor sets are recycled in bulk
+	cmdPoolManager->BeginFrame(currentFrame);
+	pGfxPending->BeginFrame(currentFrame);
+	pComputePending->BeginFrame(currentFrame);
+	if(descriptorBuffer)
+	{
+		descriptorBuffer->BeginFrame(currentFrame);
+	}
+
+	// Resources destroyed while this frame slot was last recorded are no longer in use
+	if(bindlessHeap)
+	{
+		bindlessHeap->BeginFrame(currentFrame);
+	}
+	bufferPool.BeginFrame(currentFrame, [this](BufferVk* vkBuffer)
+	{
+		if(bindlessHeap)
+		{
+			bindlessHeap->Release(vkBuffer);
+		}
+	});
+	texturePool.BeginFrame(currentFrame, [this](TextureVk* vkTexture)
+	{
+		if(bindlessHeap)
+		{
+			bindlessHeap->Release(vkTexture);
+		}
+	});
+	shaderPool.BeginFrame(currentFrame, [](IShader*) {});
+
+	PollSubmits();
+	// Submissions retire in order, everything before the oldest unfinished one is complete
+	Uint64 completedSubmit = submitRecords.empty() ? lastSubmitValue : submitRecords.front().value - 1;
+	if(gpuProfiler)
+	{
+		gpuProfiler->BeginFrame(completedSubmit);
+	}
+	queryPools->BeginFrame(completedSubmit);
 	return this;
 }
 
-IRHIHandle* VkHandle::EndFrame()
+VkHandle* VkHandle::EndFrame()
 {
-	if (swapImageIndex != -1)
+	if (bBackBufferRendered)
+	{
+		ImageViewVk* backBuffer = backBuffers[currentFrame].get();
+		vk::Extent2D backBufferExtent(backBuffer->DescHandle().size3[0], backBuffer->DescHandle().size3[1]);
+		submitThread->Present(backBuffer->ImageHandle(), backBufferExtent, currentFrame, renderFinishedSemaphores[currentFrame].get());
+		bBackBufferRendered = false;
+	}
+	else if (swapImageIndex != -1)
 	{
 		vk::PresentInfoKHR presentInfo = vk::PresentInfoKHR()
 			.setSwapchainCount(1)
@@ -398,212 +797,742 @@ IRHIHandle* VkHandle::EndFrame()
 			.setWaitSemaphoreCount(1)
 			.setPWaitSemaphores(&renderFinishedSemaphores[currentFrame].get())
 			;
-		auto result = deviceData.presentQueue.presentKHR(presentInfo);
-		assert(result == vk::Result::eSuccess);
+		auto lock = uploadContexts->LockQueues();
+		try
+		{
+			auto result = deviceData.presentQueue.presentKHR(presentInfo);
+			bSwapChainOutOfDate |= result == vk::Result::eSuboptimalKHR;
+		}
+		catch(const vk::OutOfDateKHRError&)
+		{
+			bSwapChainOutOfDate = true;
+		}
 
 		swapImageIndex = -1;
 	}
 
-	currentFrame = (currentFrame + 1) % 2;
+	currentFrame = (currentFrame + 1) % MaxFrameInFlight;
+	PollSubmits();
 	return this;
 }
 
-IRHIHandle* VkHandle::BeginCommand()
+VkHandle* VkHandle::BeginCommand()
 {
 	currentVkCmd = cmdPoolManager->GetCmdBuffer();
 	currentVkCmd->BeginCommand();
+	pGfxPending->SetCmdBuffer(currentVkCmd->Get());
+	pComputePending->SetCmdBuffer(currentVkCmd->Get());
+	if(gpuProfiler)
+	{
+		gpuProfiler->BeginCommand(currentVkCmd->Get());
+	}
+	queryPools->BeginCommand(currentVkCmd->Get());
 
 	renderResManager->ClearAttachments();
+	bInRenderPass = false;
+	bConditional = false;
 	return this;
 }
 
-IRHIHandle* VkHandle::EndCommand()
+VkHandle* VkHandle::EndCommand()
 {
+	// A conditional block cannot span command buffers, one still open is closed here
+	EndConditional();
 	currentVkCmd->EndCommand();
 	return this;
 }
 
-IRHIHandle* VkHandle::Commit()
+VkHandle* VkHandle::Commit()
 {
+	RHI_PROFILE_ZONE("Commit");
 	if(bCurrentGfx)
 	{
 		cmdPoolManager->SubmitCmdBuffer(currentVkCmd, deviceData.graphicsQueue);
-		pGfxPending->Reset();
 	}
 	else
 	{
 		cmdPoolManager->SubmitCmdBuffer(currentVkCmd, deviceData.computeQueue);
-		pComputePending->Reset();
 	}
+	GpuSyncPoint syncPoint = RecordSubmit(currentVkCmd);
+	for(Uint32 recordIndex : uncommittedReadbacks)
+	{
+		readbackRecords[recordIndex].submitValue = syncPoint.value;
+	}
+	uncommittedReadbacks.clear();
+	if(gpuProfiler)
+	{
+		gpuProfiler->Submitted(syncPoint.value);
+	}
+	queryPools->Submitted(syncPoint.value);
+	// One command may record both graphics and compute work
+	pGfxPending->Reset();
+	pComputePending->Reset();
 	
 	return this;
 }
 
-IRHIHandle* VkHandle::BeginRenderPass()
+GpuSyncPoint VkHandle::RecordSubmit(CommandBufferVk* cmdBuffer)
 {
-	renderResManager->BeginRenderPass(currentVkCmd->Get());
-	return this;
+	submitRecords.push_back({ ++lastSubmitValue, cmdBuffer, cmdBuffer->SubmitSerial(), nullptr });
+	return GpuSyncPoint{ this, lastSubmitValue };
 }
 
-IRHIHandle* VkHandle::EndRenderPass()
+GpuSyncPoint VkHandle::LastSubmit()
 {
-	renderResManager->EndRenderPass(currentVkCmd->Get());
-	return this;
+	return GpuSyncPoint{ this, lastSubmitValue };
 }
 
-IRHIHandle* VkHandle::SetGraphicsPipeline(const GfxSetting& gfxSetting)
+Bool VkHandle::IsComplete(GpuSyncPoint syncPoint)
 {
-	PipelineLayoutVk* pipelineLayout = pGfxPending->GetPipelineLayout(deviceData);
-	GraphicsPipelineVk* vkGfxPipeline = renderResManager->GetGfxPipeline(gfxSetting, pipelineLayout);
-	if(vkGfxPipeline)
+	assert(syncPoint.handle == this || syncPoint.value == 0);
+	// Records are sorted by value, finished ones may already be gone
+	auto it = std::lower_bound(submitRecords.begin(), submitRecords.end(), syncPoint.value,
+		[](const SubmitRecordVk& record, Uint64 value) { return record.value < value; });
+	if(it == submitRecords.end() || it->value != syncPoint.value)
 	{
-		if(pGfxPending->SetPipeline(vkGfxPipeline))
-		{
-			bCurrentGfx = true;
-			pGfxPending->SetCmdBuffer(currentVkCmd->Get());
-			pGfxPending->Bind();
-			pGfxPending->MarkUpdateDynamicStates();
-		}
+		return true;
 	}
-	return this;
+	return it->cmdBuffer->IsComplete(it->serial);
 }
 
-IRHIHandle* VkHandle::SetComputePipeline()
+void VkHandle::WhenComplete(GpuSyncPoint syncPoint, std::coroutine_handle<> waiter)
 {
-	PipelineLayoutVk* pipelineLayout = pComputePending->GetPipelineLayout(deviceData);
-	ComputePipelineVk* vkComputePipeline = renderResManager->GetComputePipeline(pipelineLayout);
-	if(vkComputePipeline)
+	submitWaiters.push_back({ syncPoint.value, waiter });
+}
+
+void VkHandle::CopyUploadData(void* dst, const void* src, Uint32 size)
+{
+	if(size < 2 * UploadCopyBatchSize || jobSystem->WorkerCount() == 0)
 	{
-		if(pComputePending->SetPipeline(vkComputePipeline))
-		{
-			bCurrentGfx = false;
-			pComputePending->SetCmdBuffer(currentVkCmd->Get());
-			pComputePending->Bind();
-		}
+		memcpy(dst, src, size);
+		return;
 	}
-	return this;
+	// Large copies into staging memory are split across the workers, the caller helps until all are done
+	std::function<void(Uint32, Uint32)> copyBatch = [dst, src](Uint32 begin, Uint32 end)
+	{
+		memcpy(static_cast<std::byte*>(dst) + begin, static_cast<const std::byte*>(src) + begin, end - begin);
+	};
+	JobCounter counter;
+	jobSystem->ParallelFor(size, UploadCopyBatchSize, copyBatch, counter);
+	jobSystem->Wait(counter);
 }
 
-IRHIHandle* VkHandle::SetDefaultAttachments(const AttachmentDesc &attachmentDesc)
+GpuSyncPoint VkHandle::Upload(IBuffer* buffer, const void* data, Uint32 dataSize, Uint32 offset)
 {
-	vk::ResultValue result = deviceData.logicalDevice.acquireNextImageKHR(
-		swapChain.get(), UINT64_MAX, swapImageAvailableSemaphores[currentFrame].get(), nullptr);
-	swapImageIndex = result.value;
-
-	std::shared_ptr<AttachmentVk> colorAttach = std::make_shared<AttachmentVk>(swapImageViews[currentFrame].get(), attachmentDesc, false);
-	renderResManager->SetColorAttachments(colorAttach);
+	BufferVk* vkBuffer = CastVk<BufferVk>(buffer);
+	assert(vkBuffer && offset + dataSize <= vkBuffer->GetSize());
+	if(!vkBuffer->DescHandle().bStaging)
+	{
+		vkBuffer->UpdateBufferData(const_cast<void*>(data), dataSize, offset);
+		return GpuSyncPoint{ this, 0 };
+	}
 
-	currentVkCmd->AddWaitSemaphore(swapImageAvailableSemaphores[currentFrame].get());
-	currentVkCmd->AddSignalSemaphore(renderFinishedSemaphores[currentFrame].get());
-	currentVkCmd->AddWaitStage(vk::PipelineStageFlagBits::eColorAttachmentOutput);
-    return this;
+	BufferDesc stagingDesc;
+	stagingDesc.bufferType.bTransfer = true;
+	stagingDesc.elementNum = dataSize;
+	stagingDesc.stride = 1;
+	auto stagingBuffer = std::make_unique<BufferVk>(deviceData, stagingDesc);
+	CopyUploadData(stagingBuffer->Map(), data, dataSize);
+	stagingBuffer->UnMap();
+
+	CommandBufferVk* uploadCmd = cmdPoolManager->GetCmdBuffer();
+	uploadCmd->BeginCommand();
+	// Earlier submissions on the queue may still read the destination, the copy starts after them
+	uploadCmd->Get().pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer,
+		vk::DependencyFlags(), {}, {}, {});
+	uploadCmd->Get().copyBuffer(stagingBuffer->BufferHandle(), vkBuffer->BufferHandle(), vk::BufferCopy(0, offset, dataSize));
+	// Orders the copy before every later submission on the queue, the current frame included
+	auto memoryBarrier = vk::MemoryBarrier()
+		.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+		.setDstAccessMask(vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite);
+	uploadCmd->Get().pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands,
+		vk::DependencyFlags(), memoryBarrier, {}, {});
+	uploadCmd->EndCommand();
+	cmdPoolManager->SubmitCmdBuffer(uploadCmd, deviceData.graphicsQueue);
+
+	GpuSyncPoint syncPoint = RecordSubmit(uploadCmd);
+	submitRecords.back().stagingBuffer = std::move(stagingBuffer);
+	return syncPoint;
 }
 
-IRHIHandle *VkHandle::SetColorAttachments(ITexture *texture, const AttachmentDesc &attachmentDesc)
+ReadbackTicket VkHandle::AddReadbackRecord(const ReadbackRingVk::Allocation& allocation)
 {
-	TextureVk* vkTexture = dynamic_cast<TextureVk*>(texture);
-	if(vkTexture)
+	Uint32 recordIndex;
+	if(!freeReadbackRecords.empty())
 	{
-		std::shared_ptr<AttachmentVk> colorAttach = std::make_shared<AttachmentVk>(vkTexture->ImageViewPtr(), attachmentDesc, false);
-		renderResManager->SetColorAttachments(colorAttach);
+		recordIndex = freeReadbackRecords.back();
+		freeReadbackRecords.pop_back();
 	}
-    return this;
+	else
+	{
+		recordIndex = (Uint32)readbackRecords.size();
+		readbackRecords.emplace_back();
+	}
+	ReadbackRecordVk& record = readbackRecords[recordIndex];
+	record.allocation = allocation;
+	record.submitValue = 0;
+	record.generation = (record.generation + 1) & ResourceHandleGenerationMask;
+	record.generation = record.generation == 0 ? 1 : record.generation;
+	record.bLive = true;
+	record.bReleased = false;
+	uncommittedReadbacks.push_back(recordIndex);
+	return ReadbackTicket::Make(recordIndex, record.generation);
 }
 
-IRHIHandle* VkHandle::SetDepthAttachment(ITexture *texture, const AttachmentDesc& attachmentDesc)
+VkHandle::ReadbackRecordVk* VkHandle::FindReadbackRecord(ReadbackTicket ticket)
 {
-	TextureVk* vkTexture = dynamic_cast<TextureVk*>(texture);
-	if(vkTexture)
+	Uint32 recordIndex = ticket.Index();
+	if(recordIndex < readbackRecords.size() && readbackRecords[recordIndex].bLive
+		&& !readbackRecords[recordIndex].bReleased && readbackRecords[recordIndex].generation == ticket.Generation())
 	{
-		std::shared_ptr<AttachmentVk> depthAttach = std::make_shared<AttachmentVk>(vkTexture->ImageViewPtr(), attachmentDesc, true);
-		renderResManager->SetDepthAttachment(depthAttach);
+		return &readbackRecords[recordIndex];
 	}
-    return this;
+	return nullptr;
 }
 
-IRHIHandle* VkHandle::SetVertexShader(IShader *shader)
+Bool VkHandle::IsReadbackComplete(const ReadbackRecordVk& record)
 {
-	assert(shader);
-	renderResManager->SetShader<IShader::Stage::Vertex>(shader);
-    return this;
+	return record.submitValue != 0 && IsComplete(GpuSyncPoint{ this, record.submitValue });
 }
 
-IRHIHandle* VkHandle::SetPixelShader(IShader *shader)
+void VkHandle::FreeReadbackRecord(Uint32 recordIndex)
 {
-	assert(shader);
-	renderResManager->SetShader<IShader::Stage::Pixel>(shader);
-    return this;
+	ReadbackRecordVk& record = readbackRecords[recordIndex];
+	readbackRing->Release(record.allocation);
+	record.bLive = false;
+	record.bReleased = false;
+	freeReadbackRecords.push_back(recordIndex);
 }
 
-IRHIHandle* VkHandle::SetComputeShader(IShader *shader)
+ReadbackTicket VkHandle::RequestReadback(IBuffer* buffer, Uint32 offset, Uint32 size)
 {
-	assert(shader);
-	renderResManager->SetShader<IShader::Stage::Compute>(shader);
-    return this;
+	BufferVk* vkBuffer = CastVk<BufferVk>(buffer);
+	assert(vkBuffer && offset + size <= vkBuffer->GetSize());
+	assert(vkBuffer->DescHandle().bufferType.bTransfer);
+
+	ReadbackRingVk::Allocation allocation = readbackRing->Allocate(size);
+	vk::CommandBuffer cmdBuffer = currentVkCmd->Get();
+	// Scoped to the transfer stage, earlier work only has to finish its writes
+	auto readBarrier = vk::MemoryBarrier()
+		.setSrcAccessMask(vk::AccessFlagBits::eMemoryWrite)
+		.setDstAccessMask(vk::AccessFlagBits::eTransferRead);
+	cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer,
+		vk::DependencyFlags(), readBarrier, {}, {});
+	cmdBuffer.copyBuffer(vkBuffer->BufferHandle(), readbackRing->BufferHandle(allocation),
+		vk::BufferCopy(offset, allocation.offset, size));
+	auto hostBarrier = vk::MemoryBarrier()
+		.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+		.setDstAccessMask(vk::AccessFlagBits::eHostRead);
+	cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost,
+		vk::DependencyFlags(), hostBarrier, {}, {});
+
+	return AddReadbackRecord(allocation);
 }
 
-IRHIHandle *VkHandle::SetVertexStream(Uint32 vertId, IBuffer *buffer, Uint32 offset)
+ReadbackTicket VkHandle::RequestReadback(ITexture* texture, const TextureRegion& region)
 {
-	BufferVk* vkBuffer = dynamic_cast<BufferVk*>(buffer);
-	if(vkBuffer)
+	TextureVk* vkTexture = CastVk<TextureVk>(texture);
+	assert(vkTexture);
+	const ImageDesc& imageDesc = vkTexture->ImageViewPtr()->DescHandle();
+	Uint32 texelSize = FormatTexelSize(imageDesc.format);
+	assert(texelSize > 0 && region.mipLevel < imageDesc.imageViewDesc.mipLevelsCount);
+
+	Uint32 extent[3];
+	for(Uint32 i = 0; i < 3; i++)
 	{
-		pGfxPending->SetVertex(vertId, vkBuffer->BufferHandle(), offset);
+		Uint32 mipSize = (std::max)(imageDesc.size3[i] >> region.mipLevel, 1u);
+		extent[i] = region.extent[i] > 0 ? region.extent[i] : mipSize - region.offset[i];
+		assert(region.offset[i] + extent[i] <= mipSize);
 	}
-	return this;
+	Uint32 size = extent[0] * extent[1] * extent[2] * texelSize;
+	ReadbackRingVk::Allocation allocation = readbackRing->Allocate(size);
+
+	vk::ImageAspectFlags aspect = imageDesc.bDepth ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
+	ImageViewVk* vkImageView = vkTexture->ImageViewPtr();
+	vk::ImageLayout oldLayout = vkImageView->CurrentLayout();
+	auto subresourceRange = vk::ImageSubresourceRange(aspect, region.mipLevel, 1, region.arrayLayer, 1);
+	// A never written image has no layout to return to, all of it moves to the layout it would rest in
+	if(oldLayout == vk::ImageLayout::eUndefined)
+	{
+		subresourceRange = vk::ImageSubresourceRange(aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS);
+		vkImageView->CurrentLayout() = RestingImageLayout(imageDesc);
+	}
+	vk::ImageLayout restingLayout = vkImageView->CurrentLayout();
+	auto toTransfer = vk::ImageMemoryBarrier()
+		.setOldLayout(oldLayout)
+		.setNewLayout(vk::ImageLayout::eTransferSrcOptimal)
+		.setSrcAccessMask(vk::AccessFlagBits::eMemoryWrite)
+		.setDstAccessMask(vk::AccessFlagBits::eTransferRead)
+		.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+		.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+		.setImage(vkTexture->ImageHandle())
+		.setSubresourceRange(subresourceRange);
+	auto toResting = vk::ImageMemoryBarrier(toTransfer)
+		.setOldLayout(vk::ImageLayout::eTransferSrcOptimal)
+		.setNewLayout(restingLayout)
+		.setSrcAccessMask(vk::AccessFlags())
+		.setDstAccessMask(vk::AccessFlags());
+	auto hostBarrier = vk::MemoryBarrier()
+		.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+		.setDstAccessMask(vk::AccessFlagBits::eHostRead);
+
+	auto copyRegion = vk::BufferImageCopy()
+		.setBufferOffset(allocation.offset)
+		.setBufferRowLength(0)
+		.setBufferImageHeight(0)
+		.setImageSubresource(vk::ImageSubresourceLayers(aspect, region.mipLevel, region.arrayLayer, 1))
+		.setImageOffset(vk::Offset3D(region.offset[0], region.offset[1], region.offset[2]))
+		.setImageExtent(vk::Extent3D(extent[0], extent[1], extent[2]));
+
+	vk::CommandBuffer cmdBuffer = currentVkCmd->Get();
+	cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer,
+		vk::DependencyFlags(), {}, {}, toTransfer);
+	cmdBuffer.copyImageToBuffer(vkTexture->ImageHandle(), vk::ImageLayout::eTransferSrcOptimal,
+		readbackRing->BufferHandle(allocation), copyRegion);
+	// Later work waits on its own barriers, the layout change back only has to follow the copy
+	cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost | vk::PipelineStageFlagBits::eAllCommands,
+		vk::DependencyFlags(), hostBarrier, {}, toResting);
+
+	return AddReadbackRecord(allocation);
 }
 
-IRHIHandle* VkHandle::SetViewport(Extent2D minExt, Extent2D maxExt)
+GpuSyncPoint VkHandle::GetReadbackSyncPoint(ReadbackTicket ticket)
 {
-	vk::Viewport viewport;
-	viewport.setMinDepth(0).setMaxDepth(0);
-	viewport.setX(minExt.width).setY(minExt.height);
-	viewport.setWidth(maxExt.width - minExt.width).setHeight(maxExt.height - minExt.height);
-	pGfxPending->SetViewport(viewport);
-	return this;
+	ReadbackRecordVk* record = FindReadbackRecord(ticket);
+	assert(record);
+	return GpuSyncPoint{ this, record ? record->submitValue : 0 };
 }
 
-IRHIHandle* VkHandle::SetViewport(Extent3D minExt, Extent3D maxExt)
+std::span<const std::byte> VkHandle::GetReadbackData(ReadbackTicket ticket)
 {
-	vk::Viewport viewport;
-	viewport.setMinDepth(minExt.depth).setMaxDepth(maxExt.depth);
-	viewport.setX(minExt.width).setY(minExt.height);
-	viewport.setWidth(maxExt.width - minExt.width).setHeight(maxExt.height - minExt.height);
-	pGfxPending->SetViewport(viewport);
-	return this;
+	ReadbackRecordVk* record = FindReadbackRecord(ticket);
+	if(!record || !IsReadbackComplete(*record))
+	{
+		return {};
+	}
+	return readbackRing->Read(record->allocation);
 }
 
-IRHIHandle* VkHandle::SetScissor(Extent2D minExt, Extent2D maxExt)
+void VkHandle::ReleaseReadback(ReadbackTicket ticket)
 {
-	vk::Rect2D rect2D;
-	rect2D.setOffset(vk::Offset2D(minExt.width, minExt.height));
-	rect2D.setExtent(vk::Extent2D(maxExt.width - minExt.width, maxExt.height - minExt.height));
-	pGfxPending->SetScissor(rect2D);
-	return this;
+	ReadbackRecordVk* record = FindReadbackRecord(ticket);
+	assert(record && "readback released twice");
+	if(record && IsReadbackComplete(*record))
+	{
+		FreeReadbackRecord(ticket.Index());
+	}
+	else if(record)
+	{
+		// A copy still in flight would land in recycled memory, PollSubmits frees it once it completed
+		record->bReleased = true;
+		releasedReadbacks.push_back(ticket.Index());
+	}
 }
 
-IRHIHandle* VkHandle::SetSamplerTexture(ITexture *texture, IShader::Stage stage, Uint setId, Uint bindingId)
+VkHandle* VkHandle::BeginGpuScope(const char* name)
 {
-	TextureVk* vkTexture = dynamic_cast<TextureVk*>(texture);
-	if(vkTexture)
+	if(gpuProfiler)
 	{
-		if(stage == IShader::Stage::Compute)
-		{
-			pComputePending->SetSamplerImage(vkTexture, stage, setId, bindingId);
-		}
-		else
-		{
-			pGfxPending->SetSamplerImage(vkTexture, stage, setId, bindingId);
-		}
+		gpuProfiler->BeginScope(currentVkCmd->Get(), name);
 	}
 	return this;
 }
 
-IRHIHandle* VkHandle::SetStorageTexture(ITexture *texture, IShader::Stage stage, Uint setId, Uint bindingId)
+VkHandle* VkHandle::EndGpuScope()
 {
-	TextureVk* vkTexture = dynamic_cast<TextureVk*>(texture);
-	if(vkTexture)
+	if(gpuProfiler)
 	{
-		if(stage == IShader::Stage::Compute)
+		gpuProfiler->EndScope(currentVkCmd->Get());
+	}
+	return this;
+}
+
+std::vector<GpuScopeStats> VkHandle::GetGpuScopeStats()
+{
+	return gpuProfiler ? gpuProfiler->GetScopeStats() : std::vector<GpuScopeStats>();
+}
+
+Bool VkHandle::ExportTrace(const char* filePath)
+{
+	std::vector<TraceEvent> events;
+	std::vector<TraceThread> threads;
+	if(gpuProfiler)
+	{
+		gpuProfiler->AppendTrace(events, threads);
+	}
+	// Empty unless built with RHI_CPU_PROFILE
+	CpuProfiler::Get().AppendTrace(events, threads);
+	return WriteChromeTrace(filePath, events, threads);
+}
+
+VkHandle* VkHandle::BeginQuery(QueryType type, Uint32 index)
+{
+	// Occlusion and pipeline statistics queries need the graphics queue this command is submitted to
+	assert(bCurrentGfx && "queries in a compute command");
+	queryPools->BeginQuery(currentVkCmd->Get(), type, index);
+	return this;
+}
+
+VkHandle* VkHandle::EndQuery(QueryType type, Uint32 index)
+{
+	assert(bCurrentGfx && "queries in a compute command");
+	queryPools->EndQuery(currentVkCmd->Get(), type, index);
+	return this;
+}
+
+VkHandle* VkHandle::ResolveQueries(QueryType type, Uint32 firstIndex, Uint32 count, IBuffer* buffer, Uint32 offset)
+{
+	BufferVk* vkBuffer = CastVk<BufferVk>(buffer);
+	if(vkBuffer)
+	{
+		assert(vkBuffer->DescHandle().bufferType.bTransfer);
+		assert(offset + count * QueryPoolsVk::ResultSize(type) <= vkBuffer->GetSize());
+		queryPools->Resolve(currentVkCmd->Get(), type, firstIndex, count, vkBuffer->BufferHandle(), offset);
+	}
+	return this;
+}
+
+VkHandle* VkHandle::BeginConditional(IBuffer* buffer, Uint32 offset)
+{
+	assert(!bConditional && "conditional blocks do not nest");
+	BufferVk* vkBuffer = CastVk<BufferVk>(buffer);
+	if(vkBuffer && deviceData.enabledFeatures.conditionalRendering)
+	{
+		assert(vkBuffer->DescHandle().bufferType.bPredicate);
+		assert(offset % 4 == 0 && offset + sizeof(Uint32) <= vkBuffer->GetSize());
+		auto conditionalInfo = vk::ConditionalRenderingBeginInfoEXT()
+			.setBuffer(vkBuffer->BufferHandle())
+			.setOffset(offset);
+		currentVkCmd->Get().beginConditionalRenderingEXT(conditionalInfo, deviceData.dispatcher);
+		bConditional = true;
+		bConditionalInRenderPass = bInRenderPass;
+	}
+	return this;
+}
+
+VkHandle* VkHandle::EndConditional()
+{
+	// Begun outside of a render pass, the block has to end outside of one as well
+	assert(!bConditional || bConditionalInRenderPass == bInRenderPass);
+	if(bConditional && bConditionalInRenderPass == bInRenderPass)
+	{
+		currentVkCmd->Get().endConditionalRenderingEXT(deviceData.dispatcher);
+		bConditional = false;
+	}
+	return this;
+}
+
+void VkHandle::PollSubmits()
+{
+	while(!submitRecords.empty() && submitRecords.front().cmdBuffer->IsComplete(submitRecords.front().serial))
+	{
+		submitRecords.pop_front();
+	}
+
+	std::erase_if(releasedReadbacks, [this](Uint32 recordIndex)
+	{
+		if(!IsReadbackComplete(readbackRecords[recordIndex]))
+		{
+			return false;
+		}
+		FreeReadbackRecord(recordIndex);
+		return true;
+	});
+
+	if(submitWaiters.empty())
+	{
+		return;
+	}
+	// Resumed tasks may record and wait again, they land in the fresh list
+	std::vector<std::pair<Uint64, std::coroutine_handle<>>> waiters;
+	waiters.swap(submitWaiters);
+	for(auto& [value, waiter] : waiters)
+	{
+		if(IsComplete(GpuSyncPoint{ this, value }))
+		{
+			waiter.resume();
+		}
+		else
+		{
+			submitWaiters.push_back({ value, waiter });
+		}
+	}
+}
+
+VkHandle* VkHandle::BeginRenderPass()
+{
+	RHI_PROFILE_ZONE("BeginRenderPass");
+	if(gpuProfiler)
+	{
+		gpuProfiler->BeginScope(currentVkCmd->Get(), "RenderPass");
+	}
+	renderResManager->BeginRenderPass(currentVkCmd->Get());
+	bInRenderPass = true;
+	return this;
+}
+
+VkHandle* VkHandle::EndRenderPass()
+{
+	// A block begun inside the render pass cannot outlive it
+	if(bConditional && bConditionalInRenderPass)
+	{
+		EndConditional();
+	}
+	renderResManager->EndRenderPass(currentVkCmd->Get());
+	bInRenderPass = false;
+	if(gpuProfiler)
+	{
+		gpuProfiler->EndScope(currentVkCmd->Get());
+	}
+	return this;
+}
+
+VkHandle* VkHandle::SetGraphicsPipeline(const GfxSetting& gfxSetting)
+{
+	RHI_PROFILE_ZONE("SetGraphicsPipeline");
+	PipelineLayoutVk* pipelineLayout = pGfxPending->GetPipelineLayout(deviceData);
+	GraphicsPipelineVk* vkGfxPipeline = renderResManager->GetGfxPipeline(gfxSetting, pipelineLayout);
+	if(vkGfxPipeline)
+	{
+		bCurrentGfx = true;
+		// Viewport and scissor are dynamic in every pipeline, they survive the bind
+		if(pGfxPending->SetPipeline(vkGfxPipeline))
+		{
+			pGfxPending->Bind();
+		}
+	}
+	return this;
+}
+
+VkHandle* VkHandle::SetComputePipeline()
+{
+	RHI_PROFILE_ZONE("SetComputePipeline");
+	PipelineLayoutVk* pipelineLayout = pComputePending->GetPipelineLayout(deviceData);
+	ComputePipelineVk* vkComputePipeline = renderResManager->GetComputePipeline(pipelineLayout);
+	if(vkComputePipeline)
+	{
+		bCurrentGfx = false;
+		if(pComputePending->SetPipeline(vkComputePipeline))
+		{
+			pComputePending->Bind();
+		}
+	}
+	return this;
+}
+
+VkHandle* VkHandle::SetDefaultAttachments(const AttachmentDesc &attachmentDesc)
+{
+	// The submission thread owns the swapchain, it blits this frame's back buffer into an image it acquires
+	if(submitThread)
+	{
+		std::shared_ptr<AttachmentVk> colorAttach = std::make_shared<AttachmentVk>(backBuffers[currentFrame].get(), attachmentDesc, false);
+		renderResManager->SetColorAttachments(colorAttach);
+		currentVkCmd->AddSignalSemaphore(renderFinishedSemaphores[currentFrame].get());
+		bBackBufferRendered = true;
+		return this;
+	}
+
+	// The queues are not touched, so the acquire blocks without the queue lock
+	if(bSwapChainOutOfDate)
+	{
+		RecreateSwapChainWhenVisible();
+	}
+	while(true)
+	{
+		try
+		{
+			auto result = deviceData.logicalDevice.acquireNextImageKHR(
+				swapChain.get(), SwapChainAcquireTimeout, swapImageAvailableSemaphores[currentFrame].get(), nullptr);
+			if(result.result == vk::Result::eSuccess || result.result == vk::Result::eSuboptimalKHR)
+			{
+				// A suboptimal image still signals the semaphore, it is presented and the swapchain recreated after
+				bSwapChainOutOfDate |= result.result == vk::Result::eSuboptimalKHR;
+				swapImageIndex = result.value;
+				break;
+			}
+			// eTimeout or eNotReady, the driver blocked for the whole timeout
+		}
+		catch(const vk::OutOfDateKHRError&)
+		{
+			RecreateSwapChainWhenVisible();
+		}
+	}
+
+	std::shared_ptr<AttachmentVk> colorAttach = std::make_shared<AttachmentVk>(swapImageViews[swapImageIndex].get(), attachmentDesc, false);
+	renderResManager->SetColorAttachments(colorAttach);
+
+	currentVkCmd->AddWaitSemaphore(swapImageAvailableSemaphores[currentFrame].get());
+	currentVkCmd->AddSignalSemaphore(renderFinishedSemaphores[currentFrame].get());
+	currentVkCmd->AddWaitStage(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+    return this;
+}
+
+VkHandle* VkHandle::SetColorAttachments(ITexture *texture, const AttachmentDesc &attachmentDesc)
+{
+	TextureVk* vkTexture = CastVk<TextureVk>(texture);
+	if(vkTexture)
+	{
+		std::shared_ptr<AttachmentVk> colorAttach = std::make_shared<AttachmentVk>(vkTexture->ImageViewPtr(), attachmentDesc, false);
+		renderResManager->SetColorAttachments(colorAttach);
+	}
+    return this;
+}
+
+VkHandle* VkHandle::SetDepthAttachment(ITexture *texture, const AttachmentDesc& attachmentDesc)
+{
+	TextureVk* vkTexture = CastVk<TextureVk>(texture);
+	if(vkTexture)
+	{
+		std::shared_ptr<AttachmentVk> depthAttach = std::make_shared<AttachmentVk>(vkTexture->ImageViewPtr(), attachmentDesc, true);
+		renderResManager->SetDepthAttachment(depthAttach);
+	}
+    return this;
+}
+
+VkHandle* VkHandle::SetVertexShader(IShader *shader)
+{
+	assert(shader);
+	renderResManager->SetShader<IShader::Stage::Vertex>(shader);
+    return this;
+}
+
+VkHandle* VkHandle::SetPixelShader(IShader *shader)
+{
+	assert(shader);
+	renderResManager->SetShader<IShader::Stage::Pixel>(shader);
+    return this;
+}
+
+VkHandle* VkHandle::SetComputeShader(IShader *shader)
+{
+	assert(shader);
+	renderResManager->SetShader<IShader::Stage::Compute>(shader);
+    return this;
+}
+
+VkHandle* VkHandle::SetVertexStream(Uint32 vertId, IBuffer *buffer, Uint32 offset)
+{
+	BufferVk* vkBuffer = CastVk<BufferVk>(buffer);
+	if(vkBuffer)
+	{
+		pGfxPending->SetVertex(vertId, vkBuffer->BufferHandle(), offset);
+	}
+	return this;
+}
+
+// Uint8 without its feature or a misaligned offset would be a device error, such streams are dropped
+// and unbind the previous one, so indexed draws are skipped until a valid stream is set
+static Bool IsValidIndexStream(const DeviceData& deviceData, Uint32 offset, IndexType indexType)
+{
+	assert(indexType != IndexType::Uint8 || deviceData.enabledFeatures.indexTypeUint8);
+	assert(offset % IndexTypeSize(indexType) == 0);
+	return (indexType != IndexType::Uint8 || deviceData.enabledFeatures.indexTypeUint8)
+		&& offset % IndexTypeSize(indexType) == 0;
+}
+
+VkHandle* VkHandle::SetIndexStream(IBuffer* buffer, Uint32 offset, IndexType indexType)
+{
+	BufferVk* vkBuffer = CastVk<BufferVk>(buffer);
+	if(vkBuffer && IsValidIndexStream(deviceData, offset, indexType))
+	{
+		pGfxPending->SetIndex(vkBuffer->BufferHandle(), offset, ConvertIndexType(indexType));
+	}
+	else
+	{
+		pGfxPending->SetIndex(vk::Buffer(), 0, vk::IndexType::eUint16);
+	}
+	return this;
+}
+
+VkHandle* VkHandle::SetVertexStream(Uint32 vertId, BufferId buffer, Uint32 offset)
+{
+	const BufferSlotVk* slot = bufferPool.GetSlot(buffer);
+	assert(slot || !buffer.IsValid());
+	if(slot)
+	{
+		pGfxPending->SetVertex(vertId, slot->buffer, offset);
+	}
+	return this;
+}
+
+VkHandle* VkHandle::SetIndexStream(BufferId buffer, Uint32 offset, IndexType indexType)
+{
+	const BufferSlotVk* slot = bufferPool.GetSlot(buffer);
+	assert(slot || !buffer.IsValid());
+	if(slot && IsValidIndexStream(deviceData, offset, indexType))
+	{
+		pGfxPending->SetIndex(slot->buffer, offset, ConvertIndexType(indexType));
+	}
+	else
+	{
+		pGfxPending->SetIndex(vk::Buffer(), 0, vk::IndexType::eUint16);
+	}
+	return this;
+}
+
+Bool VkHandle::SetDrawIndexBuffer(IBuffer* indexBuffer)
+{
+	BufferVk* vkIndexBuffer = CastVk<BufferVk>(indexBuffer);
+	if(vkIndexBuffer)
+	{
+		SetIndexStream(vkIndexBuffer, 0, vkIndexBuffer->DescHandle().indexType);
+	}
+	assert(pGfxPending->HasIndex());
+	return pGfxPending->HasIndex();
+}
+
+VkHandle* VkHandle::SetViewport(Extent2D minExt, Extent2D maxExt)
+{
+	vk::Viewport viewport;
+	viewport.setMinDepth(0).setMaxDepth(0);
+	viewport.setX(minExt.width).setY(minExt.height);
+	viewport.setWidth(maxExt.width - minExt.width).setHeight(maxExt.height - minExt.height);
+	pGfxPending->SetViewport(viewport);
+	return this;
+}
+
+VkHandle* VkHandle::SetViewport(Extent3D minExt, Extent3D maxExt)
+{
+	vk::Viewport viewport;
+	viewport.setMinDepth(minExt.depth).setMaxDepth(maxExt.depth);
+	viewport.setX(minExt.width).setY(minExt.height);
+	viewport.setWidth(maxExt.width - minExt.width).setHeight(maxExt.height - minExt.height);
+	pGfxPending->SetViewport(viewport);
+	return this;
+}
+
+VkHandle* VkHandle::SetScissor(Extent2D minExt, Extent2D maxExt)
+{
+	vk::Rect2D rect2D;
+	rect2D.setOffset(vk::Offset2D(minExt.width, minExt.height));
+	rect2D.setExtent(vk::Extent2D(maxExt.width - minExt.width, maxExt.height - minExt.height));
+	pGfxPending->SetScissor(rect2D);
+	return this;
+}
+
+VkHandle* VkHandle::SetSamplerTexture(ITexture *texture, IShader::Stage stage, Uint setId, Uint bindingId)
+{
+	TextureVk* vkTexture = CastVk<TextureVk>(texture);
+	if(vkTexture)
+	{
+		if(stage == IShader::Stage::Compute)
+		{
+			pComputePending->SetSamplerImage(vkTexture, stage, setId, bindingId);
+		}
+		else
+		{
+			pGfxPending->SetSamplerImage(vkTexture, stage, setId, bindingId);
+		}
+	}
+	return this;
+}
+
+VkHandle* VkHandle::SetStorageTexture(ITexture *texture, IShader::Stage stage, Uint setId, Uint bindingId)
+{
+	TextureVk* vkTexture = CastVk<TextureVk>(texture);
+	if(vkTexture)
+	{
+		if(stage == IShader::Stage::Compute)
 		{
 			pComputePending->SetStorageImage(vkTexture, stage, setId, bindingId);
 		}
@@ -615,9 +1544,9 @@ IRHIHandle* VkHandle::SetStorageTexture(ITexture *texture, IShader::Stage stage,
 	return this;
 }
 
-IRHIHandle* VkHandle::SetStorageBuffer(IBuffer *buffer, IShader::Stage stage, Uint setId, Uint bindingId)
+VkHandle* VkHandle::SetStorageBuffer(IBuffer *buffer, IShader::Stage stage, Uint setId, Uint bindingId)
 {
-	BufferVk* vkBuffer = dynamic_cast<BufferVk*>(buffer);
+	BufferVk* vkBuffer = CastVk<BufferVk>(buffer);
 	if(vkBuffer)
 	{
 		if(stage == IShader::Stage::Compute)
@@ -632,9 +1561,9 @@ IRHIHandle* VkHandle::SetStorageBuffer(IBuffer *buffer, IShader::Stage stage, Ui
 	return this;
 }
 
-IRHIHandle* VkHandle::SetUniformBuffer(IBuffer *buffer, IShader::Stage stage, Uint setId, Uint bindingId)
+VkHandle* VkHandle::SetUniformBuffer(IBuffer *buffer, IShader::Stage stage, Uint setId, Uint bindingId)
 {
-	BufferVk* vkBuffer = dynamic_cast<BufferVk*>(buffer);
+	BufferVk* vkBuffer = CastVk<BufferVk>(buffer);
 	if(vkBuffer)
 	{
 		if(stage == IShader::Stage::Compute)
@@ -649,7 +1578,113 @@ IRHIHandle* VkHandle::SetUniformBuffer(IBuffer *buffer, IShader::Stage stage, Ui
 	return this;
 }
 
-IRHIHandle* VkHandle::DrawPrimitive(Uint32 vertexCount, Uint32 firstVertex)
+VkHandle* VkHandle::SetSamplerTexture(TextureId texture, IShader::Stage stage, Uint setId, Uint bindingId)
+{
+	// The slot holds everything the descriptor needs, the TextureVk is never touched
+	const TextureSlotVk* slot = texturePool.GetSlot(texture);
+	assert(slot || !texture.IsValid());
+	if(slot)
+	{
+		assert(slot->sampler);
+		if(stage == IShader::Stage::Compute)
+		{
+			pComputePending->SetSamplerImage(slot->imageView, slot->sampler, stage, setId, bindingId);
+		}
+		else
+		{
+			pGfxPending->SetSamplerImage(slot->imageView, slot->sampler, stage, setId, bindingId);
+		}
+	}
+	return this;
+}
+
+VkHandle* VkHandle::SetStorageBuffer(BufferId buffer, IShader::Stage stage, Uint setId, Uint bindingId)
+{
+	const BufferSlotVk* slot = bufferPool.GetSlot(buffer);
+	assert(slot || !buffer.IsValid());
+	if(slot)
+	{
+		assert(slot->bufferType.bStorage);
+		if(stage == IShader::Stage::Compute)
+		{
+			pComputePending->SetStorageBuffer(slot->buffer, slot->size, stage, setId, bindingId);
+		}
+		else
+		{
+			pGfxPending->SetStorageBuffer(slot->buffer, slot->size, stage, setId, bindingId);
+		}
+	}
+	return this;
+}
+
+VkHandle* VkHandle::SetUniformBuffer(BufferId buffer, IShader::Stage stage, Uint setId, Uint bindingId)
+{
+	const BufferSlotVk* slot = bufferPool.GetSlot(buffer);
+	assert(slot || !buffer.IsValid());
+	if(slot)
+	{
+		assert(slot->bufferType.bUniform);
+		if(stage == IShader::Stage::Compute)
+		{
+			pComputePending->SetUniformBuffer(slot->buffer, slot->size, stage, setId, bindingId);
+		}
+		else
+		{
+			pGfxPending->SetUniformBuffer(slot->buffer, slot->size, stage, setId, bindingId);
+		}
+	}
+	return this;
+}
+
+VkHandle* VkHandle::SetStorageBuffer(IBuffer *buffer, IShader::Stage stage, Uint setId, Uint bindingId, Uint32 offset, Uint32 range)
+{
+	BufferVk* vkBuffer = CastVk<BufferVk>(buffer);
+	if(vkBuffer)
+	{
+		if(stage == IShader::Stage::Compute)
+		{
+			pComputePending->SetStorageBuffer(vkBuffer, stage, setId, bindingId, offset, range);
+		}
+		else
+		{
+			pGfxPending->SetStorageBuffer(vkBuffer, stage, setId, bindingId, offset, range);
+		}
+	}
+	return this;
+}
+
+VkHandle* VkHandle::SetUniformBuffer(IBuffer *buffer, IShader::Stage stage, Uint setId, Uint bindingId, Uint32 offset, Uint32 range)
+{
+	BufferVk* vkBuffer = CastVk<BufferVk>(buffer);
+	if(vkBuffer)
+	{
+		if(stage == IShader::Stage::Compute)
+		{
+			pComputePending->SetUniformBuffer(vkBuffer, stage, setId, bindingId, offset, range);
+		}
+		else
+		{
+			pGfxPending->SetUniformBuffer(vkBuffer, stage, setId, bindingId, offset, range);
+		}
+	}
+	return this;
+}
+
+VkHandle* VkHandle::SetPushConstants(IShader::Stage stage, const void* data, Uint32 size, Uint32 offset)
+{
+	assert(data);
+	if(stage == IShader::Stage::Compute)
+	{
+		pComputePending->SetPushConstants(stage, data, size, offset);
+	}
+	else
+	{
+		pGfxPending->SetPushConstants(stage, data, size, offset);
+	}
+	return this;
+}
+
+VkHandle* VkHandle::DrawPrimitive(Uint32 vertexCount, Uint32 firstVertex)
 {
 	pGfxPending->PrepareDraw();
 	// #1: vert count per instance
@@ -660,45 +1695,247 @@ IRHIHandle* VkHandle::DrawPrimitive(Uint32 vertexCount, Uint32 firstVertex)
 	return this;
 }
 
-IRHIHandle* VkHandle::DrawPrimitiveIndirect(IBuffer *argumentBuffer, Uint32 argumentOffset)
+VkHandle* VkHandle::DrawPrimitiveIndirect(IBuffer *argumentBuffer, Uint32 argumentOffset)
 {
 	pGfxPending->PrepareDraw();
-	BufferVk* vkArgumentBuffer = dynamic_cast<BufferVk*>(argumentBuffer);
+	BufferVk* vkArgumentBuffer = CastVk<BufferVk>(argumentBuffer);
 	if(vkArgumentBuffer)
 	{
-		currentVkCmd->Get().drawIndirect(vkArgumentBuffer->BufferHandle(), 0, 1, sizeof(vk::DrawIndirectCommand));
+		currentVkCmd->Get().drawIndirect(vkArgumentBuffer->BufferHandle(), argumentOffset, 1, sizeof(vk::DrawIndirectCommand));
 	}
 	return this;
 }
 
-IRHIHandle* VkHandle::DrawIndexPrimitive(IBuffer *indexBuffer, Uint32 indexCount, Uint32 firstIndex, Int32 vertOffset)
+VkHandle* VkHandle::DrawIndexPrimitive(IBuffer *indexBuffer, Uint32 indexCount, Uint32 firstIndex, Int32 vertOffset)
 {
+	if(!SetDrawIndexBuffer(indexBuffer))
+	{
+		return this;
+	}
 	pGfxPending->PrepareDraw();
-	BufferVk* vkIndexBuffer = dynamic_cast<BufferVk*>(indexBuffer);
-	if(vkIndexBuffer)
+	// #1: index count per instance
+	// #2: instance count
+	// #3: first used Index (#3 + #1 <= IndexBuffer Sum)
+	// #4: ignore first #4 num vertices
+	// #5: same #4 but instance
+	currentVkCmd->Get().drawIndexed(indexCount, 1, firstIndex, vertOffset, 0);
+	return this;
+}
+
+static_assert(sizeof(DrawIndirectArgs) == sizeof(vk::DrawIndirectCommand));
+static_assert(sizeof(DrawIndexedIndirectArgs) == sizeof(vk::DrawIndexedIndirectCommand));
+
+VkHandle* VkHandle::DrawPrimitiveInstanced(Uint32 vertexCount, Uint32 instanceCount, Uint32 firstVertex, Uint32 firstInstance)
+{
+	pGfxPending->PrepareDraw();
+	currentVkCmd->Get().draw(vertexCount, instanceCount, firstVertex, firstInstance);
+	return this;
+}
+
+VkHandle* VkHandle::DrawIndexPrimitiveInstanced(IBuffer *indexBuffer, Uint32 indexCount, Uint32 instanceCount, Uint32 firstIndex, Int32 vertOffset, Uint32 firstInstance)
+{
+	if(!SetDrawIndexBuffer(indexBuffer))
+	{
+		return this;
+	}
+	pGfxPending->PrepareDraw();
+	currentVkCmd->Get().drawIndexed(indexCount, instanceCount, firstIndex, vertOffset, firstInstance);
+	return this;
+}
+
+VkHandle* VkHandle::DrawPrimitiveIndirect(IBuffer *argumentBuffer, Uint32 argumentOffset, Uint32 drawCount, Uint32 stride)
+{
+	pGfxPending->PrepareDraw();
+	BufferVk* vkArgumentBuffer = CastVk<BufferVk>(argumentBuffer);
+	if(vkArgumentBuffer)
+	{
+		if(deviceData.enabledFeatures.multiDrawIndirect || drawCount <= 1)
+		{
+			currentVkCmd->Get().drawIndirect(vkArgumentBuffer->BufferHandle(), argumentOffset, drawCount, stride);
+		}
+		else
+		{
+			// Without multiDrawIndirect every record needs its own command
+			for(Uint32 i = 0; i < drawCount; i++)
+			{
+				currentVkCmd->Get().drawIndirect(vkArgumentBuffer->BufferHandle(), argumentOffset + i * stride, 1, stride);
+			}
+		}
+	}
+	return this;
+}
+
+VkHandle* VkHandle::DrawIndexPrimitiveIndirect(IBuffer *indexBuffer, IBuffer *argumentBuffer, Uint32 argumentOffset, Uint32 drawCount, Uint32 stride)
+{
+	if(!SetDrawIndexBuffer(indexBuffer))
+	{
+		return this;
+	}
+	pGfxPending->PrepareDraw();
+	BufferVk* vkArgumentBuffer = CastVk<BufferVk>(argumentBuffer);
+	if(vkArgumentBuffer)
 	{
-		// #1: index count per instance
-		// #2: instance count
-		// #3: first used Index (#3 + #1 <= IndexBuffer Sum)
-		// #4: ignore first #4 num vertices
-		// #5: same #4 but instance
+		if(deviceData.enabledFeatures.multiDrawIndirect || drawCount <= 1)
+		{
+			currentVkCmd->Get().drawIndexedIndirect(vkArgumentBuffer->BufferHandle(), argumentOffset, drawCount, stride);
+		}
+		else
+		{
+			for(Uint32 i = 0; i < drawCount; i++)
+			{
+				currentVkCmd->Get().drawIndexedIndirect(vkArgumentBuffer->BufferHandle(), argumentOffset + i * stride, 1, stride);
+			}
+		}
+	}
+	return this;
+}
 
-		currentVkCmd->Get().bindIndexBuffer(vkIndexBuffer->BufferHandle(), 0, vk::IndexType::eUint16);
-		currentVkCmd->Get().drawIndexed(indexCount, 1, firstIndex, vertOffset, 0);
+VkHandle* VkHandle::DrawPrimitiveIndirectCount(IBuffer *argumentBuffer, Uint32 argumentOffset, IBuffer *countBuffer, Uint32 countOffset, Uint32 maxDrawCount, Uint32 stride)
+{
+	// A GPU written count cannot be emulated on the CPU, and records past it may be stale (compacted
+	// by a culling pass), so drawing maxDrawCount of them is no fallback either
+	assert(deviceData.enabledFeatures.drawIndirectCount);
+	if(!deviceData.enabledFeatures.drawIndirectCount)
+	{
+		return this;
+	}
+	pGfxPending->PrepareDraw();
+	BufferVk* vkArgumentBuffer = CastVk<BufferVk>(argumentBuffer);
+	BufferVk* vkCountBuffer = CastVk<BufferVk>(countBuffer);
+	if(vkArgumentBuffer && vkCountBuffer)
+	{
+		currentVkCmd->Get().drawIndirectCount(vkArgumentBuffer->BufferHandle(), argumentOffset, 
+			vkCountBuffer->BufferHandle(), countOffset, maxDrawCount, stride);
 	}
 	return this;
 }
 
-IRHIHandle* VkHandle::Dispatch(Uint32 threadGroupCountX, Uint32 threadGroupCountY, Uint32 threadGroupCountZ)
+VkHandle* VkHandle::DrawIndexPrimitiveIndirectCount(IBuffer *indexBuffer, IBuffer *argumentBuffer, Uint32 argumentOffset, IBuffer *countBuffer, Uint32 countOffset, Uint32 maxDrawCount, Uint32 stride)
+{
+	assert(deviceData.enabledFeatures.drawIndirectCount);
+	if(!deviceData.enabledFeatures.drawIndirectCount)
+	{
+		return this;
+	}
+	if(!SetDrawIndexBuffer(indexBuffer))
+	{
+		return this;
+	}
+	pGfxPending->PrepareDraw();
+	BufferVk* vkArgumentBuffer = CastVk<BufferVk>(argumentBuffer);
+	BufferVk* vkCountBuffer = CastVk<BufferVk>(countBuffer);
+	if(vkArgumentBuffer && vkCountBuffer)
+	{
+		currentVkCmd->Get().drawIndexedIndirectCount(vkArgumentBuffer->BufferHandle(), argumentOffset, 
+			vkCountBuffer->BufferHandle(), countOffset, maxDrawCount, stride);
+	}
+	return this;
+}
+
+VkHandle* VkHandle::Dispatch(Uint32 threadGroupCountX, Uint32 threadGroupCountY, Uint32 threadGroupCountZ)
 {
 	pComputePending->PrepareDispatch();
+	if(gpuProfiler)
+	{
+		gpuProfiler->BeginScope(currentVkCmd->Get(), "Dispatch");
+	}
 	currentVkCmd->Get().dispatch(threadGroupCountX, threadGroupCountY, threadGroupCountZ);
+	if(gpuProfiler)
+	{
+		gpuProfiler->EndScope(currentVkCmd->Get());
+	}
+	return this;
+}
+
+VkHandle* VkHandle::FillBuffer(IBuffer* buffer, Uint32 offset, Uint32 size, Uint32 value)
+{
+	BufferVk* vkBuffer = CastVk<BufferVk>(buffer);
+	if(vkBuffer)
+	{
+		assert(offset % 4 == 0 && size % 4 == 0 && offset + size <= vkBuffer->GetSize());
+		currentVkCmd->Get().fillBuffer(vkBuffer->BufferHandle(), offset, size, value);
+	}
+	return this;
+}
+
+VkHandle* VkHandle::SetBufferBarrier(IBuffer* buffer, BufferAccess srcAccess, BufferAccess dstAccess)
+{
+	BufferVk* vkBuffer = CastVk<BufferVk>(buffer);
+	if(vkBuffer)
+	{
+		auto barrier = vk::BufferMemoryBarrier()
+			.setSrcAccessMask(ConvertBufferAccessFlags(srcAccess))
+			.setDstAccessMask(ConvertBufferAccessFlags(dstAccess))
+			.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setBuffer(vkBuffer->BufferHandle())
+			.setOffset(0)
+			.setSize(VK_WHOLE_SIZE);
+		currentVkCmd->Get().pipelineBarrier(ConvertBufferAccessStage(srcAccess), ConvertBufferAccessStage(dstAccess), 
+			vk::DependencyFlags(), nullptr, barrier, nullptr);
+	}
+	return this;
+}
+
+IGraphicsPipeline* VkHandle::CreateDrawPipeline(const GfxSetting& gfxSetting, IBindingGroup* layoutGroup)
+{
+	BindingGroupVk* vkGroup = CastVk<BindingGroupVk>(layoutGroup);
+	PipelineLayoutVk* pipelineLayout = pGfxPending->GetPipelineLayout(deviceData, 
+		vkGroup ? vkGroup->GetDescriptorSetLayout() : nullptr, DrawItemPushConstantRange());
+	// Draw pipelines are created ahead of their draws, so they compile on the workers meanwhile
+	return renderResManager->GetGfxPipeline(gfxSetting, pipelineLayout, jobSystem.get());
+}
+
+VkHandle* VkHandle::SubmitDraws(std::span<const DrawItem> drawItems)
+{
+	bCurrentGfx = true;
+	pGfxPending->SubmitDraws(drawItems);
+	return this;
+}
+
+Uint32 VkHandle::GetBindlessIndex(ITexture* texture)
+{
+	TextureVk* vkTexture = CastVk<TextureVk>(texture);
+	if(bindlessHeap && vkTexture)
+	{
+		return bindlessHeap->GetIndex(vkTexture);
+	}
+	return InvalidBindlessIndex;
+}
+
+Uint32 VkHandle::GetBindlessIndex(IBuffer* buffer)
+{
+	BufferVk* vkBuffer = CastVk<BufferVk>(buffer);
+	if(bindlessHeap && vkBuffer)
+	{
+		return bindlessHeap->GetIndex(vkBuffer);
+	}
+	return InvalidBindlessIndex;
+}
+
+VkHandle* VkHandle::SetBindlessHeap(Uint setId)
+{
+	if(bindlessHeap)
+	{
+		pGfxPending->SetBindlessHeap(bindlessHeap.get(), setId);
+		pComputePending->SetBindlessHeap(bindlessHeap.get(), setId);
+	}
+	return this;
+}
+
+VkHandle* VkHandle::SetPushDescriptorSet(Uint setId)
+{
+	if(deviceData.enabledFeatures.pushDescriptor)
+	{
+		pGfxPending->SetPushDescriptorSet(setId);
+		pComputePending->SetPushDescriptorSet(setId);
+	}
 	return this;
 }
 
-IRHIHandle* VkHandle::UpdateBuffer(IBuffer *buffer, void *data, Uint32 dataSize, Uint32 offset)
+VkHandle* VkHandle::UpdateBuffer(IBuffer *buffer, void *data, Uint32 dataSize, Uint32 offset)
 {
-	BufferVk* vkBuffer = dynamic_cast<BufferVk*>(buffer);
+	BufferVk* vkBuffer = CastVk<BufferVk>(buffer);
 	if(vkBuffer)
 	{
 		vkBuffer->UpdateBufferData(data, dataSize, offset);
@@ -706,9 +1943,9 @@ IRHIHandle* VkHandle::UpdateBuffer(IBuffer *buffer, void *data, Uint32 dataSize,
 	return this;
 }
 
-IRHIHandle* VkHandle::UpdateImageView(IImageView *imageView, void *data, Uint32 dataSize)
+VkHandle* VkHandle::UpdateImageView(IImageView *imageView, void *data, Uint32 dataSize)
 {
-	ImageViewVk* vkImageView = dynamic_cast<ImageViewVk*>(imageView);
+	ImageViewVk* vkImageView = CastVk<ImageViewVk>(imageView);
 	if(vkImageView)
 	{
 		vkImageView->SetImageData(data, dataSize);
@@ -716,10 +1953,10 @@ IRHIHandle* VkHandle::UpdateImageView(IImageView *imageView, void *data, Uint32
 	return this;
 }
 
-IRHIHandle* VkHandle::CopyBuffer(IBuffer *srcBuffer, IBuffer *dstBuffer)
+VkHandle* VkHandle::CopyBuffer(IBuffer *srcBuffer, IBuffer *dstBuffer)
 {
-	BufferVk* vkSrcBuffer = dynamic_cast<BufferVk*>(srcBuffer);
-	BufferVk* vkDstBuffer = dynamic_cast<BufferVk*>(dstBuffer);
+	BufferVk* vkSrcBuffer = CastVk<BufferVk>(srcBuffer);
+	BufferVk* vkDstBuffer = CastVk<BufferVk>(dstBuffer);
 	if(vkSrcBuffer && vkDstBuffer && vkDstBuffer->GetSize() >= vkSrcBuffer->GetSize())
 	{
 		vk::BufferCopy region = vk::BufferCopy()
@@ -733,10 +1970,10 @@ IRHIHandle* VkHandle::CopyBuffer(IBuffer *srcBuffer, IBuffer *dstBuffer)
 	return this;
 }
 
-IRHIHandle* VkHandle::CopyBufferToImage(IBuffer *srcBuffer, IImageView *dstImageView)
+VkHandle* VkHandle::CopyBufferToImage(IBuffer *srcBuffer, IImageView *dstImageView)
 {
-	BufferVk* vkSrcBuffer = dynamic_cast<BufferVk*>(srcBuffer);
-	ImageViewVk* vkDstImageView = dynamic_cast<ImageViewVk*>(dstImageView);
+	BufferVk* vkSrcBuffer = CastVk<BufferVk>(srcBuffer);
+	ImageViewVk* vkDstImageView = CastVk<ImageViewVk>(dstImageView);
 	if(vkSrcBuffer && vkDstImageView && vkDstImageView->GetSize() >= vkSrcBuffer->GetSize())
 	{
 		const auto& imageDesc = vkDstImageView->DescHandle();
@@ -754,14 +1991,15 @@ IRHIHandle* VkHandle::CopyBufferToImage(IBuffer *srcBuffer, IImageView *dstImage
         EndSingleTimeCommands(deviceData, cmdBuffer);
 
         TransitionImageLayout(deviceData, vkDstImageView->ImageHandle(), imageDesc, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+        vkDstImageView->CurrentLayout() = vk::ImageLayout::eShaderReadOnlyOptimal;
 	}
 	return this;
 }
 
-IRHIHandle* VkHandle::CopyImageToBuffer(IImageView *srcImageView, IBuffer *dstBuffer)
+VkHandle* VkHandle::CopyImageToBuffer(IImageView *srcImageView, IBuffer *dstBuffer)
 {
-	ImageViewVk* vkSrcImageView = dynamic_cast<ImageViewVk*>(srcImageView);
-	BufferVk* vkDstBuffer = dynamic_cast<BufferVk*>(dstBuffer);
+	ImageViewVk* vkSrcImageView = CastVk<ImageViewVk>(srcImageView);
+	BufferVk* vkDstBuffer = CastVk<BufferVk>(dstBuffer);
 	if(vkSrcImageView && vkDstBuffer && vkDstBuffer->GetSize() >= vkSrcImageView->GetSize())
 	{
 		const auto& imageDesc = vkSrcImageView->DescHandle();
@@ -779,14 +2017,15 @@ IRHIHandle* VkHandle::CopyImageToBuffer(IImageView *srcImageView, IBuffer *dstBu
         EndSingleTimeCommands(deviceData, cmdBuffer);
 
         TransitionImageLayout(deviceData, vkSrcImageView->ImageHandle(), imageDesc, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+        vkSrcImageView->CurrentLayout() = vk::ImageLayout::eShaderReadOnlyOptimal;
 	}
 	return this;
 }
 
-IRHIHandle* VkHandle::CopyImageToImage(IImageView *srcImageView, IImageView *dstImageView)
+VkHandle* VkHandle::CopyImageToImage(IImageView *srcImageView, IImageView *dstImageView)
 {
-	ImageViewVk* vkSrcImageView = dynamic_cast<ImageViewVk*>(srcImageView);
-	ImageViewVk* vkDstImageView = dynamic_cast<ImageViewVk*>(dstImageView);
+	ImageViewVk* vkSrcImageView = CastVk<ImageViewVk>(srcImageView);
+	ImageViewVk* vkDstImageView = CastVk<ImageViewVk>(dstImageView);
 	if(vkSrcImageView && vkDstImageView && vkDstImageView->GetSize() >= vkSrcImageView->GetSize())
 	{
 		const auto& srcImageDesc = vkSrcImageView->DescHandle();
@@ -813,6 +2052,8 @@ IRHIHandle* VkHandle::CopyImageToImage(IImageView *srcImageView, IImageView *dst
 
         TransitionImageLayout(deviceData, vkSrcImageView->ImageHandle(), srcImageDesc, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
 		TransitionImageLayout(deviceData, vkDstImageView->ImageHandle(), dstImageDesc, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+		vkSrcImageView->CurrentLayout() = vk::ImageLayout::eShaderReadOnlyOptimal;
+		vkDstImageView->CurrentLayout() = vk::ImageLayout::eShaderReadOnlyOptimal;
 	}
 	return this;
 }
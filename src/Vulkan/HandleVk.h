@@ -4,20 +4,47 @@
 #include "IRHIHandle.h"
 #include "HeaderVk.h"
 #include "CommandPoolVk.h"
+#include <array>
 #include <memory>
+#include <deque>
 #include "PendingStateVk.h"
 #include "RenderResourceVkManager.h"
+#include "BindlessHeapVk.h"
+#include "ResourcePoolVk.h"
+#include "UploadContextVk.h"
+#include "ReadbackRingVk.h"
+#include "GpuProfilerVk.h"
+#include "QueryPoolVk.h"
 
 class GLFWwindow;
 
 namespace TinyRHI
 {
-    class VkHandle : public IRHIHandle
+    // Bytes one job copies when Upload fills a staging buffer
+    #define UploadCopyBatchSize (256 << 10)
+
+    // Final, and every chained call returns VkHandle*: code holding a VkHandle* (see RHIBackend.h)
+    // calls it without virtual dispatch
+    class VkHandle final : public IRHIHandle
     {
     public:
-        explicit VkHandle(GLFWwindow* _window);
+        explicit VkHandle(GLFWwindow* _window, const HandleDesc& _handleDesc = HandleDesc());
         ~VkHandle()
 		{
+			// Jobs may still be creating resources
+			jobSystem.reset();
+			// Flushes the last submits and presents
+			submitThread.reset();
+			deviceData.logicalDevice.waitIdle();
+			bufferPool.Clear();
+			texturePool.Clear();
+			shaderPool.Clear();
+			deviceData.bindlessHeap = nullptr;
+			submitRecords.clear();
+			readbackRing.reset();
+			gpuProfiler.reset();
+			queryPools.reset();
+			uploadContexts.reset();
 			deviceData.logicalDevice.destroy();
 		}
         VkHandle(const VkHandle&) = delete;
@@ -29,13 +56,36 @@ namespace TinyRHI
 		void InitSurface();
 		void InitDevice();
 		void InitSwapChain();
-		void RecreateSwapChain();
+		// Waits for the device to go idle and rebuilds the swapchain, false while the window has no extent.
+		// Called by the submission thread when there is one
+		Bool RecreateSwapChain();
+		// Recording thread without a submission thread, waits for window events until the window is visible
+		void RecreateSwapChainWhenVisible();
+		// Submission thread mode: what SetDefaultAttachments renders into, one per frame slot
+		void InitBackBuffers();
 		void InitSync();
+		// False when no index stream is set, the draw is dropped
+		Bool SetDrawIndexBuffer(IBuffer* indexBuffer);
+		// memcpy into mapped staging memory, large copies run on the job system
+		void CopyUploadData(void* dst, const void* src, Uint32 size);
+		GpuSyncPoint RecordSubmit(CommandBufferVk* cmdBuffer);
+		// Retires finished submissions, frees their staging memory and resumes their waiters
+		void PollSubmits();
 		void InitPendingState()
 		{
-			pGfxPending = std::make_unique<GfxPendingStateVk>(deviceData);
-			pComputePending = std::make_unique<ComputePendingStateVk>(deviceData);
+			if(deviceData.enabledFeatures.descriptorBuffer)
+			{
+				// One command binds a single descriptor buffer for both bind points
+				descriptorBuffer = std::make_unique<DescriptorBufferVk>(deviceData);
+			}
+			pGfxPending = std::make_unique<GfxPendingStateVk>(deviceData, descriptorBuffer.get());
+			pComputePending = std::make_unique<ComputePendingStateVk>(deviceData, descriptorBuffer.get());
 			renderResManager = std::make_unique<RenderResourceVkManager>(deviceData);
+			if(deviceData.enabledFeatures.bindless)
+			{
+				bindlessHeap = std::make_unique<BindlessHeapVk>(deviceData);
+				deviceData.bindlessHeap = bindlessHeap.get();
+			}
 		}
 
 #ifdef DEBUG_VULKAN_MACRO
@@ -60,62 +110,122 @@ namespace TinyRHI
 		virtual ITexture* CreateTextureWithoutSampling(const ImageDesc& imageDesc);
 		virtual ITexture* CreateTexture(const ImageDesc& imageDesc, const SamplerState& samplerState);
 		virtual ITexture* CreateTextureWithData(const ImageDesc& imageDesc, const SamplerState& samplerState, void* data, Uint32 dataSize);
+		virtual IBindingGroup* CreateBindingGroup(const BindingGroupDesc& bindingGroupDesc);
+
+		virtual BufferId CreateBufferId(const BufferDesc& bufferDesc, void* data, Uint32 dataSize);
+		virtual TextureId CreateTextureId(const ImageDesc& imageDesc, const SamplerState* samplerState, void* data, Uint32 dataSize);
+		virtual ShaderId CreateShaderId(IShader::Stage stage, const ShaderDesc& shaderDesc);
+		virtual IBuffer* GetBuffer(BufferId buffer);
+		virtual ITexture* GetTexture(TextureId texture);
+		virtual IShader* GetShader(ShaderId shader);
+		virtual void DestroyBuffer(BufferId buffer);
+		virtual void DestroyTexture(TextureId texture);
+		virtual void DestroyShader(ShaderId shader);
 
 		virtual Uint32 GetTotalVRAM() const;
 		virtual Uint32 GetUsedVRAM() const;
+
+		virtual RHIStats GetStats() const;
+		virtual JobSystem* GetJobSystem()
+		{
+			return jobSystem.get();
+		}
     
         // 
         // ------------------------------------------------------------------------------------------------
 
-		virtual IRHIHandle* BeginFrame();
-		virtual IRHIHandle* EndFrame();
-
-		virtual IRHIHandle* BeginCommand();
-		virtual IRHIHandle* EndCommand();
-		virtual IRHIHandle* Commit();
-
-		virtual IRHIHandle* BeginRenderPass();
-		virtual IRHIHandle* EndRenderPass();
-
-		virtual IRHIHandle* SetGraphicsPipeline(const GfxSetting& gfxSetting);
-		virtual IRHIHandle* SetComputePipeline();
-
-		virtual IRHIHandle* SetTransition(ITransition* trans) {return this;};
-
-		virtual IRHIHandle* SetDefaultAttachments(const AttachmentDesc &attachmentDesc);
-		virtual IRHIHandle* SetColorAttachments(ITexture* texture, const AttachmentDesc& attachmentDesc);
-		virtual IRHIHandle* SetDepthAttachment(ITexture* texture, const AttachmentDesc& attachmentDesc);
-
-		virtual IRHIHandle* SetVertexShader(IShader* shader);
-		virtual IRHIHandle* SetPixelShader(IShader* shader);
-		virtual IRHIHandle* SetComputeShader(IShader* shader);
-
-		virtual IRHIHandle* SetVertexStream(Uint32 vertId, IBuffer* buffer, Uint32 offset);
-		virtual IRHIHandle* SetViewport(Extent2D minExt, Extent2D maxExt);
-		virtual IRHIHandle* SetViewport(Extent3D minExt, Extent3D maxExt);
-		virtual IRHIHandle* SetScissor(Extent2D minExt, Extent2D maxExt);
-
-		virtual IRHIHandle* SetSamplerTexture(ITexture* texture, IShader::Stage stage, Uint setId, Uint bindingId);
-		virtual IRHIHandle* SetStorageTexture(ITexture* texture, IShader::Stage stage, Uint setId, Uint bindingId);
-		virtual IRHIHandle* SetStorageBuffer(IBuffer* buffer, IShader::Stage stage, Uint setId, Uint bindingId);
-		virtual IRHIHandle* SetUniformBuffer(IBuffer* Buffer, IShader::Stage stage, Uint setId, Uint bindingId);
-
-        virtual IRHIHandle* DrawPrimitive(Uint32 vertexCount, Uint32 firstVertex);
-		virtual IRHIHandle* DrawPrimitiveIndirect(IBuffer* argumentBuffer, Uint32 argumentOffset);
-		virtual IRHIHandle* DrawIndexPrimitive(IBuffer *indexBuffer, Uint32 indexCount, Uint32 firstIndex, Int32 vertOffset);
-		virtual IRHIHandle* Dispatch(Uint32 threadGroupCountX, Uint32 threadGroupCountY, Uint32 threadGroupCountZ);
-
-		virtual IRHIHandle* UpdateBuffer(IBuffer* buffer, void* data, Uint32 dataSize, Uint32 offset);
-		virtual IRHIHandle* UpdateImageView(IImageView* imageView, void* data, Uint32 dataSize);
-        virtual IRHIHandle* CopyBuffer(IBuffer* srcBuffer, IBuffer* dstBuffer);
-		virtual IRHIHandle* CopyBufferToImage(IBuffer* srcBuffer, IImageView* dstImageView);
-		virtual IRHIHandle* CopyImageToBuffer(IImageView* srcImageView, IBuffer* dstBuffer);
-		virtual IRHIHandle* CopyImageToImage(IImageView* srcImageView, IImageView* dstImageView);
+		virtual VkHandle* BeginFrame();
+		virtual VkHandle* EndFrame();
+
+		virtual VkHandle* BeginCommand();
+		virtual VkHandle* EndCommand();
+		virtual VkHandle* Commit();
+		virtual GpuSyncPoint LastSubmit();
+		virtual Bool IsComplete(GpuSyncPoint syncPoint);
+		virtual void WhenComplete(GpuSyncPoint syncPoint, std::coroutine_handle<> waiter);
+		virtual GpuSyncPoint Upload(IBuffer* buffer, const void* data, Uint32 dataSize, Uint32 offset);
+		virtual ReadbackTicket RequestReadback(IBuffer* buffer, Uint32 offset, Uint32 size);
+		virtual ReadbackTicket RequestReadback(ITexture* texture, const TextureRegion& region);
+		virtual GpuSyncPoint GetReadbackSyncPoint(ReadbackTicket ticket);
+		virtual std::span<const std::byte> GetReadbackData(ReadbackTicket ticket);
+		virtual void ReleaseReadback(ReadbackTicket ticket);
+		virtual VkHandle* BeginGpuScope(const char* name);
+		virtual VkHandle* EndGpuScope();
+		virtual std::vector<GpuScopeStats> GetGpuScopeStats();
+		virtual Bool ExportTrace(const char* filePath);
+		virtual VkHandle* BeginQuery(QueryType type, Uint32 index);
+		virtual VkHandle* EndQuery(QueryType type, Uint32 index);
+		virtual VkHandle* ResolveQueries(QueryType type, Uint32 firstIndex, Uint32 count, IBuffer* buffer, Uint32 offset);
+		virtual VkHandle* BeginConditional(IBuffer* buffer, Uint32 offset);
+		virtual VkHandle* EndConditional();
+
+		virtual VkHandle* BeginRenderPass();
+		virtual VkHandle* EndRenderPass();
+
+		virtual VkHandle* SetGraphicsPipeline(const GfxSetting& gfxSetting);
+		virtual VkHandle* SetComputePipeline();
+
+		virtual VkHandle* SetTransition(ITransition* trans) {return this;};
+
+		virtual VkHandle* SetDefaultAttachments(const AttachmentDesc &attachmentDesc);
+		virtual VkHandle* SetColorAttachments(ITexture* texture, const AttachmentDesc& attachmentDesc);
+		virtual VkHandle* SetDepthAttachment(ITexture* texture, const AttachmentDesc& attachmentDesc);
+
+		virtual VkHandle* SetVertexShader(IShader* shader);
+		virtual VkHandle* SetPixelShader(IShader* shader);
+		virtual VkHandle* SetComputeShader(IShader* shader);
+
+		virtual VkHandle* SetVertexStream(Uint32 vertId, IBuffer* buffer, Uint32 offset);
+		virtual VkHandle* SetIndexStream(IBuffer* buffer, Uint32 offset, IndexType indexType);
+		virtual VkHandle* SetVertexStream(Uint32 vertId, BufferId buffer, Uint32 offset);
+		virtual VkHandle* SetIndexStream(BufferId buffer, Uint32 offset, IndexType indexType);
+		virtual VkHandle* SetViewport(Extent2D minExt, Extent2D maxExt);
+		virtual VkHandle* SetViewport(Extent3D minExt, Extent3D maxExt);
+		virtual VkHandle* SetScissor(Extent2D minExt, Extent2D maxExt);
+
+		virtual VkHandle* SetSamplerTexture(ITexture* texture, IShader::Stage stage, Uint setId, Uint bindingId);
+		virtual VkHandle* SetStorageTexture(ITexture* texture, IShader::Stage stage, Uint setId, Uint bindingId);
+		virtual VkHandle* SetStorageBuffer(IBuffer* buffer, IShader::Stage stage, Uint setId, Uint bindingId);
+		virtual VkHandle* SetUniformBuffer(IBuffer* Buffer, IShader::Stage stage, Uint setId, Uint bindingId);
+		virtual VkHandle* SetSamplerTexture(TextureId texture, IShader::Stage stage, Uint setId, Uint bindingId);
+		virtual VkHandle* SetStorageBuffer(BufferId buffer, IShader::Stage stage, Uint setId, Uint bindingId);
+		virtual VkHandle* SetUniformBuffer(BufferId buffer, IShader::Stage stage, Uint setId, Uint bindingId);
+		virtual VkHandle* SetStorageBuffer(IBuffer* buffer, IShader::Stage stage, Uint setId, Uint bindingId, Uint32 offset, Uint32 range);
+		virtual VkHandle* SetUniformBuffer(IBuffer* Buffer, IShader::Stage stage, Uint setId, Uint bindingId, Uint32 offset, Uint32 range);
+		virtual VkHandle* SetPushConstants(IShader::Stage stage, const void* data, Uint32 size, Uint32 offset);
+
+        virtual VkHandle* DrawPrimitive(Uint32 vertexCount, Uint32 firstVertex);
+		virtual VkHandle* DrawPrimitiveIndirect(IBuffer* argumentBuffer, Uint32 argumentOffset);
+		virtual VkHandle* DrawIndexPrimitive(IBuffer *indexBuffer, Uint32 indexCount, Uint32 firstIndex, Int32 vertOffset);
+		virtual VkHandle* DrawPrimitiveInstanced(Uint32 vertexCount, Uint32 instanceCount, Uint32 firstVertex, Uint32 firstInstance);
+		virtual VkHandle* DrawIndexPrimitiveInstanced(IBuffer *indexBuffer, Uint32 indexCount, Uint32 instanceCount, Uint32 firstIndex, Int32 vertOffset, Uint32 firstInstance);
+		virtual VkHandle* DrawPrimitiveIndirect(IBuffer* argumentBuffer, Uint32 argumentOffset, Uint32 drawCount, Uint32 stride);
+		virtual VkHandle* DrawIndexPrimitiveIndirect(IBuffer *indexBuffer, IBuffer* argumentBuffer, Uint32 argumentOffset, Uint32 drawCount, Uint32 stride);
+		virtual VkHandle* DrawPrimitiveIndirectCount(IBuffer* argumentBuffer, Uint32 argumentOffset, IBuffer* countBuffer, Uint32 countOffset, Uint32 maxDrawCount, Uint32 stride);
+		virtual VkHandle* DrawIndexPrimitiveIndirectCount(IBuffer *indexBuffer, IBuffer* argumentBuffer, Uint32 argumentOffset, IBuffer* countBuffer, Uint32 countOffset, Uint32 maxDrawCount, Uint32 stride);
+		virtual VkHandle* Dispatch(Uint32 threadGroupCountX, Uint32 threadGroupCountY, Uint32 threadGroupCountZ);
+		virtual IGraphicsPipeline* CreateDrawPipeline(const GfxSetting& gfxSetting, IBindingGroup* layoutGroup);
+		virtual VkHandle* SubmitDraws(std::span<const DrawItem> drawItems);
+		virtual VkHandle* FillBuffer(IBuffer* buffer, Uint32 offset, Uint32 size, Uint32 value);
+		virtual VkHandle* SetBufferBarrier(IBuffer* buffer, BufferAccess srcAccess, BufferAccess dstAccess);
+
+		virtual Uint32 GetBindlessIndex(ITexture* texture);
+		virtual Uint32 GetBindlessIndex(IBuffer* buffer);
+		virtual VkHandle* SetBindlessHeap(Uint setId);
+		virtual VkHandle* SetPushDescriptorSet(Uint setId);
+
+		virtual VkHandle* UpdateBuffer(IBuffer* buffer, void* data, Uint32 dataSize, Uint32 offset);
+		virtual VkHandle* UpdateImageView(IImageView* imageView, void* data, Uint32 dataSize);
+        virtual VkHandle* CopyBuffer(IBuffer* srcBuffer, IBuffer* dstBuffer);
+		virtual VkHandle* CopyBufferToImage(IBuffer* srcBuffer, IImageView* dstImageView);
+		virtual VkHandle* CopyImageToBuffer(IImageView* srcImageView, IBuffer* dstBuffer);
+		virtual VkHandle* CopyImageToImage(IImageView* srcImageView, IImageView* dstImageView);
 
 
 
     private:
 		GLFWwindow* window;
+		HandleDesc handleDesc;
 
 		vk::UniqueInstance instance;
 
@@ -132,21 +242,77 @@ namespace TinyRHI
 		vk::Extent2D swapChainExtent;
 		std::vector<std::unique_ptr<ImageViewVk>> swapImageViews;
 		Uint32 swapImageIndex;
+		// Set by an out of date or suboptimal acquire or present, the next acquire recreates the swapchain
+		Bool bSwapChainOutOfDate = false;
+		// Submission thread mode only, swapChain belongs to that thread then
+		std::array<std::unique_ptr<ImageViewVk>, MaxFrameInFlight> backBuffers;
+		Bool bBackBufferRendered = false;
 
 		std::vector<vk::UniqueSemaphore> swapImageAvailableSemaphores;
 		std::vector<vk::UniqueSemaphore> renderFinishedSemaphores;
 		std::vector<vk::UniqueFence> inFlightFences;
-		Uint currentFrame;
+		// Read by Destroy* from other threads
+		std::atomic<Uint> currentFrame;
 
+		std::unique_ptr<JobSystem> jobSystem;
+		std::unique_ptr<UploadContextsVk> uploadContexts;
 		std::unique_ptr<CommandPoolManager> cmdPoolManager;
+		std::unique_ptr<SubmitThreadVk> submitThread;
+
+		struct SubmitRecordVk
+		{
+			Uint64 value;
+			CommandBufferVk* cmdBuffer;
+			Uint64 serial;
+			// Source of an Upload, released with the record
+			std::unique_ptr<BufferVk> stagingBuffer;
+		};
+		// Unfinished submissions in submit order
+		std::deque<SubmitRecordVk> submitRecords;
+		Uint64 lastSubmitValue = 0;
+		std::vector<std::pair<Uint64, std::coroutine_handle<>>> submitWaiters;
+
+		struct ReadbackRecordVk
+		{
+			ReadbackRingVk::Allocation allocation;
+			// 0 until the recording command is committed
+			Uint64 submitValue = 0;
+			Uint16 generation = 0;
+			Bool bLive = false;
+			// Released while its copy was in flight, the ticket is dead and PollSubmits frees it later
+			Bool bReleased = false;
+		};
+		std::unique_ptr<ReadbackRingVk> readbackRing;
+		std::vector<ReadbackRecordVk> readbackRecords;
+		std::vector<Uint32> freeReadbackRecords;
+		// Recorded into the current command, stamped by Commit
+		std::vector<Uint32> uncommittedReadbacks;
+		std::vector<Uint32> releasedReadbacks;
+		ReadbackTicket AddReadbackRecord(const ReadbackRingVk::Allocation& allocation);
+		ReadbackRecordVk* FindReadbackRecord(ReadbackTicket ticket);
+		Bool IsReadbackComplete(const ReadbackRecordVk& record);
+		void FreeReadbackRecord(Uint32 recordIndex);
+
+		std::unique_ptr<GpuProfilerVk> gpuProfiler;
+		std::unique_ptr<QueryPoolsVk> queryPools;
 
 		CommandBufferVk* currentVkCmd;
+		Bool bInRenderPass = false;
+		// Conditional rendering is active in currentVkCmd, and it was begun inside the current render pass
+		Bool bConditional = false;
+		Bool bConditionalInRenderPass = false;
 
 		Bool bCurrentGfx;
+		std::unique_ptr<DescriptorBufferVk> descriptorBuffer;
 		std::unique_ptr<GfxPendingStateVk> pGfxPending;
 		std::unique_ptr<ComputePendingStateVk> pComputePending;
 
 		std::unique_ptr<RenderResourceVkManager> renderResManager;
+		std::unique_ptr<BindlessHeapVk> bindlessHeap;
+
+		BufferPoolVk bufferPool;
+		TexturePoolVk texturePool;
+		ShaderPoolVk shaderPool;
     };
 
 
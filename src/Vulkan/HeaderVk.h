@@ -10,36 +10,31 @@
 #include "IRenderPass.h"
 #include "ISampler.h"
 #include "IShader.h"
+#include "CpuProfiler.h"
 
 namespace TinyRHI
 {
-	inline vk::CommandBuffer BeginSingleTimeCommands(const DeviceData& deviceData)
+	inline void HashCombine(Uint64& seed, Uint64 value)
 	{
-		auto cmdBufferAllocInfo = vk::CommandBufferAllocateInfo()
-			.setLevel(vk::CommandBufferLevel::ePrimary)	// ��Ҫ�������������ֱ���ύ����
-			.setCommandPool(deviceData.commandPool)
-			.setCommandBufferCount(1);
-		vk::CommandBuffer cmdBuffer = (deviceData.logicalDevice.allocateCommandBuffers(cmdBufferAllocInfo))[0];
-
-		auto beginInfo = vk::CommandBufferBeginInfo()
-			.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);	// ��һ���ύʹ��
-		cmdBuffer.begin(beginInfo);
-
-		return cmdBuffer;
-	};
+		seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+	}
 
-	inline void EndSingleTimeCommands(const DeviceData& deviceData, vk::CommandBuffer cmdBuffer)
+	// Interface -> backend object. Only one backend is compiled in, so the RTTI check only catches
+	// foreign objects; RHI_STATIC_BACKEND trusts the caller and drops it
+	template<typename VkType, typename IType>
+	inline VkType* CastVk(IType* object)
 	{
-		cmdBuffer.end();
-
-		auto submitInfo = vk::SubmitInfo()
-			.setCommandBufferCount(1)
-			.setPCommandBuffers(&cmdBuffer);
-		deviceData.graphicsQueue.submit({ submitInfo });
-		deviceData.graphicsQueue.waitIdle();
+#ifdef RHI_STATIC_BACKEND
+		return static_cast<VkType*>(object);
+#else
+		return dynamic_cast<VkType*>(object);
+#endif
+	}
 
-		deviceData.logicalDevice.freeCommandBuffers(deviceData.commandPool, { cmdBuffer });
-	};
+	// One-off upload on the calling thread's command pool, blocks until the GPU is done. Thread safe,
+	// see UploadContextVk.h
+	vk::CommandBuffer BeginSingleTimeCommands(const DeviceData& deviceData);
+	void EndSingleTimeCommands(const DeviceData& deviceData, vk::CommandBuffer cmdBuffer);
 
 	inline void TransitionImageLayout(const DeviceData& deviceData, vk::Image image, const ImageDesc& imageDesc, vk::ImageLayout oldLayout, vk::ImageLayout newLayout)
 	{
@@ -125,11 +120,82 @@ namespace TinyRHI
 		}
 		if(bufferType.bTransfer)
 		{
-			usage |= vk::BufferUsageFlagBits::eTransferSrc;
+			usage |= vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst;
 		}
 		return usage;
 	}
 
+	inline vk::IndexType ConvertIndexType(IndexType indexType)
+	{
+		switch (indexType)
+		{
+		case IndexType::Uint16:
+			return vk::IndexType::eUint16;
+		case IndexType::Uint32:
+			return vk::IndexType::eUint32;
+		case IndexType::Uint8:
+			return vk::IndexType::eUint8EXT;
+		}
+		return vk::IndexType::eUint16;
+	}
+
+	inline Uint32 IndexTypeSize(IndexType indexType)
+	{
+		switch (indexType)
+		{
+		case IndexType::Uint16:
+			return 2;
+		case IndexType::Uint32:
+			return 4;
+		case IndexType::Uint8:
+			return 1;
+		}
+		return 2;
+	}
+
+	inline vk::PipelineStageFlags ConvertBufferAccessStage(BufferAccess bufferAccess)
+	{
+		switch (bufferAccess)
+		{
+		case BufferAccess::TransferWrite:
+			return vk::PipelineStageFlagBits::eTransfer;
+		case BufferAccess::ComputeRead:
+		case BufferAccess::ComputeWrite:
+			return vk::PipelineStageFlagBits::eComputeShader;
+		case BufferAccess::IndirectArgument:
+			return vk::PipelineStageFlagBits::eDrawIndirect;
+		case BufferAccess::VertexInput:
+			return vk::PipelineStageFlagBits::eVertexInput;
+		case BufferAccess::GraphicsRead:
+			return vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader;
+		case BufferAccess::Predicate:
+			return vk::PipelineStageFlagBits::eConditionalRenderingEXT;
+		}
+		return vk::PipelineStageFlagBits::eAllCommands;
+	}
+
+	inline vk::AccessFlags ConvertBufferAccessFlags(BufferAccess bufferAccess)
+	{
+		switch (bufferAccess)
+		{
+		case BufferAccess::TransferWrite:
+			return vk::AccessFlagBits::eTransferWrite;
+		case BufferAccess::ComputeRead:
+			return vk::AccessFlagBits::eShaderRead;
+		case BufferAccess::ComputeWrite:
+			return vk::AccessFlagBits::eShaderWrite;
+		case BufferAccess::IndirectArgument:
+			return vk::AccessFlagBits::eIndirectCommandRead;
+		case BufferAccess::VertexInput:
+			return vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead;
+		case BufferAccess::GraphicsRead:
+			return vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eUniformRead;
+		case BufferAccess::Predicate:
+			return vk::AccessFlagBits::eConditionalRenderingReadEXT;
+		}
+		return vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite;
+	}
+
 	inline vk::Format ConvertAttribType(AttribType attribType)
 	{
 		switch (attribType)
@@ -418,7 +484,8 @@ namespace TinyRHI
 
 	inline vk::ImageUsageFlags ConvertImageUsage(ImageUsage imageUsage)
 	{
-		vk::ImageUsageFlags usage;
+		// Any image may be read back
+		vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eTransferSrc;
 		if(imageUsage.colorAttach)
 		{
 			usage |= vk::ImageUsageFlagBits::eColorAttachment;
@@ -438,6 +505,26 @@ namespace TinyRHI
 		return usage;
 	}
 
+	// Layout an image is left in between commands once written (ImageVk::CurrentLayout tracks the actual one):
+	// render passes end color attachments in ePresentSrcKHR and depth in eDepthStencilAttachmentOptimal,
+	// uploads end in eShaderReadOnlyOptimal
+	inline vk::ImageLayout RestingImageLayout(const ImageDesc& imageDesc)
+	{
+		if(imageDesc.usage.colorAttach)
+		{
+			return vk::ImageLayout::ePresentSrcKHR;
+		}
+		if(imageDesc.usage.depthAttach)
+		{
+			return vk::ImageLayout::eDepthStencilAttachmentOptimal;
+		}
+		if(imageDesc.usage.Storage)
+		{
+			return vk::ImageLayout::eGeneral;
+		}
+		return vk::ImageLayout::eShaderReadOnlyOptimal;
+	}
+
 	inline vk::ShaderStageFlags ConvertShaderStage(IShader::Stage stage)
 	{
 		switch (stage)
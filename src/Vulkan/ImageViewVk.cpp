@@ -1,6 +1,7 @@
 #ifdef RHI_SUPPORT_VULKAN
 
 #include "ImageViewVk.h"
+#include "BindlessHeapVk.h"
 
 using namespace TinyRHI;
 
@@ -92,6 +93,7 @@ void ImageVk::SetImageData(void *data, Uint32 dataSize)
         EndSingleTimeCommands(deviceData, cmdBuffer);
 
         TransitionImageLayout(deviceData, image.get(), imageDesc, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+        layout = vk::ImageLayout::eShaderReadOnlyOptimal;
     }
 }
 
@@ -141,4 +143,13 @@ ImageViewVk::ImageViewVk(const DeviceData &deviceData, ImageDesc imageDesc, vk::
     imageView = deviceData.logicalDevice.createImageViewUnique(imageViewInfo);
 }
 
+TextureVk::~TextureVk()
+{
+    // Deleted through the pointer API while frames in flight may still index the slot
+    if(deviceData.bindlessHeap)
+    {
+        deviceData.bindlessHeap->Retire(this);
+    }
+}
+
 #endif
@@ -40,9 +40,16 @@ namespace TinyRHI
 			return imageDesc;
 		}
 
+		// Layout left by the last recorded render pass or copy, eUndefined until the image is first written
+		auto& CurrentLayout()
+		{
+			return layout;
+		}
+
 	private:
 		const DeviceData& deviceData;
 		ImageDesc imageDesc;
+		vk::ImageLayout layout = vk::ImageLayout::eUndefined;
 
 		vk::UniqueImage image;
 		vk::UniqueDeviceMemory imageMemory;
@@ -87,6 +94,11 @@ namespace TinyRHI
 			return imagePtr->DescHandle();
 		}
 
+		auto& CurrentLayout()
+		{
+			return imagePtr->CurrentLayout();
+		}
+
 	private:
 		vk::UniqueImageView imageView;
 		std::unique_ptr<ImageVk> imagePtr;
@@ -98,21 +110,23 @@ namespace TinyRHI
 		TextureVk() = delete;
 
 		TextureVk(			
-			const DeviceData& deviceData,
+			const DeviceData& _deviceData,
 			const ImageDesc& imageDesc)
-			: imageView(std::make_unique<ImageViewVk>(deviceData, imageDesc))
+			: deviceData(_deviceData), imageView(std::make_unique<ImageViewVk>(_deviceData, imageDesc))
 		{
 		}
 
 		TextureVk(
-			const DeviceData& deviceData,
+			const DeviceData& _deviceData,
 			const ImageDesc& imageDesc,
 			const SamplerState& samplerState)
-			: imageView(std::make_unique<ImageViewVk>(deviceData, imageDesc)),
-			sampler(std::make_unique<SamplerVk>(deviceData.logicalDevice, samplerState))
+			: deviceData(_deviceData), imageView(std::make_unique<ImageViewVk>(_deviceData, imageDesc)),
+			sampler(std::make_unique<SamplerVk>(_deviceData.logicalDevice, samplerState))
 		{
 		}
 
+		~TextureVk();
+
 		void SetImageData(void* data, Uint32 dataSize)
 		{
 			return imageView->SetImageData(data, dataSize);
@@ -150,9 +164,22 @@ namespace TinyRHI
 			return sampler->SamplerHandle();
 		}
 
+		Bool HasSampler() const
+		{
+			return sampler != nullptr;
+		}
+
+		// Slot in BindlessHeapVk, assigned on first request
+		auto& BindlessIndex()
+		{
+			return bindlessIndex;
+		}
+
 	private:
+		const DeviceData& deviceData;
 		std::unique_ptr<ImageViewVk> imageView;
 		std::unique_ptr<SamplerVk> sampler;
+		Uint32 bindlessIndex = InvalidBindlessIndex;
 	};
 
 	// Ptr is managed by outside
@@ -8,58 +8,284 @@ using namespace TinyRHI;
 
 PipelineLayoutVk* PendingStateVk::GetPipelineLayout(const DeviceData& deviceData)
 {
-    Uint32 hashResult = 0;
-    std::vector<DescriptorSetLayoutVk> dsLayouts;
+    // Only hash binding signatures here: on a cache hit no Vulkan object is created
+    Uint32 hashResult = 17;
+    hashResult = hashResult * 31 + static_cast<Uint32>(pushConstantRange.stageFlags);
+    hashResult = hashResult * 31 + pushConstantRange.size;
+    // Sets up to the highest written or bindless one, a set nothing was written to in between gets an empty layout
+    Uint dsLayoutNum = 0;
+    for(Uint i = 0; i < MaxDescriptorSetCount; i++)
+    {
+        if(writerDirty[i] || IsBindlessSet(i))
+        {
+            dsLayoutNum = i + 1;
+        }
+    }
+    const DescriptorSetLayoutBindingDescArray* dsLayoutBindingArrs[MaxDescriptorSetCount] = {};
+    DescriptorSetLayoutVk::Usage dsLayoutUsages[MaxDescriptorSetCount] = {};
+
+    for(Uint i = 0; i < dsLayoutNum; i++)
+    {
+        if(IsBindlessSet(i))
+        {
+            // Resources of the bindless set come from the heap, not from Set* calls
+            assert(!writerDirty[i]);
+            hashResult = hashResult * 31 + bindlessHeap->GetDescriptorSetLayout()->Hash();
+            continue;
+        }
+        // An empty push descriptor set would push nothing, gaps are plain pooled sets
+        dsLayoutUsages[i] = writerDirty[i] ? GetSetUsage(i) : DescriptorSetLayoutVk::Usage::Pooled;
+        dsLayoutBindingArrs[i] = &dsWriter[i].GetDSLayoutBindingArray();
+        hashResult = hashResult * 31 + DescriptorSetLayoutVk::LayoutKey(*dsLayoutBindingArrs[i], dsLayoutUsages[i]);
+    }
 
-    auto hashDSLayout = [&](const DescriptorSetLayoutBindingDescArray& layoutBindings)
+    auto& pipelineLayout = pipelineLayoutCache[hashResult];
+    if(!pipelineLayout)
     {
-        Uint32 result = 0;
-        for(const auto& layoutBinding : layoutBindings)
+        std::vector<DescriptorSetLayoutVk*> dsLayouts;
+        for(Uint i = 0; i < dsLayoutNum; i++)
         {
-            result ^= std::hash<Uint32>{}(layoutBinding.binding);
-            result ^= std::hash<Uint32>{}(static_cast<Uint32>(layoutBinding.type));
-            result ^= std::hash<Uint32>{}(static_cast<Uint32>(layoutBinding.flag));
+            dsLayouts.push_back(IsBindlessSet(i) 
+                ? bindlessHeap->GetDescriptorSetLayout() 
+                : dsPool->GetDescriptorSetLayout(*dsLayoutBindingArrs[i], dsLayoutUsages[i]));
         }
-        return result;
-    };
+        pipelineLayout = std::make_unique<PipelineLayoutVk>(deviceData, dsLayouts, pushConstantRange);
+        pipelineLayoutCreateCount++;
+    }
+    return pipelineLayout.get();
+}
 
-    for(Uint i = 0; i < MaxDescriptorSetCount && writerDirty[i]; i++)
+PipelineLayoutVk* PendingStateVk::GetPipelineLayout(const DeviceData& deviceData, DescriptorSetLayoutVk* dsLayout, const vk::PushConstantRange& range)
+{
+    Uint32 hashResult = 17;
+    hashResult = hashResult * 31 + static_cast<Uint32>(range.stageFlags);
+    hashResult = hashResult * 31 + range.size;
+    if(dsLayout)
     {
-        auto dsLayoutBindingArr = dsWriter[i].GetDSLayoutBindingArray();
-        dsLayouts.push_back(DescriptorSetLayoutVk(deviceData, dsLayoutBindingArr));
-        hashResult ^= hashDSLayout(dsLayoutBindingArr) << i;
+        hashResult = hashResult * 31 + dsLayout->Hash();
     }
 
     auto& pipelineLayout = pipelineLayoutCache[hashResult];
     if(!pipelineLayout)
     {
-        pipelineLayout = std::make_unique<PipelineLayoutVk>(deviceData, dsLayouts);
+        std::vector<DescriptorSetLayoutVk*> dsLayouts;
+        if(dsLayout)
+        {
+            dsLayouts.push_back(dsLayout);
+        }
+        pipelineLayout = std::make_unique<PipelineLayoutVk>(deviceData, dsLayouts, range);
+        pipelineLayoutCreateCount++;
     }
     return pipelineLayout.get();
 }
 
-void GfxPendingStateVk::PrepareDraw()
+Uint64 PendingStateVk::DescriptorContentKey(DescriptorSetLayoutVk* dsLayout, Uint index) const
 {
-    UpdateDynamicStates();
+    Uint64 contentKey = dsWriter[index].ContentHash();
+    HashCombine(contentKey, dsLayout->Hash());
+    return contentKey;
+}
 
-    if(dsChanged)
+vk::DescriptorSet PendingStateVk::ResolveDescriptorSet(Uint index)
+{
+    DescriptorSetLayoutVk* dsLayout = currentPipelineLayout->DSLayoutHandle()[index];
+
+    // Same layout and same bound resources share one set, which is written only once per frame
+    Uint64 contentKey = DescriptorContentKey(dsLayout, index);
+
+    Bool bAllocated = false;
+    vk::DescriptorSet descriptorSet = dsPool->GetDescriptorSet(dsLayout, contentKey, dsWriter[index], bAllocated);
+    if(bAllocated)
     {
-        dsChanged = false;
-        // 1. write change to descriptorSet
-        for(Uint dsWriterIndex = 0; dsWriterIndex < MaxDescriptorSetCount; dsWriterIndex++)
+        dsWriter[index].Update(deviceData.logicalDevice, descriptorSet, dsLayout);
+    }
+    dsWriter[index].ClearDirty();
+    return descriptorSet;
+}
+
+vk::DeviceSize PendingStateVk::ResolveDescriptorOffset(Uint index)
+{
+    DescriptorSetLayoutVk* dsLayout = currentPipelineLayout->DSLayoutHandle()[index];
+    Uint64 contentKey = DescriptorContentKey(dsLayout, index);
+
+    Bool bAllocated = false;
+    vk::DeviceSize offset = descriptorBuffer->GetDescriptorOffset(dsLayout, contentKey, dsWriter[index], bAllocated);
+    if(bAllocated)
+    {
+        dsWriter[index].WriteDescriptors(deviceData, dsLayout, descriptorBuffer->MappedPtr(offset));
+    }
+    dsWriter[index].ClearDirty();
+    return offset;
+}
+
+void PendingStateVk::UpdateDescriptorSets(vk::PipelineBindPoint bindPoint, vk::PipelineLayout vkPipelineLayout)
+{
+    // A new layout (or command buffer) invalidates whatever was bound before
+    Bool bRebindAll = bLayoutChanged;
+
+    if(descriptorBuffer)
+    {
+        // Graphics and compute share the buffer, the other bind point may have moved it on to a new block
+        Uint32 block = descriptorBuffer->CurrentBlock();
+        Bool bResolveAll = bLayoutChanged || dsOffsetsBlock != block;
+        for(Uint dsIndex = 0; dsIndex < dsNum; dsIndex++)
         {
-            if(writerDirty[dsWriterIndex])
+            if(bResolveAll || dsWriter[dsIndex].Dirty())
             {
-				dsWriter[dsWriterIndex].BindDescriptor(*dsArray[dsWriterIndex]);
-				dsWriter[dsWriterIndex].Update(deviceData.logicalDevice);
+                dsOffsets[dsIndex] = ResolveDescriptorOffset(dsIndex);
             }
         }
+        if(descriptorBuffer->CurrentBlock() != block)
+        {
+            // The block filled up halfway, sets resolved before then live in the previous one
+            block = descriptorBuffer->CurrentBlock();
+            for(Uint dsIndex = 0; dsIndex < dsNum; dsIndex++)
+            {
+                dsOffsets[dsIndex] = ResolveDescriptorOffset(dsIndex);
+            }
+            if(descriptorBuffer->CurrentBlock() != block)
+            {
+                throw std::runtime_error("descriptor sets of one pipeline layout exceed a descriptor buffer block!");
+            }
+        }
+        dsOffsetsBlock = block;
+        bLayoutChanged = false;
+
+        // Binding another block drops the offsets of both bind points
+        descriptorBuffer->Bind(currentCmdBuffer);
+        if(dsOffsetsBindSerial != descriptorBuffer->BindSerial())
+        {
+            dsOffsetsBindSerial = descriptorBuffer->BindSerial();
+            bRebindAll = true;
+        }
 
-        // 2. bind descriptorSet
-        if(dsNum > 0)
+        // Every set lives in the single bound buffer
+        Uint32 bufferIndices[MaxDescriptorSetCount] = {};
+        if(dsNum > 0 && (bRebindAll || memcmp(dsOffsets, boundDsOffsets, dsNum * sizeof(vk::DeviceSize)) != 0))
         {
-            currentCmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, currentPipeline->GetLayout(), 0, dsNum, dsArray[0], 0, nullptr);
+            currentCmdBuffer.setDescriptorBufferOffsetsEXT(bindPoint, vkPipelineLayout, 0, dsNum, bufferIndices, dsOffsets, deviceData.dispatcher);
+            memcpy(boundDsOffsets, dsOffsets, dsNum * sizeof(vk::DeviceSize));
+            descriptorSetBinds.emitted += dsNum;
         }
+        else
+        {
+            descriptorSetBinds.skipped += dsNum;
+        }
+        return;
+    }
+
+    // 1. find the set matching the bound resources
+    for(Uint dsIndex = 0; dsIndex < dsNum; dsIndex++)
+    {
+        DescriptorSetLayoutVk* dsLayout = currentPipelineLayout->DSLayoutHandle()[dsIndex];
+        if(dsLayout->GetUsage() == DescriptorSetLayoutVk::Usage::Bindless)
+        {
+            dsArray[dsIndex] = bindlessHeap->DescriptorSetHandle();
+            continue;
+        }
+        if(bLayoutChanged || dsWriter[dsIndex].Dirty())
+        {
+            if(dsLayout->GetUsage() == DescriptorSetLayoutVk::Usage::PushDescriptor)
+            {
+                // Nothing is allocated or cached, the payload goes straight into the command buffer
+                dsWriter[dsIndex].Push(deviceData, currentCmdBuffer, currentPipelineLayout->PushTemplate(bindPoint), vkPipelineLayout, dsIndex);
+                dsWriter[dsIndex].ClearDirty();
+                descriptorSetBinds.emitted++;
+                continue;
+            }
+            dsArray[dsIndex] = ResolveDescriptorSet(dsIndex);
+        }
+    }
+    bLayoutChanged = false;
+
+    // 2. only sets (or dynamic offsets) the command buffer does not hold yet are bound
+    Bool bBindSet[MaxDescriptorSetCount] = {};
+    for(Uint dsIndex = 0; dsIndex < dsNum; dsIndex++)
+    {
+        if(currentPipelineLayout->DSLayoutHandle()[dsIndex]->GetUsage() == DescriptorSetLayoutVk::Usage::PushDescriptor)
+        {
+            continue;
+        }
+        Uint32 dynamicOffsets[MaxDescriptorBindingCount];
+        Uint32 dynamicOffsetCount = dsWriter[dsIndex].GetDynamicOffsets(dynamicOffsets);
+        bBindSet[dsIndex] = bRebindAll || dsArray[dsIndex] != boundDsArray[dsIndex]
+            || dynamicOffsetCount != boundDynamicOffsetCount[dsIndex]
+            || memcmp(dynamicOffsets, boundDynamicOffsets[dsIndex], dynamicOffsetCount * sizeof(Uint32)) != 0;
+        if(bBindSet[dsIndex])
+        {
+            boundDsArray[dsIndex] = dsArray[dsIndex];
+            boundDynamicOffsetCount[dsIndex] = dynamicOffsetCount;
+            memcpy(boundDynamicOffsets[dsIndex], dynamicOffsets, dynamicOffsetCount * sizeof(Uint32));
+        }
+        else
+        {
+            descriptorSetBinds.skipped++;
+        }
+    }
+
+    // Consecutive sets to bind share one call
+    Uint32 dynamicOffsets[MaxDescriptorSetCount * MaxDescriptorBindingCount];
+    Uint firstSet = 0;
+    for(Uint dsIndex = 0; dsIndex <= dsNum; dsIndex++)
+    {
+        if(dsIndex < dsNum && bBindSet[dsIndex])
+        {
+            continue;
+        }
+        if(dsIndex > firstSet)
+        {
+            Uint32 dynamicOffsetCount = 0;
+            for(Uint i = firstSet; i < dsIndex; i++)
+            {
+                memcpy(dynamicOffsets + dynamicOffsetCount, boundDynamicOffsets[i], boundDynamicOffsetCount[i] * sizeof(Uint32));
+                dynamicOffsetCount += boundDynamicOffsetCount[i];
+            }
+            currentCmdBuffer.bindDescriptorSets(bindPoint, vkPipelineLayout, firstSet, dsIndex - firstSet, dsArray + firstSet, dynamicOffsetCount, dynamicOffsets);
+            descriptorSetBinds.emitted += dsIndex - firstSet;
+        }
+        firstSet = dsIndex + 1;
+    }
+}
+
+void PendingStateVk::UpdatePushConstants()
+{
+    const vk::PushConstantRange& layoutRange = currentPipelineLayout->GetPushConstantRange();
+    // Stages set after the pipeline was chosen are not part of its layout
+    assert((pushConstantRange.stageFlags & layoutRange.stageFlags) == pushConstantRange.stageFlags);
+    assert(pushConstantRange.size <= layoutRange.size);
+    // Bytes nothing wrote are left alone instead of pushing stale or uninitialized data
+    Uint32 end = (std::min)(pushConstantRange.size, layoutRange.size);
+    if(pushConstantBegin < end)
+    {
+        currentCmdBuffer.pushConstants(currentPipelineLayout->PipelineLayoutHandle(), layoutRange.stageFlags, 
+            pushConstantBegin, end - pushConstantBegin, pushConstantData + pushConstantBegin);
+        pushConstantUpdates.emitted++;
+    }
+    bPushConstantDirty = false;
+}
+
+void GfxPendingStateVk::PrepareDraw()
+{
+    RHI_PROFILE_ZONE("PrepareDraw");
+    UpdateDynamicStates();
+
+    if(bPushConstantDirty)
+    {
+        UpdatePushConstants();
+    }
+
+    if(dsChanged)
+    {
+        dsChanged = false;
+        UpdateDescriptorSets(vk::PipelineBindPoint::eGraphics, currentPipeline->GetLayout());
+    }
+
+    // Index buffers are independent of the pipeline, only a changed stream is bound again
+    if(bIndexDirty && indexBuffer)
+    {
+        bIndexDirty = false;
+        currentCmdBuffer.bindIndexBuffer(indexBuffer, indexOffset, indexType);
+        indexBufferBinds.emitted++;
     }
 
     if(bVertDirty)
@@ -100,30 +326,124 @@ void GfxPendingStateVk::PrepareDraw()
         if(TemporaryIA.NumUsed > 0)
         {
             currentCmdBuffer.bindVertexBuffers(0, TemporaryIA.NumUsed, TemporaryIA.VertexBuffers, TemporaryIA.VertexOffsets);
+            vertexBufferBinds.emitted++;
         }
     }
 }
 
-void ComputePendingStateVk::PrepareDispatch()
+void GfxPendingStateVk::SubmitDraws(std::span<const DrawItem> drawItems)
 {
-    if(dsChanged)
+    UpdateDynamicStates();
+
+    // Items are translated straight into commands, diffed against the previous item only
+    GraphicsPipelineVk* lastPipeline = nullptr;
+    vk::PipelineLayout lastLayout;
+    BindingGroupVk* lastGroup = nullptr;
+    const Uint32* lastPushConstants = nullptr;
+    IBuffer* lastVertexBuffer = nullptr;
+    Uint32 lastVertexOffset = 0;
+    IBuffer* lastIndexBuffer = nullptr;
+    Uint32 lastIndexOffset = 0;
+    IndexType lastIndexType = IndexType::Uint16;
+
+    for(const DrawItem& item : drawItems)
     {
-        dsChanged = false;
-        // 1. write change to descriptorSet
-        for(Uint dsWriterIndex = 0; dsWriterIndex < MaxDescriptorSetCount; dsWriterIndex++)
+        // Only VkHandle creates these objects, no dynamic_cast needed
+        GraphicsPipelineVk* pipeline = static_cast<GraphicsPipelineVk*>(item.pipeline);
+        if(pipeline != lastPipeline)
         {
-            if(writerDirty[dsWriterIndex])
+            pipeline->Bind(currentCmdBuffer);
+            pipelineBinds.emitted++;
+            if(pipeline->GetLayout() != lastLayout)
             {
-				dsWriter[dsWriterIndex].BindDescriptor(*dsArray[dsWriterIndex]);
-				dsWriter[dsWriterIndex].Update(deviceData.logicalDevice);
+                lastLayout = pipeline->GetLayout();
+                lastGroup = nullptr;
+                lastPushConstants = nullptr;
             }
+            lastPipeline = pipeline;
+        }
+        else
+        {
+            pipelineBinds.skipped++;
         }
 
-        // 2. bind descriptorSet
-        if(dsNum > 0)
+        BindingGroupVk* group = static_cast<BindingGroupVk*>(item.bindingGroup);
+        if(group && group != lastGroup)
         {
-            currentCmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, currentPipeline->GetLayout(), 0, dsNum, dsArray[0], 0, nullptr);
+            currentCmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, lastLayout, 0, group->DescriptorSetHandle(), nullptr);
+            descriptorSetBinds.emitted++;
+            lastGroup = group;
         }
+        else if(group)
+        {
+            descriptorSetBinds.skipped++;
+        }
+
+        if(!lastPushConstants || memcmp(lastPushConstants, item.pushConstants, DrawItemPushConstantSize) != 0)
+        {
+            const vk::PushConstantRange range = DrawItemPushConstantRange();
+            currentCmdBuffer.pushConstants(lastLayout, range.stageFlags, 0, range.size, item.pushConstants);
+            pushConstantUpdates.emitted++;
+            lastPushConstants = item.pushConstants;
+        }
+        else
+        {
+            pushConstantUpdates.skipped++;
+        }
+
+        if(item.vertexBuffer && (item.vertexBuffer != lastVertexBuffer || item.vertexBufferOffset != lastVertexOffset))
+        {
+            vk::DeviceSize offset = item.vertexBufferOffset;
+            currentCmdBuffer.bindVertexBuffers(0, 1, &static_cast<BufferVk*>(item.vertexBuffer)->BufferHandle(), &offset);
+            vertexBufferBinds.emitted++;
+            lastVertexBuffer = item.vertexBuffer;
+            lastVertexOffset = item.vertexBufferOffset;
+        }
+        else if(item.vertexBuffer)
+        {
+            vertexBufferBinds.skipped++;
+        }
+
+        if(!item.indexBuffer)
+        {
+            currentCmdBuffer.draw(item.elementCount, item.instanceCount, item.firstElement, item.firstInstance);
+            continue;
+        }
+
+        if(item.indexBuffer != lastIndexBuffer || item.indexBufferOffset != lastIndexOffset || item.indexType != lastIndexType)
+        {
+            currentCmdBuffer.bindIndexBuffer(static_cast<BufferVk*>(item.indexBuffer)->BufferHandle(), item.indexBufferOffset, ConvertIndexType(item.indexType));
+            indexBufferBinds.emitted++;
+            lastIndexBuffer = item.indexBuffer;
+            lastIndexOffset = item.indexBufferOffset;
+            lastIndexType = item.indexType;
+        }
+        else
+        {
+            indexBufferBinds.skipped++;
+        }
+        currentCmdBuffer.drawIndexed(item.elementCount, item.instanceCount, item.firstElement, item.vertexOffset, item.firstInstance);
+    }
+
+    // The command buffer no longer holds what the pending state bound
+    if(!drawItems.empty())
+    {
+        InvalidateBoundState();
+    }
+}
+
+void ComputePendingStateVk::PrepareDispatch()
+{
+    RHI_PROFILE_ZONE("PrepareDispatch");
+    if(bPushConstantDirty)
+    {
+        UpdatePushConstants();
+    }
+
+    if(dsChanged)
+    {
+        dsChanged = false;
+        UpdateDescriptorSets(vk::PipelineBindPoint::eCompute, currentPipeline->GetLayout());
     }
 }
 
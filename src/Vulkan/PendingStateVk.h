@@ -2,28 +2,60 @@
 #ifdef RHI_SUPPORT_VULKAN
 
 #include <cassert>
+#include <cstring>
 #include "IRHIHandle.h"
 #include "PipelineVk.h"
 #include "DescriptorSetPoolVk.h"
 #include "ImageViewVk.h"
 #include "BufferVk.h"
+#include "BindlessHeapVk.h"
+#include "DescriptorBufferVk.h"
+#include "BindingGroupVk.h"
+#include <span>
 
 namespace TinyRHI
 {
     #define MaxVertexCount 20
     #define MaxDescriptorSetCount 4
+    // Minimum maxPushConstantsSize guaranteed by the spec
+    #define MaxPushConstantSize 128
+
+    inline vk::PushConstantRange DrawItemPushConstantRange()
+    {
+        return vk::PushConstantRange(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, DrawItemPushConstantSize);
+    }
 
     class PendingStateVk
     {
     public:
-        PendingStateVk(const DeviceData& _deviceData)
+        PendingStateVk(const DeviceData& _deviceData, DescriptorBufferVk* _descriptorBuffer)
             : deviceData(_deviceData)
+            , descriptorBuffer(_descriptorBuffer)
         {
             dsPool = std::make_unique<DescriptorSetPoolVk>(_deviceData);
+            dsOffsetsBlock = (std::numeric_limits<Uint32>::max)();
+            dsOffsetsBindSerial = 0;
             for(Uint i = 0; i < MaxDescriptorSetCount; i++)
             {
                 writerDirty[i] = false;
+                boundDynamicOffsetCount[i] = 0;
             }
+            dsChanged = false;
+            bLayoutChanged = false;
+            dsNum = 0;
+            currentPipelineLayout = nullptr;
+            bindlessHeap = nullptr;
+            bindlessSetId = MaxDescriptorSetCount;
+            pushSetId = MaxDescriptorSetCount;
+            pushConstantRange = vk::PushConstantRange();
+            pushConstantBegin = MaxPushConstantSize;
+            memset(pushConstantData, 0, sizeof(pushConstantData));
+            bPushConstantDirty = false;
+        }
+
+        void BeginFrame(Uint32 frameIndex)
+        {
+            dsPool->BeginFrame(frameIndex);
         }
 
         vk::DescriptorPool GetDescriptorPool()
@@ -34,6 +66,19 @@ namespace TinyRHI
         void SetCmdBuffer(vk::CommandBuffer cmdBuffer)
         {
             currentCmdBuffer = cmdBuffer;
+            InvalidateBoundState();
+        }
+
+        // Nothing recorded into the previous command buffer carries over, so the
+        // next pipeline layout rebinds every set and push constant
+        void InvalidateBoundState()
+        {
+            if(descriptorBuffer)
+            {
+                descriptorBuffer->InvalidateBinding();
+            }
+            currentPipelineLayout = nullptr;
+            dsNum = 0;
         }
 
         void SetSamplerImage(TextureVk* vkTexture, IShader::Stage stage, Uint setId, Uint bindingId)
@@ -55,36 +100,203 @@ namespace TinyRHI
             return SetBuffer<true>(vkBuffer, stage, setId, bindingId);
         }
 
+        // Pooled resources bind straight from their slot's handles
+        void SetSamplerImage(vk::ImageView imageView, vk::Sampler sampler, IShader::Stage stage, Uint setId, Uint bindingId)
+        {
+            return SetTexture<false>(imageView, sampler, stage, setId, bindingId);
+        }
+
+        void SetStorageBuffer(vk::Buffer buffer, Uint32 size, IShader::Stage stage, Uint setId, Uint bindingId)
+        {
+            return SetBuffer<false>(buffer, size, stage, setId, bindingId);
+        }
+        void SetUniformBuffer(vk::Buffer buffer, Uint32 size, IShader::Stage stage, Uint setId, Uint bindingId)
+        {
+            return SetBuffer<true>(buffer, size, stage, setId, bindingId);
+        }
+
+        void SetStorageBuffer(BufferVk* vkBuffer, IShader::Stage stage, Uint setId, Uint bindingId, Uint32 offset, Uint32 range)
+        {
+            return SetBufferRange<false>(vkBuffer, stage, setId, bindingId, offset, range);
+        }
+        void SetUniformBuffer(BufferVk* vkBuffer, IShader::Stage stage, Uint setId, Uint bindingId, Uint32 offset, Uint32 range)
+        {
+            return SetBufferRange<true>(vkBuffer, stage, setId, bindingId, offset, range);
+        }
+
+        // Following pipeline layouts take the heap's layout at setId
+        void SetBindlessHeap(BindlessHeapVk* heap, Uint setId)
+        {
+            assert(setId < MaxDescriptorSetCount);
+            bindlessHeap = heap;
+            bindlessSetId = setId;
+        }
+
+        // Following pipeline layouts push setId instead of allocating it
+        void SetPushDescriptorSet(Uint setId)
+        {
+            assert(setId < MaxDescriptorSetCount);
+            pushSetId = setId;
+        }
+
+        // Stages accumulate into a single range, so one vkCmdPushConstants covers every stage
+        void SetPushConstants(IShader::Stage stage, const void* data, Uint32 size, Uint32 offset)
+        {
+            // Bytes past the device limit (or the staging copy) are dropped rather than overflowing
+            Uint32 limit = (std::min)(deviceData.properties.limits.maxPushConstantsSize, (Uint32)MaxPushConstantSize);
+            assert(offset + size <= limit);
+            if(offset >= limit)
+            {
+                return;
+            }
+            size = (std::min)(size, limit - offset);
+
+            vk::PushConstantRange newRange = pushConstantRange;
+            newRange.stageFlags |= ConvertShaderStage(stage);
+            // vkCmdPushConstants takes multiples of 4
+            newRange.size = (std::max)(newRange.size, (std::min)((offset + size + 3) & ~3u, limit));
+            if(newRange == pushConstantRange && offset >= pushConstantBegin && memcmp(pushConstantData + offset, data, size) == 0)
+            {
+                pushConstantUpdates.skipped++;
+                return;
+            }
+            memcpy(pushConstantData + offset, data, size);
+            pushConstantRange = newRange;
+            pushConstantBegin = (std::min)(pushConstantBegin, offset & ~3u);
+            bPushConstantDirty = true;
+        }
+
         PipelineLayoutVk* GetPipelineLayout(const DeviceData& deviceData);
+        // Layout of a CreateDrawPipeline pipeline, shared with Set* pipelines of the same signature
+        PipelineLayoutVk* GetPipelineLayout(const DeviceData& deviceData, DescriptorSetLayoutVk* dsLayout, const vk::PushConstantRange& range);
+
+        DescriptorSetLayoutVk* GetDescriptorSetLayout(const DescriptorSetLayoutBindingDescArray& layoutBindings)
+        {
+            return dsPool->GetDescriptorSetLayout(layoutBindings);
+        }
+
+        void AccumulateStats(RHIStats& stats) const
+        {
+            stats.descriptorSetLayoutCreated += dsPool->LayoutCreateCount();
+            stats.pipelineLayoutCreated += pipelineLayoutCreateCount;
+            stats.descriptorSetAllocated += dsPool->SetAllocateCount();
+            stats.descriptorSetCacheHit += dsPool->SetCacheHitCount();
+            stats.descriptorPoolCreated += dsPool->PoolCreateCount();
+            AccumulateCounter(stats.pipelineBinds, pipelineBinds);
+            AccumulateCounter(stats.descriptorSetBinds, descriptorSetBinds);
+            AccumulateCounter(stats.pushConstantUpdates, pushConstantUpdates);
+        }
+
+        // Resources and push constants are set again for every command
+        void Reset()
+        {
+            for (Uint i = 0; i < MaxDescriptorSetCount; i++)
+            {
+                dsWriter[i].Reset();
+                writerDirty[i] = false;
+            }
+            pushConstantRange = vk::PushConstantRange();
+            pushConstantBegin = MaxPushConstantSize;
+            bPushConstantDirty = false;
+        }
 
     protected:
         template<Bool bWriteEnable>
         void SetTexture(TextureVk* vkTexture, IShader::Stage stage, Uint setId, Uint bindingId)
         {
-            Dirty(dsWriter[setId].WriteImage<bWriteEnable>(vkTexture->ImageViewHandle(), stage, vkTexture->SamplerHandle(), bindingId), setId);
+            SetTexture<bWriteEnable>(vkTexture->ImageViewHandle(), vkTexture->SamplerHandle(), stage, setId, bindingId);
+        }
+
+        template<Bool bWriteEnable>
+        void SetTexture(vk::ImageView imageView, vk::Sampler sampler, IShader::Stage stage, Uint setId, Uint bindingId)
+        {
+            Dirty(dsWriter[setId].WriteImage<bWriteEnable>(imageView, stage, sampler, bindingId), setId);
         }
 
         template<Bool bUniform>
         void SetBuffer(BufferVk* vkBuffer, IShader::Stage stage, Uint setId, Uint bindingId)
         {
-            Dirty(dsWriter[setId].WriteBuffer<bUniform>(vkBuffer->BufferHandle(), stage, 0, vkBuffer->GetSize(), bindingId), setId);
+            SetBuffer<bUniform>(vkBuffer->BufferHandle(), vkBuffer->GetSize(), stage, setId, bindingId);
         }
 
-        void Dirty(Bool bDirty, Uint index)
+        template<Bool bUniform>
+        void SetBuffer(vk::Buffer buffer, Uint32 size, IShader::Stage stage, Uint setId, Uint bindingId)
         {
-            if(bDirty && index < MaxDescriptorSetCount)
+            Dirty(dsWriter[setId].WriteBuffer<bUniform>(buffer, stage, 0, size, bindingId), setId);
+        }
+
+        template<Bool bUniform>
+        void SetBufferRange(BufferVk* vkBuffer, IShader::Stage stage, Uint setId, Uint bindingId, Uint32 offset, Uint32 range)
+        {
+            assert(offset + range <= vkBuffer->GetSize());
+            // Descriptor offsets and dynamic offsets alike must be aligned, an unaligned offset is dropped
+            const auto& limits = deviceData.properties.limits;
+            vk::DeviceSize alignment = bUniform ? limits.minUniformBufferOffsetAlignment : limits.minStorageBufferOffsetAlignment;
+            assert(offset % alignment == 0 && "buffer range offsets must be multiples of min*BufferOffsetAlignment");
+            if(offset % alignment != 0)
             {
-                writerDirty[index] = true;
-                dsChanged = true;
+                return;
+            }
+
+            // Descriptor buffers and push descriptors have no dynamic descriptors, the offset goes into the descriptor
+            if(descriptorBuffer || setId == pushSetId)
+            {
+                Dirty(dsWriter[setId].WriteBuffer<bUniform>(vkBuffer->BufferHandle(), stage, offset, range, bindingId), setId);
+                return;
             }
+
+            // The whole offset is dynamic, so draws that only move through the buffer keep the same descriptor set
+            Dirty(dsWriter[setId].WriteDynamicBuffer<bUniform>(vkBuffer->BufferHandle(), stage, offset, 0, range, bindingId), setId);
         }
 
-        void Reset()
+        static void AccumulateCounter(RHIStats::BindCounter& dst, const RHIStats::BindCounter& src)
+        {
+            dst.emitted += src.emitted;
+            dst.skipped += src.skipped;
+        }
+
+        void SetPipelineLayout(PipelineLayoutVk* vkPipelineLayout)
         {
-            for (Uint i = 0; i < MaxDescriptorSetCount && writerDirty[i]; i++)
+            // Binding a pipeline with the same layout keeps the bound sets and push constants valid
+            if(currentPipelineLayout == vkPipelineLayout)
             {
-                dsWriter[i].Reset();
-                writerDirty[i] = false;
+                return;
+            }
+            currentPipelineLayout = vkPipelineLayout;
+            dsNum = 0;
+            if(currentPipelineLayout)
+            {
+                dsNum = (std::min)((Uint)currentPipelineLayout->DSLayoutHandle().size(), (Uint)MaxDescriptorSetCount);
+            }
+            // Sets have to be looked up again against the new layouts
+            bLayoutChanged = true;
+            dsChanged = true;
+            bPushConstantDirty = true;
+        }
+
+        void UpdatePushConstants();
+
+        Uint64 DescriptorContentKey(DescriptorSetLayoutVk* dsLayout, Uint index) const;
+        vk::DescriptorSet ResolveDescriptorSet(Uint index);
+        vk::DeviceSize ResolveDescriptorOffset(Uint index);
+        void UpdateDescriptorSets(vk::PipelineBindPoint bindPoint, vk::PipelineLayout vkPipelineLayout);
+
+        Bool IsBindlessSet(Uint index) const
+        {
+            return bindlessHeap && index == bindlessSetId;
+        }
+
+        DescriptorSetLayoutVk::Usage GetSetUsage(Uint index) const
+        {
+            return index == pushSetId ? DescriptorSetLayoutVk::Usage::PushDescriptor : DescriptorSetLayoutVk::Usage::Pooled;
+        }
+
+        void Dirty(Bool bDirty, Uint index)
+        {
+            if(bDirty && index < MaxDescriptorSetCount)
+            {
+                writerDirty[index] = true;
+                dsChanged = true;
             }
         }
 
@@ -94,65 +306,107 @@ namespace TinyRHI
         DescriptorSetWriterVk dsWriter[MaxDescriptorSetCount];
         Bool writerDirty[MaxDescriptorSetCount];
         Bool dsChanged;
+        Bool bLayoutChanged;
 
-        vk::DescriptorSet* dsArray[MaxDescriptorSetCount];
+        PipelineLayoutVk* currentPipelineLayout;
+        vk::DescriptorSet dsArray[MaxDescriptorSetCount];
         Uint dsNum;
 
+        // What the command buffer holds, compared against before binding
+        vk::DescriptorSet boundDsArray[MaxDescriptorSetCount];
+        Uint32 boundDynamicOffsets[MaxDescriptorSetCount][MaxDescriptorBindingCount];
+        Uint32 boundDynamicOffsetCount[MaxDescriptorSetCount];
+        vk::DeviceSize boundDsOffsets[MaxDescriptorSetCount];
+
+        RHIStats::BindCounter pipelineBinds;
+        RHIStats::BindCounter descriptorSetBinds;
+        RHIStats::BindCounter pushConstantUpdates;
+
         const DeviceData& deviceData;
         std::unique_ptr<DescriptorSetPoolVk> dsPool;
 
+        BindlessHeapVk* bindlessHeap;
+        Uint bindlessSetId;
+        Uint pushSetId;
+
+        std::byte pushConstantData[MaxPushConstantSize];
+        vk::PushConstantRange pushConstantRange;
+        // Lowest written byte, only [pushConstantBegin, pushConstantRange.size) is pushed
+        Uint32 pushConstantBegin;
+        Bool bPushConstantDirty;
+
+        // Replaces dsPool's sets when VK_EXT_descriptor_buffer is enabled, owned by the handle
+        DescriptorBufferVk* descriptorBuffer;
+        vk::DeviceSize dsOffsets[MaxDescriptorSetCount];
+        // Block dsOffsets point into and the bind they were recorded under
+        Uint32 dsOffsetsBlock;
+        Uint64 dsOffsetsBindSerial;
+
         std::unordered_map<Uint32, std::unique_ptr<PipelineLayoutVk>> pipelineLayoutCache;
+        Uint32 pipelineLayoutCreateCount = 0;
     };
 
     class GfxPendingStateVk : public PendingStateVk
     {
     public:
-        GfxPendingStateVk(const DeviceData& _deviceData)
-            : PendingStateVk(_deviceData)
+        GfxPendingStateVk(const DeviceData& _deviceData, DescriptorBufferVk* _descriptorBuffer)
+            : PendingStateVk(_deviceData, _descriptorBuffer)
         {
-            Reset();
+            viewport = vk::Viewport();
+            scissor = vk::Rect2D();
+            for(Uint i = 0; i < MaxVertexCount; i++)
+            {
+                vertOffsetArray[i] = 0;
+            }
+            bVertDirty = false;
+            bIndexDirty = false;
+            MarkUpdateDynamicStates();
+            currentPipeline = nullptr;
         }
         ~GfxPendingStateVk()
         {
         }
 
-        void Reset()
+        void SetCmdBuffer(vk::CommandBuffer cmdBuffer)
         {
-            PendingStateVk::Reset();
-            viewport = vk::Viewport();
-            bViewportDirty = true;
-
-            scissor = vk::Rect2D();
-            bScissorDirty = true;
-
-            bVertDirty = true;
+            currentCmdBuffer = cmdBuffer;
+            InvalidateBoundState();
+            // Like resources, the index stream is set again for every command, the buffer may be gone by now
+            indexBuffer = vk::Buffer();
+        }
 
+        // Pipeline, dynamic state and vertex/index streams are recorded again
+        void InvalidateBoundState()
+        {
+            PendingStateVk::InvalidateBoundState();
             currentPipeline = nullptr;
+            MarkUpdateDynamicStates();
+            bVertDirty = true;
+            bIndexDirty = true;
         }
 
         Bool SetPipeline(GraphicsPipelineVk* newPipeline)
         {
             if(currentPipeline != newPipeline)
             {
-                currentPipeline = newPipeline;
-                auto& pipelineDesc = currentPipeline->PipelineDescHandle();
-                PipelineLayoutVk* vkPipelineLayout = dynamic_cast<PipelineLayoutVk*>(pipelineDesc.pipelineLayout);
-                if(vkPipelineLayout)
+                // Vertex streams are packed by the pipeline's vertex bindings
+                if(!currentPipeline || !SameVertexBindings(currentPipeline, newPipeline))
                 {
-                    auto& dsVkArray = vkPipelineLayout->DSLayoutHandle();
-                    for(dsNum = 0; dsNum < dsVkArray.size() && dsNum < MaxDescriptorSetCount; dsNum++)
-                    {
-                        dsArray[dsNum] = &dsPool->GetDescriptorSet(&dsVkArray[dsNum])->DescriptorSetHandle();
-                    }
+                    bVertDirty = true;
                 }
+                currentPipeline = newPipeline;
+                auto& pipelineDesc = currentPipeline->PipelineDescHandle();
+                SetPipelineLayout(CastVk<PipelineLayoutVk>(pipelineDesc.pipelineLayout));
                 return true;
             }
+            pipelineBinds.skipped++;
             return false;
         }
 
         void Bind()
         {
             currentPipeline->Bind(currentCmdBuffer);
+            pipelineBinds.emitted++;
         }
 
         void SetViewport(vk::Viewport newViewport)
@@ -161,8 +415,9 @@ namespace TinyRHI
             {
                 viewport = newViewport;
                 bViewportDirty = true;
-                // SetScissor();
+                return;
             }
+            dynamicStates.skipped++;
         }
 
         void SetScissor(vk::Rect2D newScissor)
@@ -171,17 +426,40 @@ namespace TinyRHI
             {
                 scissor = newScissor;
                 bScissorDirty = true;
+                return;
             }
+            dynamicStates.skipped++;
         }
 
         void SetVertex(Uint32 vertId, vk::Buffer vertBuffer, Uint32 offset)
         {
-            if(vertId < MaxVertexCount && vertBufferArray[vertId] != vertBuffer && vertOffsetArray[vertId] != offset)
+            assert(vertId < MaxVertexCount);
+            if(vertBufferArray[vertId] != vertBuffer || vertOffsetArray[vertId] != offset)
             {
                 vertBufferArray[vertId] = vertBuffer;
                 vertOffsetArray[vertId] = offset;
                 bVertDirty = true;
+                return;
             }
+            vertexBufferBinds.skipped++;
+        }
+
+        void SetIndex(vk::Buffer buffer, vk::DeviceSize offset, vk::IndexType type)
+        {
+            if(indexBuffer != buffer || indexOffset != offset || indexType != type)
+            {
+                indexBuffer = buffer;
+                indexOffset = offset;
+                indexType = type;
+                bIndexDirty = true;
+                return;
+            }
+            indexBufferBinds.skipped++;
+        }
+
+        Bool HasIndex() const
+        {
+            return indexBuffer != vk::Buffer();
         }
 
         void MarkUpdateDynamicStates()
@@ -191,6 +469,7 @@ namespace TinyRHI
         }
 
         void PrepareDraw();
+        void SubmitDraws(std::span<const DrawItem> drawItems);
 
         void UpdateDynamicStates()
         {
@@ -198,13 +477,42 @@ namespace TinyRHI
             {
                 currentCmdBuffer.setViewport(0, viewport);
                 bViewportDirty = false;
+                dynamicStates.emitted++;
             }
 
             if(bScissorDirty)
             {
                 currentCmdBuffer.setScissor(0, scissor);
                 bScissorDirty = false;
+                dynamicStates.emitted++;
+            }
+        }
+
+        void AccumulateStats(RHIStats& stats) const
+        {
+            PendingStateVk::AccumulateStats(stats);
+            AccumulateCounter(stats.vertexBufferBinds, vertexBufferBinds);
+            AccumulateCounter(stats.indexBufferBinds, indexBufferBinds);
+            AccumulateCounter(stats.dynamicStates, dynamicStates);
+        }
+
+    private:
+        static Bool SameVertexBindings(GraphicsPipelineVk* lhs, GraphicsPipelineVk* rhs)
+        {
+            const auto& lhsBindings = lhs->PipelineDescHandle().setting.vertexDecl.vertexBindings;
+            const auto& rhsBindings = rhs->PipelineDescHandle().setting.vertexDecl.vertexBindings;
+            if(lhsBindings.size() != rhsBindings.size())
+            {
+                return false;
+            }
+            for(Uint i = 0; i < lhsBindings.size(); i++)
+            {
+                if(lhsBindings[i].binding != rhsBindings[i].binding)
+                {
+                    return false;
+                }
             }
+            return true;
         }
 
     private:
@@ -218,23 +526,39 @@ namespace TinyRHI
         vk::DeviceSize vertOffsetArray[MaxVertexCount];
         Bool bVertDirty;
 
+        vk::Buffer indexBuffer;
+        vk::DeviceSize indexOffset = 0;
+        vk::IndexType indexType = vk::IndexType::eUint16;
+        Bool bIndexDirty;
+
         GraphicsPipelineVk* currentPipeline;
+
+        RHIStats::BindCounter vertexBufferBinds;
+        RHIStats::BindCounter indexBufferBinds;
+        RHIStats::BindCounter dynamicStates;
     };
 
     class ComputePendingStateVk : public PendingStateVk
     {
     public:
-        ComputePendingStateVk(const DeviceData& _deviceData)
-            : PendingStateVk(_deviceData)
+        ComputePendingStateVk(const DeviceData& _deviceData, DescriptorBufferVk* _descriptorBuffer)
+            : PendingStateVk(_deviceData, _descriptorBuffer)
         {
+            currentPipeline = nullptr;
         }
         ~ComputePendingStateVk()
         {
         }
 
-        void Reset()
+        void SetCmdBuffer(vk::CommandBuffer cmdBuffer)
         {
-            PendingStateVk::Reset();
+            currentCmdBuffer = cmdBuffer;
+            InvalidateBoundState();
+        }
+
+        void InvalidateBoundState()
+        {
+            PendingStateVk::InvalidateBoundState();
             currentPipeline = nullptr;
         }
 
@@ -244,23 +568,17 @@ namespace TinyRHI
             {
                 currentPipeline = newPipeline;
                 auto& pipelineDesc = currentPipeline->PipelineDescHandle();
-                PipelineLayoutVk* vkPipelineLayout = dynamic_cast<PipelineLayoutVk*>(pipelineDesc.pipelineLayout);
-                if(vkPipelineLayout)
-                {
-                    auto& dsVkArray = vkPipelineLayout->DSLayoutHandle();
-                    for(dsNum = 0; dsNum < dsVkArray.size() && dsNum < MaxDescriptorSetCount; dsNum++)
-                    {
-                        dsArray[dsNum] = &dsPool->GetDescriptorSet(&dsVkArray[dsNum])->DescriptorSetHandle();
-                    }
-                }
+                SetPipelineLayout(CastVk<PipelineLayoutVk>(pipelineDesc.pipelineLayout));
                 return true;
             }
+            pipelineBinds.skipped++;
             return false;
         }
 
         void Bind()
         {
             currentPipeline->Bind(currentCmdBuffer);
+            pipelineBinds.emitted++;
         }
 
         void PrepareDispatch();
@@ -4,16 +4,77 @@
 
 using namespace TinyRHI;
 
+// A pipeline reads descriptors either from bound sets or from descriptor buffers, never both
+static vk::PipelineCreateFlags GetPipelineCreateFlags(const DeviceData& deviceData)
+{
+    vk::PipelineCreateFlags flags;
+    if (deviceData.enabledFeatures.descriptorBuffer)
+    {
+        flags |= vk::PipelineCreateFlagBits::eDescriptorBufferEXT;
+    }
+    return flags;
+}
+
 GraphicsPipelineVk::GraphicsPipelineVk(
-    const DeviceData& deviceData,
-    GraphicsPipelineDesc _graphicsPipelineDesc)
-    : graphicsPipelineDesc(_graphicsPipelineDesc)
+    const DeviceData& _deviceData,
+    GraphicsPipelineDesc _graphicsPipelineDesc,
+    JobSystem* _compileJobs)
+    : deviceData(_deviceData), graphicsPipelineDesc(_graphicsPipelineDesc)
 {
     PipelineLayoutVk* vkPipelineLayout = dynamic_cast<PipelineLayoutVk*>(graphicsPipelineDesc.pipelineLayout);
+    this->pipelineLayout = vkPipelineLayout->PipelineLayoutHandle();
+    if (_compileJobs)
+    {
+        // vkCreateGraphicsPipelines is free threaded, everything it reads outlives the pipeline
+        compileTask = std::make_shared<CompileTaskVk>();
+        _compileJobs->Run([this, task = compileTask]()
+        {
+            // Claimed by a use or by the destructor, this may be gone already
+            if (!task->bClaimed.exchange(true, std::memory_order_acq_rel))
+            {
+                Compile(deviceData);
+                task->bDone.store(true, std::memory_order_release);
+                task->bDone.notify_all();
+            }
+        });
+    }
+    else
+    {
+        Compile(deviceData);
+    }
+}
+
+GraphicsPipelineVk::~GraphicsPipelineVk()
+{
+    // Claiming an unstarted compile cancels it, a running one still writes into this pipeline
+    if (compileTask && compileTask->bClaimed.exchange(true, std::memory_order_acq_rel))
+    {
+        compileTask->bDone.wait(false, std::memory_order_acquire);
+    }
+}
+
+void GraphicsPipelineVk::WaitCompiled()
+{
+    if (!compileTask || compileTask->bDone.load(std::memory_order_acquire))
+    {
+        return;
+    }
+    if (!compileTask->bClaimed.exchange(true, std::memory_order_acq_rel))
+    {
+        Compile(deviceData);
+        compileTask->bDone.store(true, std::memory_order_release);
+        compileTask->bDone.notify_all();
+        return;
+    }
+    compileTask->bDone.wait(false, std::memory_order_acquire);
+}
+
+void GraphicsPipelineVk::Compile(const DeviceData& deviceData)
+{
+    RHI_PROFILE_ZONE("CompileGfxPipeline");
     RenderPassVk* vkRenderPass = dynamic_cast<RenderPassVk*>(graphicsPipelineDesc.renderPass);
     ShaderVk<IShader::Stage::Vertex>* vkVertShader = dynamic_cast<ShaderVk<IShader::Stage::Vertex>*>(graphicsPipelineDesc.vertShader);
     ShaderVk<IShader::Stage::Pixel>* vkPixelShader = dynamic_cast<ShaderVk<IShader::Stage::Pixel>*>(graphicsPipelineDesc.pixelShader);
-    this->pipelineLayout = vkPipelineLayout->PipelineLayoutHandle();
 
     vk::PipelineShaderStageCreateInfo shaderStageCreateInfo[] = { vkVertShader->Handle(), vkPixelShader->Handle() };
 
@@ -89,6 +150,7 @@ GraphicsPipelineVk::GraphicsPipelineVk(
         .setPDynamicStates(dynamicStates);
 
     auto pipelineCreateInfo = vk::GraphicsPipelineCreateInfo()
+        .setFlags(GetPipelineCreateFlags(deviceData))
         .setStageCount(2)
         .setPStages(shaderStageCreateInfo)
         .setPVertexInputState(&vertexInputStateCreateInfo)
@@ -118,7 +180,7 @@ ComputePipelineVk::ComputePipelineVk(
     this->pipelineLayout = vkPipelineLayout->PipelineLayoutHandle();
 
     auto pipelineCreateInfo = vk::ComputePipelineCreateInfo()
-        .setFlags(vk::PipelineCreateFlags())
+        .setFlags(GetPipelineCreateFlags(deviceData))
         .setStage(vkCompShader->Handle())
         .setLayout(this->pipelineLayout)
         .setBasePipelineHandle(nullptr)
@@ -13,20 +13,33 @@ namespace TinyRHI
 	class PipelineLayoutVk : public IPipelineLayout, public UniqueHash
 	{
 	public:
+		// DescriptorSetLayouts are owned by DescriptorSetPoolVk's layout cache
 		PipelineLayoutVk(
 			const DeviceData& deviceData, 
-			std::vector<DescriptorSetLayoutVk>& _vkDescriptorSetLayouts)
+			const std::vector<DescriptorSetLayoutVk*>& _vkDescriptorSetLayouts,
+			const vk::PushConstantRange& _pushConstantRange = vk::PushConstantRange())
+			: logicalDevice(deviceData.logicalDevice), vkDescriptorSetLayouts(_vkDescriptorSetLayouts), 
+			pushConstantRange(_pushConstantRange)
 		{
 			std::vector<vk::DescriptorSetLayout> descriptorSetLayouts(_vkDescriptorSetLayouts.size());
 			for (Uint32 i = 0; i < _vkDescriptorSetLayouts.size(); i++)
 			{
-				descriptorSetLayouts[i] = _vkDescriptorSetLayouts[i].DSLayoutHandle();
-				vkDescriptorSetLayouts.push_back(std::move(_vkDescriptorSetLayouts[i]));
+				descriptorSetLayouts[i] = _vkDescriptorSetLayouts[i]->DSLayoutHandle();
+				if (_vkDescriptorSetLayouts[i]->GetUsage() == DescriptorSetLayoutVk::Usage::PushDescriptor)
+				{
+					assert(pushSet == Uint32(-1));
+					pushSet = i;
+				}
 			}
 
 			auto pipelineLayoutCreateInfo = vk::PipelineLayoutCreateInfo()
 				.setSetLayoutCount(descriptorSetLayouts.size())
 				.setPSetLayouts(descriptorSetLayouts.data());
+			if (pushConstantRange.size > 0)
+			{
+				pipelineLayoutCreateInfo.setPushConstantRangeCount(1)
+					.setPPushConstantRanges(&pushConstantRange);
+			}
 
 			pipelineLayout = deviceData.logicalDevice.createPipelineLayoutUnique(pipelineLayoutCreateInfo);
 		}
@@ -41,20 +54,54 @@ namespace TinyRHI
 			return vkDescriptorSetLayouts;
 		}
 
+		// One range from offset 0 visible to every stage that pushes, size 0 when unused
+		const vk::PushConstantRange& GetPushConstantRange() const
+		{
+			return pushConstantRange;
+		}
+
+		// Push templates are bound to a pipeline layout and a bind point, so they live here
+		vk::DescriptorUpdateTemplate PushTemplate(vk::PipelineBindPoint bindPoint)
+		{
+			assert(pushSet != Uint32(-1));
+			auto& pushTemplate = pushTemplates[bindPoint == vk::PipelineBindPoint::eCompute ? 1 : 0];
+			if (!pushTemplate)
+			{
+				auto templateCreateInfo = vk::DescriptorUpdateTemplateCreateInfo()
+					.setDescriptorUpdateEntries(vkDescriptorSetLayouts[pushSet]->TemplateEntries())
+					.setTemplateType(vk::DescriptorUpdateTemplateType::ePushDescriptorsKHR)
+					.setPipelineBindPoint(bindPoint)
+					.setPipelineLayout(pipelineLayout.get())
+					.setSet(pushSet);
+				pushTemplate = logicalDevice.createDescriptorUpdateTemplateUnique(templateCreateInfo);
+			}
+			return pushTemplate.get();
+		}
+
 	private:
+		vk::Device logicalDevice;
 		vk::UniquePipelineLayout pipelineLayout;
-		std::vector<DescriptorSetLayoutVk> vkDescriptorSetLayouts;
+		std::vector<DescriptorSetLayoutVk*> vkDescriptorSetLayouts;
+		vk::PushConstantRange pushConstantRange;
+
+		Uint32 pushSet = Uint32(-1);
+		// graphics, compute
+		vk::UniqueDescriptorUpdateTemplate pushTemplates[2];
 	};
 
 	class GraphicsPipelineVk : public IGraphicsPipeline
 	{
 	public:
+		// With compileJobs the pipeline is compiled on a worker, the first use waits for it
 		GraphicsPipelineVk(
-			const DeviceData& deviceData,
-			GraphicsPipelineDesc _graphicsPipelineDesc);
+			const DeviceData& _deviceData,
+			GraphicsPipelineDesc _graphicsPipelineDesc,
+			JobSystem* _compileJobs = nullptr);
+		~GraphicsPipelineVk();
 
 		void Bind(vk::CommandBuffer cmdBuffer)
 		{
+			WaitCompiled();
 			cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.get());
 		}
 
@@ -65,6 +112,7 @@ namespace TinyRHI
 
 		auto& PipelineHandle()
 		{
+			WaitCompiled();
 			return pipeline.get();
 		}
 
@@ -74,9 +122,26 @@ namespace TinyRHI
 		}
 
 	private:
+		void Compile(const DeviceData& deviceData);
+
+		// Compiles right here when the job has not started yet, otherwise blocks until it finished.
+		// Never runs other jobs of the shared queue
+		void WaitCompiled();
+
+		// Whoever claims it first compiles, the queued job only does so when no use came before
+		struct CompileTaskVk
+		{
+			std::atomic<Bool> bClaimed = false;
+			std::atomic<Bool> bDone = false;
+		};
+
+		const DeviceData& deviceData;
 		vk::UniquePipeline pipeline;
 		vk::PipelineLayout pipelineLayout;
 		GraphicsPipelineDesc graphicsPipelineDesc;
+
+		// Shared with the job, which may run after the pipeline is gone when nobody waited for it
+		std::shared_ptr<CompileTaskVk> compileTask;
 	};
 
 	class ComputePipelineVk : public IComputePipeline
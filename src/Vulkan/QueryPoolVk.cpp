@@ -0,0 +1,157 @@
+#ifdef RHI_SUPPORT_VULKAN
+
+#include "QueryPoolVk.h"
+
+namespace TinyRHI
+{
+    // Same order as the members of PipelineStatistics
+    static const vk::QueryPipelineStatisticFlags StatisticFlags =
+        vk::QueryPipelineStatisticFlagBits::eInputAssemblyVertices
+        | vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations
+        | vk::QueryPipelineStatisticFlagBits::eClippingInvocations
+        | vk::QueryPipelineStatisticFlagBits::eClippingPrimitives
+        | vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations
+        | vk::QueryPipelineStatisticFlagBits::eComputeShaderInvocations;
+
+    QueryPoolsVk::QueryPoolsVk(const DeviceData& _deviceData)
+        : deviceData(_deviceData)
+    {
+    }
+
+    void QueryPoolsVk::BeginFrame(Uint64 completedSubmit)
+    {
+        for (Uint32 typeIndex = 0; typeIndex < QueryTypeCount; typeIndex++)
+        {
+            QueryType type = (QueryType)typeIndex;
+            TypePoolsVk& typePools = typePoolsArray[typeIndex];
+            typePools.bReset = false;
+            typePools.ended.reset();
+            if (!IsSupported(type))
+            {
+                continue;
+            }
+
+            // Pools of frames that never submitted are free as well
+            Uint32 freePool = (Uint32)typePools.pools.size();
+            for (Uint32 i = 0; i < typePools.pools.size(); i++)
+            {
+                if (typePools.pools[i].submitValue <= completedSubmit)
+                {
+                    freePool = i;
+                    break;
+                }
+            }
+            if (freePool == typePools.pools.size())
+            {
+                auto queryPoolInfo = vk::QueryPoolCreateInfo()
+                    .setQueryType(type == QueryType::PipelineStatistics ? vk::QueryType::ePipelineStatistics : vk::QueryType::eOcclusion)
+                    .setQueryCount(MaxQueriesPerFrame)
+                    .setPipelineStatistics(type == QueryType::PipelineStatistics ? StatisticFlags : vk::QueryPipelineStatisticFlags());
+                PoolVk pool;
+                pool.queryPool = deviceData.logicalDevice.createQueryPoolUnique(queryPoolInfo);
+                typePools.pools.push_back(std::move(pool));
+            }
+            typePools.current = freePool;
+            typePools.pools[freePool].submitValue = 0;
+            // Its last submission completed, nothing on either queue still uses the pool
+            if (deviceData.enabledFeatures.hostQueryReset)
+            {
+                deviceData.logicalDevice.resetQueryPool(typePools.pools[freePool].queryPool.get(), 0, MaxQueriesPerFrame);
+                typePools.bReset = true;
+            }
+        }
+    }
+
+    void QueryPoolsVk::BeginCommand(vk::CommandBuffer cmdBuffer)
+    {
+        for (Uint32 typeIndex = 0; typeIndex < QueryTypeCount; typeIndex++)
+        {
+            TypePoolsVk& typePools = typePoolsArray[typeIndex];
+            if (!typePools.bReset && IsSupported((QueryType)typeIndex) && !typePools.pools.empty()
+                && !deviceData.enabledFeatures.hostQueryReset)
+            {
+                cmdBuffer.resetQueryPool(typePools.pools[typePools.current].queryPool.get(), 0, MaxQueriesPerFrame);
+                typePools.bReset = true;
+            }
+        }
+    }
+
+    void QueryPoolsVk::Submitted(Uint64 submitValue)
+    {
+        for (Uint32 typeIndex = 0; typeIndex < QueryTypeCount; typeIndex++)
+        {
+            TypePoolsVk& typePools = typePoolsArray[typeIndex];
+            if (typePools.bReset)
+            {
+                typePools.pools[typePools.current].submitValue = submitValue;
+            }
+        }
+    }
+
+    void QueryPoolsVk::BeginQuery(vk::CommandBuffer cmdBuffer, QueryType type, Uint32 index)
+    {
+        assert(index < MaxQueriesPerFrame);
+        if (IsSupported(type))
+        {
+            // Exact sample counts cost more on some hardware, binary queries only need "any"
+            vk::QueryControlFlags flags = type == QueryType::Occlusion && deviceData.enabledFeatures.occlusionQueryPrecise
+                ? vk::QueryControlFlagBits::ePrecise : vk::QueryControlFlags();
+            cmdBuffer.beginQuery(CurrentPool(type), index, flags);
+        }
+    }
+
+    void QueryPoolsVk::EndQuery(vk::CommandBuffer cmdBuffer, QueryType type, Uint32 index)
+    {
+        assert(index < MaxQueriesPerFrame);
+        if (IsSupported(type))
+        {
+            cmdBuffer.endQuery(CurrentPool(type), index);
+            typePoolsArray[(Uint32)type].ended.set(index);
+        }
+    }
+
+    void QueryPoolsVk::Resolve(vk::CommandBuffer cmdBuffer, QueryType type, Uint32 firstIndex, Uint32 count, vk::Buffer buffer, Uint32 offset)
+    {
+        assert(firstIndex + count <= MaxQueriesPerFrame);
+        Uint32 resultSize = ResultSize(type);
+        // vkCmdCopyQueryPoolResults needs the offset aligned to the result width, 8 bytes with e64
+        assert(offset % (type == QueryType::PipelineStatistics ? sizeof(Uint64) : sizeof(Uint32)) == 0);
+        if (!IsSupported(type))
+        {
+            cmdBuffer.fillBuffer(buffer, offset, count * resultSize, 0);
+            return;
+        }
+        vk::QueryResultFlags flags = vk::QueryResultFlagBits::eWait;
+        if (type == QueryType::PipelineStatistics)
+        {
+            flags |= vk::QueryResultFlagBits::e64;
+        }
+
+        // Runs of ended and never ended indices, eWait on the latter would stall the GPU forever
+        const TypePoolsVk& typePools = typePoolsArray[(Uint32)type];
+        Uint32 index = firstIndex;
+        while (index < firstIndex + count)
+        {
+            Bool bEnded = typePools.ended[index];
+            assert(bEnded && "resolving a query that was not ended this frame");
+            Uint32 runEnd = index + 1;
+            while (runEnd < firstIndex + count && typePools.ended[runEnd] == bEnded)
+            {
+                runEnd++;
+            }
+            Uint32 runOffset = offset + (index - firstIndex) * resultSize;
+            if (bEnded)
+            {
+                cmdBuffer.copyQueryPoolResults(CurrentPool(type), index, runEnd - index, buffer, runOffset, resultSize, flags);
+            }
+            else
+            {
+                cmdBuffer.fillBuffer(buffer, runOffset, (runEnd - index) * resultSize, 0);
+            }
+            index = runEnd;
+        }
+    }
+
+} // namespace TinyRHI
+
+#endif
@@ -0,0 +1,76 @@
+#pragma once
+#ifdef RHI_SUPPORT_VULKAN
+
+#include <array>
+#include <bitset>
+#include <vector>
+#include "HeaderVk.h"
+
+namespace TinyRHI
+{
+	/*
+	* Occlusion and pipeline statistics queries of IRHIHandle::BeginQuery. Each frame takes one query pool
+	* per type from a recycled list: a pool comes back once the last submission that used it completed,
+	* and a new one is only created when none has. Commands go to the graphics or the compute queue, so a
+	* pool is reset from the host (hostQueryReset) when the frame takes it, and queries can begin anywhere,
+	* render passes included. Without the feature the reset is recorded in the frame's first command, which
+	* only orders it with one queue: queries then read as zero when the two queues differ.
+	* Recording thread only.
+	*/
+	class QueryPoolsVk
+	{
+	public:
+		QueryPoolsVk(const DeviceData& _deviceData);
+
+		// Every submission up to completedSubmit finished
+		void BeginFrame(Uint64 completedSubmit);
+		void BeginCommand(vk::CommandBuffer cmdBuffer);
+		// The frame's pools stay in use until this submission completed
+		void Submitted(Uint64 submitValue);
+
+		void BeginQuery(vk::CommandBuffer cmdBuffer, QueryType type, Uint32 index);
+		void EndQuery(vk::CommandBuffer cmdBuffer, QueryType type, Uint32 index);
+		// Outside of a render pass. The GPU waits for the queries, the CPU does not; indices not ended this
+		// frame would never become available and are written as zero instead
+		void Resolve(vk::CommandBuffer cmdBuffer, QueryType type, Uint32 firstIndex, Uint32 count, vk::Buffer buffer, Uint32 offset);
+
+		static Uint32 ResultSize(QueryType type)
+		{
+			return type == QueryType::PipelineStatistics ? sizeof(PipelineStatistics) : sizeof(Uint32);
+		}
+
+	private:
+		struct PoolVk
+		{
+			vk::UniqueQueryPool queryPool;
+			Uint64 submitValue = 0;
+		};
+
+		struct TypePoolsVk
+		{
+			std::vector<PoolVk> pools;
+			// Pool of the current frame
+			Uint32 current = 0;
+			Bool bReset = false;
+			// Indices ended in the current frame
+			std::bitset<MaxQueriesPerFrame> ended;
+		};
+
+		Bool IsSupported(QueryType type) const
+		{
+			Bool bOrderedReset = deviceData.enabledFeatures.hostQueryReset || deviceData.graphicsQueue == deviceData.computeQueue;
+			return bOrderedReset && (type != QueryType::PipelineStatistics || deviceData.enabledFeatures.pipelineStatisticsQuery);
+		}
+		vk::QueryPool CurrentPool(QueryType type)
+		{
+			TypePoolsVk& typePools = typePoolsArray[(Uint32)type];
+			assert(typePools.bReset && "queries need a BeginCommand in the frame first");
+			return typePools.pools[typePools.current].queryPool.get();
+		}
+
+		const DeviceData& deviceData;
+		std::array<TypePoolsVk, QueryTypeCount> typePoolsArray;
+	};
+}
+
+#endif
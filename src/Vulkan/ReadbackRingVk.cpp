@@ -0,0 +1,129 @@
+#ifdef RHI_SUPPORT_VULKAN
+
+#include "ReadbackRingVk.h"
+
+namespace TinyRHI
+{
+    ReadbackRingVk::ReadbackRingVk(const DeviceData& _deviceData)
+        : deviceData(_deviceData)
+    {
+        // CPU reads of uncached memory are very slow, take cached memory whenever the device has it
+        vk::PhysicalDeviceMemoryProperties memProperties = deviceData.physicalDevice.getMemoryProperties();
+        vk::MemoryPropertyFlags cachedProp = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCached;
+        vk::MemoryPropertyFlags coherentProp = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+
+        vk::BufferCreateInfo probeInfo = vk::BufferCreateInfo()
+            .setSize(ReadbackBlockSize)
+            .setUsage(vk::BufferUsageFlagBits::eTransferDst)
+            .setSharingMode(vk::SharingMode::eExclusive);
+        vk::UniqueBuffer probeBuffer = deviceData.logicalDevice.createBufferUnique(probeInfo);
+        Uint32 typeBits = deviceData.logicalDevice.getBufferMemoryRequirements(probeBuffer.get()).memoryTypeBits;
+
+        Bool bCached = false;
+        for (Uint32 i = 0; i < memProperties.memoryTypeCount; i++)
+        {
+            if ((typeBits & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & cachedProp) == cachedProp)
+            {
+                bCached = true;
+                break;
+            }
+        }
+        memoryTypeIndex = findMemoryType(memProperties, bCached ? cachedProp : coherentProp, typeBits);
+        bCoherent = static_cast<bool>(memProperties.memoryTypes[memoryTypeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent);
+
+        CreateBlock(ReadbackBlockSize);
+    }
+
+    ReadbackRingVk::~ReadbackRingVk()
+    {
+        for (auto& block : blocks)
+        {
+            deviceData.logicalDevice.unmapMemory(block.memory.get());
+        }
+    }
+
+    Uint32 ReadbackRingVk::CreateBlock(Uint32 size)
+    {
+        Block block;
+        block.size = size;
+
+        auto bufferInfo = vk::BufferCreateInfo()
+            .setSize(size)
+            .setUsage(vk::BufferUsageFlagBits::eTransferDst)
+            .setSharingMode(vk::SharingMode::eExclusive);
+        block.buffer = deviceData.logicalDevice.createBufferUnique(bufferInfo);
+
+        vk::MemoryRequirements memRequirements = deviceData.logicalDevice.getBufferMemoryRequirements(block.buffer.get());
+        auto allocInfo = vk::MemoryAllocateInfo()
+            .setAllocationSize(memRequirements.size)
+            .setMemoryTypeIndex(memoryTypeIndex);
+        block.memory = deviceData.logicalDevice.allocateMemoryUnique(allocInfo);
+        deviceData.logicalDevice.bindBufferMemory(block.buffer.get(), block.memory.get(), 0);
+        block.mappedPtr = static_cast<std::byte*>(deviceData.logicalDevice.mapMemory(block.memory.get(), 0, VK_WHOLE_SIZE));
+
+        blocks.push_back(std::move(block));
+        return (Uint32)blocks.size() - 1;
+    }
+
+    ReadbackRingVk::Allocation ReadbackRingVk::Allocate(Uint32 size)
+    {
+        auto fits = [size](const Block& block)
+        {
+            Uint32 offset = (block.used + ReadbackAlignment - 1) & ~(ReadbackAlignment - 1);
+            return offset + size <= block.size;
+        };
+
+        if (!fits(blocks[currentBlock]))
+        {
+            // Rewind a drained block, or grow
+            Uint32 freeBlock = (Uint32)blocks.size();
+            for (Uint32 i = 0; i < blocks.size(); i++)
+            {
+                if (blocks[i].liveCount == 0 && blocks[i].size >= size)
+                {
+                    freeBlock = i;
+                    break;
+                }
+            }
+            if (freeBlock == blocks.size())
+            {
+                freeBlock = CreateBlock((std::max)(size, (Uint32)ReadbackBlockSize));
+            }
+            blocks[freeBlock].used = 0;
+            currentBlock = freeBlock;
+        }
+
+        Block& block = blocks[currentBlock];
+        Allocation allocation;
+        allocation.block = currentBlock;
+        allocation.offset = (block.used + ReadbackAlignment - 1) & ~(ReadbackAlignment - 1);
+        allocation.size = size;
+        block.used = allocation.offset + size;
+        block.liveCount++;
+        return allocation;
+    }
+
+    void ReadbackRingVk::Release(const Allocation& allocation)
+    {
+        Block& block = blocks[allocation.block];
+        assert(block.liveCount > 0);
+        block.liveCount--;
+    }
+
+    std::span<const std::byte> ReadbackRingVk::Read(const Allocation& allocation)
+    {
+        Block& block = blocks[allocation.block];
+        if (!bCoherent)
+        {
+            auto range = vk::MappedMemoryRange()
+                .setMemory(block.memory.get())
+                .setOffset(0)
+                .setSize(VK_WHOLE_SIZE);
+            deviceData.logicalDevice.invalidateMappedMemoryRanges(range);
+        }
+        return std::span<const std::byte>(block.mappedPtr + allocation.offset, allocation.size);
+    }
+
+} // namespace TinyRHI
+
+#endif
@@ -0,0 +1,64 @@
+#pragma once
+#ifdef RHI_SUPPORT_VULKAN
+
+#include <span>
+#include <vector>
+#include "HeaderVk.h"
+
+namespace TinyRHI
+{
+	#define ReadbackBlockSize (4 * 1024 * 1024)
+	#define ReadbackAlignment 16
+
+	/*
+	* Persistently mapped, host cached blocks that GPU copies land in. Allocations bump through the
+	* current block; a block is rewound once every allocation in it was released, and a new block is
+	* only created when none is free. Recording thread only.
+	*/
+	class ReadbackRingVk
+	{
+	public:
+		struct Allocation
+		{
+			Uint32 block = 0;
+			Uint32 offset = 0;
+			Uint32 size = 0;
+		};
+
+		ReadbackRingVk(const DeviceData& _deviceData);
+		~ReadbackRingVk();
+
+		Allocation Allocate(Uint32 size);
+		void Release(const Allocation& allocation);
+
+		vk::Buffer BufferHandle(const Allocation& allocation) const
+		{
+			return blocks[allocation.block].buffer.get();
+		}
+
+		// Only once the copy into it completed
+		std::span<const std::byte> Read(const Allocation& allocation);
+
+	private:
+		struct Block
+		{
+			vk::UniqueBuffer buffer;
+			vk::UniqueDeviceMemory memory;
+			std::byte* mappedPtr = nullptr;
+			Uint32 size = 0;
+			Uint32 used = 0;
+			Uint32 liveCount = 0;
+		};
+
+		Uint32 CreateBlock(Uint32 size);
+
+		const DeviceData& deviceData;
+		Uint32 memoryTypeIndex;
+		Bool bCoherent;
+
+		std::vector<Block> blocks;
+		Uint32 currentBlock = 0;
+	};
+}
+
+#endif
@@ -4,8 +4,9 @@
 
 using namespace TinyRHI;
 
-GraphicsPipelineVk* RenderResourceVkManager::GetGfxPipeline(const GfxSetting &setting, PipelineLayoutVk *pipelineLayout)
+GraphicsPipelineVk* RenderResourceVkManager::GetGfxPipeline(const GfxSetting &setting, PipelineLayoutVk *pipelineLayout, JobSystem* compileJobs)
 {
+    RHI_PROFILE_ZONE("GetGfxPipeline");
     Uint hashResult = 0;
     Uint32 hashMoveIndex = 0;
     auto vkRenderPass = GetCurrentRenderPass();
@@ -27,7 +28,7 @@ GraphicsPipelineVk* RenderResourceVkManager::GetGfxPipeline(const GfxSetting &se
             .renderPass = vkRenderPass,
             .setting = setting,
         };
-        gfxPipeline = std::make_unique<GraphicsPipelineVk>(deviceData, desc);
+        gfxPipeline = std::make_unique<GraphicsPipelineVk>(deviceData, desc, compileJobs);
     }
     return gfxPipeline.get();
 }
@@ -80,6 +81,19 @@ void RenderResourceVkManager::BeginRenderPass(vk::CommandBuffer cmdBuffer)
         .setPClearValues(clearValues.data());
 
     cmdBuffer.beginRenderPass(beginInfo, vk::SubpassContents::eInline);  
+
+    // The render pass leaves its attachments in their final layouts
+    for(const auto& colorAttachment : colorAttachments)
+    {
+        if(colorAttachment)
+        {
+            colorAttachment->ImageViewHandle()->CurrentLayout() = vk::ImageLayout::ePresentSrcKHR;
+        }
+    }
+    if(depthAttachment)
+    {
+        depthAttachment->ImageViewHandle()->CurrentLayout() = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+    }
 }
 
 void RenderResourceVkManager::EndRenderPass(vk::CommandBuffer cmdBuffer)
@@ -31,7 +31,8 @@ namespace TinyRHI
 
     // Pipeline
     public:
-        GraphicsPipelineVk* GetGfxPipeline(const GfxSetting& setting, PipelineLayoutVk* pipelineLayout);
+        // A new pipeline is compiled on compileJobs when given, see GraphicsPipelineVk
+        GraphicsPipelineVk* GetGfxPipeline(const GfxSetting& setting, PipelineLayoutVk* pipelineLayout, JobSystem* compileJobs = nullptr);
         ComputePipelineVk* GetComputePipeline(PipelineLayoutVk* pipelineLayout);
 
     private:
@@ -94,7 +95,7 @@ namespace TinyRHI
         template<IShader::Stage stage>
         void SetShader(IShader* shader)
         {
-	        ShaderVk<stage>* vkShader = dynamic_cast<ShaderVk<stage>*>(shader);
+	        ShaderVk<stage>* vkShader = CastVk<ShaderVk<stage>>(shader);
             assert(vkShader != nullptr);
 
             if constexpr (stage == IShader::Stage::Vertex)
@@ -0,0 +1,197 @@
+#pragma once
+#ifdef RHI_SUPPORT_VULKAN
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include "HeaderVk.h"
+#include "ResourceHandle.h"
+#include "BufferVk.h"
+#include "ImageViewVk.h"
+
+namespace TinyRHI
+{
+	// Hot data read by binds, copied out of the object when it is added
+	struct BufferSlotVk
+	{
+		vk::Buffer buffer;
+		Uint32 size = 0;
+		IndexType indexType = IndexType::Uint16;
+		BufferType bufferType;
+	};
+
+	struct TextureSlotVk
+	{
+		vk::ImageView imageView;
+		vk::Sampler sampler;
+	};
+
+	struct ShaderSlotVk
+	{
+		IShader::Stage stage;
+	};
+
+	#define ResourcePoolChunkBits 10
+	#define ResourcePoolChunkSize (1u << ResourcePoolChunkBits)
+	#define ResourcePoolChunkCount ((ResourceHandleIndexMask + 1) >> ResourcePoolChunkBits)
+
+	/*
+	* Structure of arrays indexed by ResourceHandle::Index(), in fixed chunks that never move:
+	* generations | slots (hot Vulkan handles and metadata) | objects (owning, cold)
+	* Add and Remove may race with each other and with lookups, they serialize on a mutex.
+	* Lookups take no lock: one chunk load and one generation compare. Removed objects are kept
+	* for MaxFrameInFlight frames, their slot index is reused right away under a new generation.
+	*/
+	template<typename Handle, typename Object, typename Slot>
+	class ResourcePoolVk
+	{
+		struct Chunk
+		{
+			std::array<std::atomic<Uint16>, ResourcePoolChunkSize> generations = {};
+			std::array<Slot, ResourcePoolChunkSize> slots;
+			std::array<std::unique_ptr<Object>, ResourcePoolChunkSize> objects;
+		};
+
+	public:
+		~ResourcePoolVk()
+		{
+			Clear();
+		}
+
+		Handle Add(std::unique_ptr<Object> object, const Slot& slot)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			Uint32 index;
+			if(!freeIndices.empty())
+			{
+				index = freeIndices.back();
+				freeIndices.pop_back();
+			}
+			else
+			{
+				index = indexCount++;
+				assert(index <= ResourceHandleIndexMask);
+				auto& chunk = chunks[index >> ResourcePoolChunkBits];
+				if(!chunk.load(std::memory_order_relaxed))
+				{
+					chunk.store(new Chunk(), std::memory_order_release);
+				}
+			}
+
+			Chunk* chunk = chunks[index >> ResourcePoolChunkBits].load(std::memory_order_relaxed);
+			Uint32 local = index & (ResourcePoolChunkSize - 1);
+			chunk->slots[local] = slot;
+			chunk->objects[local] = std::move(object);
+
+			Uint32 generation = (chunk->generations[local].load(std::memory_order_relaxed) + 1) & ResourceHandleGenerationMask;
+			generation = generation == 0 ? 1 : generation;
+			// Publishes slot and object to lookups on other threads
+			chunk->generations[local].store((Uint16)generation, std::memory_order_release);
+			return Handle::Make(index, generation);
+		}
+
+		Bool IsAlive(Handle handle) const
+		{
+			return Find(handle) != nullptr;
+		}
+
+		// nullptr for an invalid or destroyed handle
+		Object* Get(Handle handle) const
+		{
+			Chunk* chunk = Find(handle);
+			return chunk ? chunk->objects[handle.Index() & (ResourcePoolChunkSize - 1)].get() : nullptr;
+		}
+
+		const Slot* GetSlot(Handle handle) const
+		{
+			Chunk* chunk = Find(handle);
+			return chunk ? &chunk->slots[handle.Index() & (ResourcePoolChunkSize - 1)] : nullptr;
+		}
+
+		// Frame is the one currently recording, the object dies when that frame slot comes around again
+		void Remove(Handle handle, Uint frame)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			Chunk* chunk = Find(handle);
+			if(!chunk)
+			{
+				assert(!handle.IsValid() && "resource destroyed twice");
+				return;
+			}
+			Uint32 index = handle.Index();
+			Uint32 local = index & (ResourcePoolChunkSize - 1);
+			// Odd to even: the slot reads as dead until Add bumps it again
+			Uint32 generation = (handle.Generation() + 1) & ResourceHandleGenerationMask;
+			chunk->generations[local].store((Uint16)generation, std::memory_order_release);
+
+			retired[frame].push_back(std::move(chunk->objects[local]));
+			chunk->slots[local] = Slot();
+			freeIndices.push_back(index);
+		}
+
+		// onDestroy(Object*) runs right before each retired object of the frame is deleted
+		template<typename Func>
+		void BeginFrame(Uint frame, Func&& onDestroy)
+		{
+			std::vector<std::unique_ptr<Object>> frameObjects;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				frameObjects.swap(retired[frame]);
+			}
+			for(auto& object : frameObjects)
+			{
+				onDestroy(object.get());
+			}
+		}
+
+		// Device teardown only, nothing may be in flight
+		void Clear()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for(auto& chunk : chunks)
+			{
+				delete chunk.exchange(nullptr, std::memory_order_relaxed);
+			}
+			for(auto& frameObjects : retired)
+			{
+				frameObjects.clear();
+			}
+			freeIndices.clear();
+			indexCount = 0;
+		}
+
+		Uint32 Size()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return indexCount - (Uint32)freeIndices.size();
+		}
+
+	private:
+		Chunk* Find(Handle handle) const
+		{
+			Uint32 index = handle.Index();
+			Chunk* chunk = chunks[index >> ResourcePoolChunkBits].load(std::memory_order_acquire);
+			if(chunk && handle.Generation() != 0
+				&& chunk->generations[index & (ResourcePoolChunkSize - 1)].load(std::memory_order_acquire) == handle.Generation())
+			{
+				return chunk;
+			}
+			return nullptr;
+		}
+
+		std::array<std::atomic<Chunk*>, ResourcePoolChunkCount> chunks = {};
+		std::mutex mutex;
+		Uint32 indexCount = 0;
+		std::vector<Uint32> freeIndices;
+
+		std::array<std::vector<std::unique_ptr<Object>>, MaxFrameInFlight> retired;
+	};
+
+	using BufferPoolVk = ResourcePoolVk<BufferId, BufferVk, BufferSlotVk>;
+	using TexturePoolVk = ResourcePoolVk<TextureId, TextureVk, TextureSlotVk>;
+	using ShaderPoolVk = ResourcePoolVk<ShaderId, IShader, ShaderSlotVk>;
+}
+
+#endif
@@ -0,0 +1,253 @@
+#ifdef RHI_SUPPORT_VULKAN
+
+#include "SubmitThreadVk.h"
+#include "UploadContextVk.h"
+
+namespace TinyRHI
+{
+    SubmitThreadVk::SubmitThreadVk(const DeviceData& _deviceData, SwapChainTargetVk _swapChainTarget)
+        : deviceData(_deviceData), swapChainTarget(std::move(_swapChainTarget))
+    {
+        swapImages = deviceData.logicalDevice.getSwapchainImagesKHR(swapChainTarget.swapChain->get());
+
+        auto poolInfo = vk::CommandPoolCreateInfo()
+            .setFlags(vk::CommandPoolCreateFlagBits::eTransient)
+            .setQueueFamilyIndex(deviceData.queueFamilyIndices.graphicsFamilyIndex);
+        auto fenceInfo = vk::FenceCreateInfo().setFlags(vk::FenceCreateFlagBits::eSignaled);
+        for (PresentSlotVk& slot : presentSlots)
+        {
+            slot.commandPool = deviceData.logicalDevice.createCommandPoolUnique(poolInfo);
+            auto allocInfo = vk::CommandBufferAllocateInfo()
+                .setCommandPool(slot.commandPool.get())
+                .setLevel(vk::CommandBufferLevel::ePrimary)
+                .setCommandBufferCount(1);
+            slot.cmdBuffer = deviceData.logicalDevice.allocateCommandBuffers(allocInfo)[0];
+            slot.acquireSemaphore = deviceData.logicalDevice.createSemaphoreUnique(vk::SemaphoreCreateInfo());
+            slot.blitFinishedSemaphore = deviceData.logicalDevice.createSemaphoreUnique(vk::SemaphoreCreateInfo());
+            slot.fence = deviceData.logicalDevice.createFenceUnique(fenceInfo);
+        }
+
+        thread = std::thread(&SubmitThreadVk::ThreadLoop, this);
+    }
+
+    SubmitThreadVk::~SubmitThreadVk()
+    {
+        SubmitWorkVk stopWork;
+        stopWork.bStop = true;
+        Push(stopWork);
+        thread.join();
+
+        // The last blits and the presents waiting on them still use the slots
+        auto lock = deviceData.uploadContexts->LockQueues();
+        deviceData.logicalDevice.waitIdle();
+    }
+
+    void SubmitThreadVk::Submit(CommandBufferVk* cmdBuffer, vk::Queue queue)
+    {
+        SubmitWorkVk work;
+        work.cmdBuffer = cmdBuffer;
+        work.queue = queue;
+        Push(work);
+    }
+
+    void SubmitThreadVk::Present(vk::Image backBuffer, vk::Extent2D backBufferExtent, Uint32 frameSlot, vk::Semaphore renderFinished)
+    {
+        assert(frameSlot < MaxFrameInFlight);
+        SubmitWorkVk work;
+        work.backBuffer = backBuffer;
+        work.backBufferExtent = backBufferExtent;
+        work.frameSlot = frameSlot;
+        work.waitSemaphore = renderFinished;
+        pendingPresents.fetch_add(1, std::memory_order_relaxed);
+        Push(work);
+    }
+
+    void SubmitThreadVk::WaitPresents()
+    {
+        Uint32 presents = pendingPresents.load(std::memory_order_acquire);
+        while(presents != 0)
+        {
+            pendingPresents.wait(presents, std::memory_order_acquire);
+            presents = pendingPresents.load(std::memory_order_acquire);
+        }
+    }
+
+    Bool SubmitThreadVk::TakeSwapChainOutOfDate()
+    {
+        return bSwapChainOutOfDate.exchange(false, std::memory_order_acq_rel);
+    }
+
+    void SubmitThreadVk::Push(SubmitWorkVk work)
+    {
+        workQueue.Push(work);
+        pendingCount.fetch_add(1, std::memory_order_release);
+        pendingCount.notify_one();
+    }
+
+    void SubmitThreadVk::ThreadLoop()
+    {
+        while(true)
+        {
+            pendingCount.wait(0, std::memory_order_acquire);
+
+            SubmitWorkVk work;
+            // A producer bumps the count after linking its node, the node may show up a moment later
+            while(!workQueue.Pop(work))
+            {
+                std::this_thread::yield();
+            }
+            pendingCount.fetch_sub(1, std::memory_order_relaxed);
+
+            if(work.bStop)
+            {
+                return;
+            }
+
+            if(work.cmdBuffer)
+            {
+                work.cmdBuffer->QueueSubmit(work.queue);
+            }
+            else
+            {
+                PresentBackBuffer(work);
+                pendingPresents.fetch_sub(1, std::memory_order_release);
+                pendingPresents.notify_all();
+            }
+        }
+    }
+
+    void SubmitThreadVk::PresentBackBuffer(const SubmitWorkVk& work)
+    {
+        PresentSlotVk& slot = presentSlots[work.frameSlot];
+        // The slot's previous blit finished, its semaphores and command buffer are free again
+        auto waitResult = deviceData.logicalDevice.waitForFences(slot.fence.get(), true, UINT64_MAX);
+        assert(waitResult == vk::Result::eSuccess);
+        deviceData.logicalDevice.resetFences(slot.fence.get());
+
+        if(bRecreateSwapChain && swapChainTarget.recreate())
+        {
+            swapImages = deviceData.logicalDevice.getSwapchainImagesKHR(swapChainTarget.swapChain->get());
+            bRecreateSwapChain = false;
+            bSwapChainOutOfDate.store(true, std::memory_order_release);
+        }
+
+        Bool bAcquired = false;
+        Uint32 imageIndex = 0;
+        while(!bRecreateSwapChain && !bAcquired)
+        {
+            try
+            {
+                auto result = deviceData.logicalDevice.acquireNextImageKHR(
+                    swapChainTarget.swapChain->get(), SwapChainAcquireTimeout, slot.acquireSemaphore.get(), nullptr);
+                // eTimeout or eNotReady retry, the driver blocked for the whole timeout
+                bAcquired = result.result == vk::Result::eSuccess || result.result == vk::Result::eSuboptimalKHR;
+                bRecreateSwapChain = result.result == vk::Result::eSuboptimalKHR;
+                imageIndex = result.value;
+            }
+            catch(const vk::OutOfDateKHRError&)
+            {
+                bRecreateSwapChain = true;
+            }
+        }
+
+        auto lock = deviceData.uploadContexts->LockQueues();
+        if(!bAcquired)
+        {
+            // Nothing to present into (a minimized window), the render finished semaphore is still consumed
+            vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+            auto submitInfo = vk::SubmitInfo()
+                .setWaitSemaphoreCount(1)
+                .setPWaitSemaphores(&work.waitSemaphore)
+                .setPWaitDstStageMask(&waitStage);
+            deviceData.graphicsQueue.submit(submitInfo, slot.fence.get());
+            return;
+        }
+
+        RecordBlit(slot, work, swapImages[imageIndex]);
+        vk::Semaphore waitSemaphores[] = { work.waitSemaphore, slot.acquireSemaphore.get() };
+        vk::PipelineStageFlags waitStages[] = { vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer };
+        auto submitInfo = vk::SubmitInfo()
+            .setWaitSemaphoreCount(2)
+            .setPWaitSemaphores(waitSemaphores)
+            .setPWaitDstStageMask(waitStages)
+            .setCommandBufferCount(1)
+            .setPCommandBuffers(&slot.cmdBuffer)
+            .setSignalSemaphoreCount(1)
+            .setPSignalSemaphores(&slot.blitFinishedSemaphore.get());
+        deviceData.graphicsQueue.submit(submitInfo, slot.fence.get());
+
+        vk::PresentInfoKHR presentInfo = vk::PresentInfoKHR()
+            .setSwapchainCount(1)
+            .setPSwapchains(&swapChainTarget.swapChain->get())
+            .setPImageIndices(&imageIndex)
+            .setWaitSemaphoreCount(1)
+            .setPWaitSemaphores(&slot.blitFinishedSemaphore.get());
+        // Recreated before the next acquire
+        try
+        {
+            auto result = deviceData.presentQueue.presentKHR(presentInfo);
+            bRecreateSwapChain |= result == vk::Result::eSuboptimalKHR;
+        }
+        catch(const vk::OutOfDateKHRError&)
+        {
+            bRecreateSwapChain = true;
+        }
+    }
+
+    void SubmitThreadVk::RecordBlit(PresentSlotVk& slot, const SubmitWorkVk& work, vk::Image swapImage)
+    {
+        deviceData.logicalDevice.resetCommandPool(slot.commandPool.get());
+        vk::CommandBuffer cmdBuffer = slot.cmdBuffer;
+        cmdBuffer.begin(vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+        auto subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+        auto backBufferToSrc = vk::ImageMemoryBarrier()
+            .setOldLayout(vk::ImageLayout::ePresentSrcKHR)
+            .setNewLayout(vk::ImageLayout::eTransferSrcOptimal)
+            .setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eTransferRead)
+            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setImage(work.backBuffer)
+            .setSubresourceRange(subresourceRange);
+        // The acquire semaphore wait already happened at the transfer stage
+        auto swapImageToDst = vk::ImageMemoryBarrier(backBufferToSrc)
+            .setOldLayout(vk::ImageLayout::eUndefined)
+            .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+            .setSrcAccessMask(vk::AccessFlags())
+            .setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setImage(swapImage);
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), {}, {}, { backBufferToSrc, swapImageToDst });
+
+        // Scales when the swapchain was recreated and the back buffers have not followed yet
+        vk::Extent2D swapExtent = *swapChainTarget.extent;
+        auto subresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+        auto blitRegion = vk::ImageBlit()
+            .setSrcSubresource(subresource)
+            .setSrcOffsets({ vk::Offset3D(0, 0, 0), vk::Offset3D((Int32)work.backBufferExtent.width, (Int32)work.backBufferExtent.height, 1) })
+            .setDstSubresource(subresource)
+            .setDstOffsets({ vk::Offset3D(0, 0, 0), vk::Offset3D((Int32)swapExtent.width, (Int32)swapExtent.height, 1) });
+        cmdBuffer.blitImage(work.backBuffer, vk::ImageLayout::eTransferSrcOptimal, swapImage, vk::ImageLayout::eTransferDstOptimal,
+            blitRegion, vk::Filter::eLinear);
+
+        // Later commands of this queue render into the back buffer again, they wait for the blit's read
+        auto backBufferToPresent = vk::ImageMemoryBarrier(backBufferToSrc)
+            .setOldLayout(vk::ImageLayout::eTransferSrcOptimal)
+            .setNewLayout(vk::ImageLayout::ePresentSrcKHR)
+            .setSrcAccessMask(vk::AccessFlags())
+            .setDstAccessMask(vk::AccessFlags());
+        auto swapImageToPresent = vk::ImageMemoryBarrier(swapImageToDst)
+            .setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+            .setNewLayout(vk::ImageLayout::ePresentSrcKHR)
+            .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setDstAccessMask(vk::AccessFlags());
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands,
+            vk::DependencyFlags(), {}, {}, { backBufferToPresent, swapImageToPresent });
+
+        cmdBuffer.end();
+    }
+
+} // namespace TinyRHI
+
+#endif
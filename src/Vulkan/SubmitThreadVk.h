@@ -0,0 +1,158 @@
+#pragma once
+#ifdef RHI_SUPPORT_VULKAN
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include "HeaderVk.h"
+#include "CommandBufferVk.h"
+
+namespace TinyRHI
+{
+	// Lock free multi producer, single consumer queue (intrusive list with a stub node)
+	template<typename T>
+	class MpscQueueVk
+	{
+		struct Node
+		{
+			std::atomic<Node*> next = nullptr;
+			T value;
+		};
+
+	public:
+		MpscQueueVk()
+			: head(&stub), tail(&stub)
+		{
+		}
+
+		~MpscQueueVk()
+		{
+			T value;
+			while(Pop(value))
+			{
+			}
+			if(tail != &stub)
+			{
+				delete tail;
+			}
+		}
+
+		void Push(T value)
+		{
+			Node* node = new Node();
+			node->value = std::move(value);
+			Node* prev = head.exchange(node, std::memory_order_acq_rel);
+			prev->next.store(node, std::memory_order_release);
+		}
+
+		// Consumer thread only
+		Bool Pop(T& value)
+		{
+			Node* first = tail;
+			Node* next = first->next.load(std::memory_order_acquire);
+			if(!next)
+			{
+				return false;
+			}
+			// next becomes the new stub, its value is moved out
+			value = std::move(next->value);
+			tail = next;
+			if(first != &stub)
+			{
+				delete first;
+			}
+			return true;
+		}
+
+	private:
+		std::atomic<Node*> head;
+		Node* tail;
+		Node stub;
+	};
+
+	// Nanoseconds one vkAcquireNextImageKHR blocks before it is retried
+	#define SwapChainAcquireTimeout 1000000000ull
+
+	// The swapchain as the submission thread sees it, owned by the handle
+	struct SwapChainTargetVk
+	{
+		vk::UniqueSwapchainKHR* swapChain = nullptr;
+		vk::Extent2D* extent = nullptr;
+		// Rebuilds swapChain and extent, false while the window has no extent
+		std::function<Bool()> recreate;
+	};
+
+	/*
+	* Owns every vkQueueSubmit and vkQueuePresentKHR of the recording thread (HandleDesc::bSubmitThread).
+	* Recorded command buffers and presents are handed over in order through a lock free queue, so a
+	* present blocking on vsync never stalls recording. Work keeps its order, and fences still tell when
+	* it completed: waiting on a command buffer that is not submitted yet just waits a little longer.
+	*
+	* The swapchain belongs to this thread as well. The recording thread renders into a back buffer per
+	* frame slot; a present acquires a swapchain image here, blits the back buffer into it and presents
+	* it, so neither the acquire nor the present ever waits on the recording thread. An out of date
+	* swapchain is recreated here and reported through TakeSwapChainOutOfDate.
+	*/
+	class SubmitThreadVk
+	{
+	public:
+		SubmitThreadVk(const DeviceData& _deviceData, SwapChainTargetVk _swapChainTarget);
+		// Drains the queue first
+		~SubmitThreadVk();
+
+		void Submit(CommandBufferVk* cmdBuffer, vk::Queue queue);
+		// backBuffer was left in ePresentSrcKHR by a command signaling renderFinished, it goes back there
+		void Present(vk::Image backBuffer, vk::Extent2D backBufferExtent, Uint32 frameSlot, vk::Semaphore renderFinished);
+		// Blocks until every pushed present was handled. Only for rare events such as resizing the back buffers
+		void WaitPresents();
+		// True once after the swapchain was recreated with a new extent, the back buffers may follow it
+		Bool TakeSwapChainOutOfDate();
+
+	private:
+		struct SubmitWorkVk
+		{
+			// nullptr for a present
+			CommandBufferVk* cmdBuffer = nullptr;
+			vk::Queue queue;
+			vk::Image backBuffer;
+			vk::Extent2D backBufferExtent;
+			Uint32 frameSlot = 0;
+			vk::Semaphore waitSemaphore;
+			Bool bStop = false;
+		};
+
+		// Per frame slot, reused once the slot's previous blit finished
+		struct PresentSlotVk
+		{
+			vk::UniqueCommandPool commandPool;
+			vk::CommandBuffer cmdBuffer;
+			vk::UniqueSemaphore acquireSemaphore;
+			vk::UniqueSemaphore blitFinishedSemaphore;
+			vk::UniqueFence fence;
+		};
+
+		void Push(SubmitWorkVk work);
+		void ThreadLoop();
+		void PresentBackBuffer(const SubmitWorkVk& work);
+		void RecordBlit(PresentSlotVk& slot, const SubmitWorkVk& work, vk::Image swapImage);
+
+		const DeviceData& deviceData;
+		MpscQueueVk<SubmitWorkVk> workQueue;
+		// Pushed and not yet taken, the thread sleeps on it while zero
+		std::atomic<Uint32> pendingCount = 0;
+		// Presents pushed and not yet handled, WaitPresents sleeps on it
+		std::atomic<Uint32> pendingPresents = 0;
+		std::atomic<Bool> bSwapChainOutOfDate = false;
+
+		// Submission thread only
+		SwapChainTargetVk swapChainTarget;
+		std::vector<vk::Image> swapImages;
+		Bool bRecreateSwapChain = false;
+		std::array<PresentSlotVk, MaxFrameInFlight> presentSlots;
+
+		std::thread thread;
+	};
+}
+
+#endif
@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include "BaseType.h"
 
 namespace TinyRHI
@@ -8,7 +9,8 @@ namespace TinyRHI
     public:
         UniqueHash()
         {
-            hashId = nextId++;
+            // Objects are created from loader threads as well
+            hashId = nextId.fetch_add(1, std::memory_order_relaxed);
         }
 
         Uint32 Hash()
@@ -18,9 +20,9 @@ namespace TinyRHI
 
     protected:
 
-        static Uint32 nextId;
+        static std::atomic<Uint32> nextId;
         Uint32 hashId;
     };
-    inline Uint32 UniqueHash::nextId = 0;
+    inline std::atomic<Uint32> UniqueHash::nextId = 0;
 
 } // namespace TinyRHI
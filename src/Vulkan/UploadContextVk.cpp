@@ -0,0 +1,79 @@
+#ifdef RHI_SUPPORT_VULKAN
+
+#include <unordered_map>
+#include "UploadContextVk.h"
+
+namespace TinyRHI
+{
+    UploadContextsVk::UploadContextsVk(const DeviceData& _deviceData)
+        : deviceData(_deviceData), serial(nextSerial.fetch_add(1, std::memory_order_relaxed))
+    {
+    }
+
+    UploadContextsVk::~UploadContextsVk()
+    {
+        // Every upload waits for its own fence, nothing recorded from these pools is still pending
+        std::lock_guard<std::mutex> lock(poolMutex);
+        threadPools.clear();
+    }
+
+    vk::CommandPool UploadContextsVk::GetThreadPool()
+    {
+        // Entries of destroyed instances stay behind unused, their serials never come back
+        thread_local std::unordered_map<Uint64, vk::CommandPool> cachedPools;
+        auto it = cachedPools.find(serial);
+        if(it != cachedPools.end())
+        {
+            return it->second;
+        }
+
+        auto commandPoolCreateInfo = vk::CommandPoolCreateInfo()
+            .setFlags(vk::CommandPoolCreateFlagBits::eTransient)
+            .setQueueFamilyIndex(deviceData.queueFamilyIndices.graphicsFamilyIndex);
+        vk::UniqueCommandPool commandPool = deviceData.logicalDevice.createCommandPoolUnique(commandPoolCreateInfo);
+        vk::CommandPool pool = commandPool.get();
+        {
+            std::lock_guard<std::mutex> lock(poolMutex);
+            threadPools.push_back(std::move(commandPool));
+        }
+        cachedPools[serial] = pool;
+        return pool;
+    }
+
+    vk::CommandBuffer BeginSingleTimeCommands(const DeviceData& deviceData)
+    {
+        auto cmdBufferAllocInfo = vk::CommandBufferAllocateInfo()
+            .setLevel(vk::CommandBufferLevel::ePrimary)
+            .setCommandPool(deviceData.uploadContexts->GetThreadPool())
+            .setCommandBufferCount(1);
+        vk::CommandBuffer cmdBuffer = (deviceData.logicalDevice.allocateCommandBuffers(cmdBufferAllocInfo))[0];
+
+        auto beginInfo = vk::CommandBufferBeginInfo()
+            .setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+        cmdBuffer.begin(beginInfo);
+
+        return cmdBuffer;
+    }
+
+    void EndSingleTimeCommands(const DeviceData& deviceData, vk::CommandBuffer cmdBuffer)
+    {
+        cmdBuffer.end();
+
+        auto submitInfo = vk::SubmitInfo()
+            .setCommandBufferCount(1)
+            .setPCommandBuffers(&cmdBuffer);
+        // Wait on a fence of our own instead of the queue, other threads keep submitting meanwhile
+        vk::UniqueFence uploadFence = deviceData.logicalDevice.createFenceUnique(vk::FenceCreateInfo());
+        {
+            auto lock = deviceData.uploadContexts->LockQueues();
+            deviceData.graphicsQueue.submit({ submitInfo }, uploadFence.get());
+        }
+        auto result = deviceData.logicalDevice.waitForFences(uploadFence.get(), true, UINT64_MAX);
+        assert(result == vk::Result::eSuccess);
+
+        deviceData.logicalDevice.freeCommandBuffers(deviceData.uploadContexts->GetThreadPool(), { cmdBuffer });
+    }
+
+} // namespace TinyRHI
+
+#endif
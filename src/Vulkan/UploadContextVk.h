@@ -0,0 +1,51 @@
+#pragma once
+#ifdef RHI_SUPPORT_VULKAN
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "HeaderVk.h"
+
+namespace TinyRHI
+{
+	/*
+	* Concurrency model of a VkHandle:
+	*  - Resource creation (Create*Shader, CreateBuffer*, CreateTexture*, Create*Id, Destroy*, Get*)
+	*    may be called from any thread, concurrently with recording.
+	*  - Everything returning IRHIHandle*, CreateBindingGroup and CreateDrawPipeline belong to the
+	*    single recording thread.
+	* Uploads record into a transient command pool owned by the calling thread. Every submit and
+	* present on the device's queues goes through LockQueues, vkQueueSubmit is externally synchronized.
+	*/
+	class UploadContextsVk
+	{
+	public:
+		UploadContextsVk(const DeviceData& _deviceData);
+		~UploadContextsVk();
+
+		UploadContextsVk(const UploadContextsVk&) = delete;
+		UploadContextsVk& operator=(const UploadContextsVk&) = delete;
+
+		// Pool of the calling thread, created on its first upload
+		vk::CommandPool GetThreadPool();
+
+		std::unique_lock<std::mutex> LockQueues()
+		{
+			return std::unique_lock<std::mutex>(queueMutex);
+		}
+
+	private:
+		const DeviceData& deviceData;
+		// Keys the per thread pool cache, never reused by another instance
+		Uint64 serial;
+
+		std::mutex poolMutex;
+		std::vector<vk::UniqueCommandPool> threadPools;
+
+		std::mutex queueMutex;
+
+		static inline std::atomic<Uint64> nextSerial = 1;
+	};
+}
+
+#endif
@@ -0,0 +1,259 @@
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <cassert>
+#include <cmath>
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include "RHIHandleFactory.h"
+#include "IBuffer.h"
+#include "GpuCulling.h"
+
+// Must match test_gpuCulling_example_vert.vert
+const uint32_t GRID_SIZE = 16;
+const float GRID_EXTENT = 1.5f;
+const float QUAD_HALF_SIZE = 0.08f;
+// Hi-Z pyramid of a static occluder in front of the screen center
+const uint32_t HIZ_SIZE = 16;
+const float OCCLUDER_DEPTH = 0.25f;
+
+static std::vector<char> readFile(const std::string& filename)
+{
+    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open file!");
+    }
+
+    size_t fileSize = (size_t) file.tellg();
+    std::vector<char> buffer(fileSize);
+
+    file.seekg(0);
+    file.read(buffer.data(), fileSize);
+
+    file.close();
+
+    return buffer;
+}
+
+std::vector<Float> vertex =
+{
+    -QUAD_HALF_SIZE, -QUAD_HALF_SIZE,
+    QUAD_HALF_SIZE, -QUAD_HALF_SIZE,
+    QUAD_HALF_SIZE, QUAD_HALF_SIZE,
+    -QUAD_HALF_SIZE, QUAD_HALF_SIZE,
+};
+
+std::vector<uint16_t> index =
+{
+    0, 1, 2, 2, 3, 0
+};
+
+// A grid wider than the screen, the columns panned out of view are culled on the GPU
+void ProduceObjects(std::vector<TinyRHI::CullingObject>& objects)
+{
+    for (uint32_t i = 0; i < GRID_SIZE * GRID_SIZE; i++)
+    {
+        float cellX = (i % GRID_SIZE + 0.5f) / GRID_SIZE * 2.0f * GRID_EXTENT - GRID_EXTENT;
+        float cellY = (i / GRID_SIZE + 0.5f) / GRID_SIZE * 2.0f * GRID_EXTENT - GRID_EXTENT;
+        objects.push_back(TinyRHI::CullingObject
+        {
+            .boundsCenter = { cellX, cellY, 0.5f },
+            .boundsRadius = QUAD_HALF_SIZE * 1.4143f,
+            .indexCount = (Uint32)index.size(),
+            .firstIndex = 0,
+            .vertexOffset = 0,
+            .firstInstance = i,
+        });
+    }
+}
+
+// One mip is enough for the small quads. Nothing was drawn outside of the occluder, its texels keep the far plane
+void ProduceHiZ(std::vector<float>& hiZ)
+{
+    hiZ.assign(HIZ_SIZE * HIZ_SIZE, 1.0f);
+    for (uint32_t y = HIZ_SIZE / 4; y < HIZ_SIZE * 3 / 4; y++)
+    {
+        for (uint32_t x = HIZ_SIZE / 4; x < HIZ_SIZE * 3 / 4; x++)
+        {
+            hiZ[y * HIZ_SIZE + x] = OCCLUDER_DEPTH;
+        }
+    }
+}
+
+int main()
+{
+    glfwInit();
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    GLFWwindow* window = glfwCreateWindow(1024, 1024, "Test_GpuCulling_Example", nullptr, nullptr);
+    // Without the drawIndirectCount feature the culled draw is skipped and the window stays clear
+    TinyRHI::IRHIHandle* pHandle = TinyRHI::RHIHandleFactory::getHandle(window);
+
+    TinyRHI::AttachmentDesc attachmentDesc
+    {
+        .format = Format::BGRA8_SRGB,
+        .loadOp = TinyRHI::AttachmentDesc::LoadOp::Clear,
+        .clearValue =
+        {
+            .color = {0, 0, 0, 1}
+        }
+    };
+
+    TinyRHI::IBuffer* pVertex = pHandle->CreateBufferWithData(
+        TinyRHI::BufferDesc
+        {
+            .bufferType
+            {
+                .bVertex = true
+            },
+            .elementNum = 4,
+            .stride = sizeof(Float) * 2,
+            .bStaging = true,
+        }, vertex.data(), sizeof(Float) * vertex.size());
+
+    TinyRHI::IBuffer* pIndex = pHandle->CreateBufferWithData(
+        TinyRHI::BufferDesc
+        {
+            .bufferType
+            {
+                .bIndex = true
+            },
+            .elementNum = (Uint32)index.size(),
+            .stride = sizeof(uint16_t),
+            .bStaging = true,
+            .indexType = TinyRHI::IndexType::Uint16,
+        }, index.data(), sizeof(uint16_t) * index.size());
+
+    auto vertShaderCode = readFile("shader/spirv/test_gpuCulling_example_vert.spv");
+    auto vertShader = pHandle->CreateVertexShader(TinyRHI::ShaderDesc
+    {
+        .codeData = vertShaderCode.data(),
+        .codeSize = (Uint32)vertShaderCode.size(),
+    });
+
+    auto pixelShaderCode = readFile("shader/spirv/test_gpuCulling_example_frag.spv");
+    auto pixelShader = pHandle->CreatePixelShader(TinyRHI::ShaderDesc
+    {
+        .codeData = pixelShaderCode.data(),
+        .codeSize = (Uint32)pixelShaderCode.size(),
+    });
+
+    auto cullShaderCode = readFile("shader/spirv/GpuCulling.spv");
+    auto cullShader = pHandle->CreateComputeShader(TinyRHI::ShaderDesc
+    {
+        .codeData = cullShaderCode.data(),
+        .codeSize = (Uint32)cullShaderCode.size(),
+    });
+
+    auto occlusionShaderCode = readFile("shader/spirv/GpuCullingOcclusion.spv");
+    auto occlusionShader = pHandle->CreateComputeShader(TinyRHI::ShaderDesc
+    {
+        .codeData = occlusionShaderCode.data(),
+        .codeSize = (Uint32)occlusionShaderCode.size(),
+    });
+
+    std::vector<float> hiZ;
+    ProduceHiZ(hiZ);
+    TinyRHI::ITexture* pHiZ = pHandle->CreateTextureWithData(
+        TinyRHI::ImageDesc
+        {
+            .size3 = {HIZ_SIZE, HIZ_SIZE, 1},
+            .format = Format::R32_FLOAT,
+            .bStaging = true,
+            .usage =
+            {
+                .Sample = true,
+            },
+        },
+        TinyRHI::SamplerState
+        {
+            .addressMode = TinyRHI::SamplerState::AddressMode::Clamp2Edge,
+            .filterType = TinyRHI::SamplerState::FilterType::Nearest,
+        }, hiZ.data(), sizeof(float) * (Uint32)hiZ.size());
+
+    std::vector<TinyRHI::CullingObject> objects;
+    ProduceObjects(objects);
+    TinyRHI::GpuCulling culling(pHandle, TinyRHI::GpuCullingDesc
+    {
+        .frustumShader = cullShader,
+        .occlusionShader = occlusionShader,
+        .maxObjectCount = (Uint32)objects.size(),
+    });
+    culling.UpdateObjects(objects.data(), (Uint32)objects.size());
+
+    auto gfxSetting = TinyRHI::GfxSetting
+    {
+        .vertexDecl
+        {
+            .vertexBindings
+            {
+                {
+                    .binding = 0,
+                    .stride = sizeof(Float) * 2,
+                    .bInstance = false,
+                },
+            },
+            .attributeDescs
+            {
+                TinyRHI::VertexDeclaration::VertexAttributeDesc
+                {
+                    .location = 0,
+                    .binding = 0,
+                    .offset = 0,
+                    .format = TinyRHI::AttribType::Vec2,
+                },
+            },
+        },
+        .blendSettings
+        {
+            TinyRHI::BlendSetting::Opaque,
+        },
+    };
+
+    while(!glfwWindowShouldClose(window))
+    {
+        glfwPollEvents();
+
+        // Pan the camera sideways, viewProj is a plain translation
+        float pan[2] = { 0.5f * (float)sin(glfwGetTime()), 0.0f };
+        TinyRHI::CullingView view;
+        view.viewProj[0] = view.viewProj[5] = view.viewProj[10] = view.viewProj[15] = 1.0f;
+        view.viewProj[12] = pan[0];
+        view.viewProj[13] = pan[1];
+        TinyRHI::GpuCulling::ExtractFrustumPlanes(view);
+        view.hiZSize[0] = view.hiZSize[1] = (float)HIZ_SIZE;
+        view.hiZMipCount = 1;
+        culling.UpdateView(view);
+        // Every other two seconds the quads behind the occluder are culled too, leaving a hole in the center
+        bool bOcclusion = (int)glfwGetTime() / 2 % 2 == 1;
+
+        pHandle->
+            BeginFrame()->
+                BeginCommand();
+                    // Pass1: cull the grid against the view (and the Hi-Z), survivors become indirect draws
+                    culling.Cull(bOcclusion ? pHiZ : nullptr);
+        pHandle->
+                    // Pass2: draw the survivors with the GPU written count
+                    SetDefaultAttachments(attachmentDesc)->
+                    BeginRenderPass()->
+                        SetVertexShader(vertShader)->
+                        SetPixelShader(pixelShader)->
+                        SetPushConstants(TinyRHI::IShader::Stage::Vertex, pan, sizeof(pan), 0)->
+                        SetGraphicsPipeline(gfxSetting)->
+                        SetViewport(Extent2D(0, 0), Extent2D(1024, 1024))->
+                        SetScissor(Extent2D(0, 0), Extent2D(1024, 1024))->
+                        SetVertexStream(0, pVertex, 0);
+                        culling.Draw(pIndex);
+        pHandle->
+                    EndRenderPass()->
+                EndCommand()->
+                Commit()->
+            EndFrame();
+    }
+
+    glfwDestroyWindow(window);
+
+    return 0;
+}
@@ -0,0 +1,22 @@
+#version 450
+
+layout(location = 0) in vec2 inPosition;
+
+layout(push_constant) uniform View {
+    vec2 pan;
+} view;
+
+layout(location = 0) out vec3 fragColor;
+
+// Must match the object grid in TinyRHI_gpuCulling_example.cpp
+const uint GRID_SIZE = 16;
+const float GRID_EXTENT = 1.5;
+
+void main() {
+    // firstInstance of each surviving draw is its object index
+    uint index = gl_InstanceIndex;
+    vec2 cell = vec2(index % GRID_SIZE, index / GRID_SIZE);
+    vec2 center = (cell + 0.5) / float(GRID_SIZE) * 2.0 * GRID_EXTENT - GRID_EXTENT;
+    gl_Position = vec4(center + inPosition + view.pan, 0.5, 1.0);
+    fragColor = vec3(cell / float(GRID_SIZE), 1.0);
+}